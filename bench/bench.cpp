@@ -0,0 +1,437 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+// Scaling benchmark: generates an executable and a graph of libraries it depends on, runs
+// dylibbundler on them and compares what the run cost with the budgets in budgets.txt.
+//
+// The same program stands in for otool, install_name_tool and codesign when it's run under
+// their names, doing their work with the native tool backend, so the external backend can be
+// measured anywhere.
+
+#include "Fixture.h"
+#include "MachO.h"
+#include "Settings.h"
+#include "ToolBackend.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+
+// ---- stand-in tools ----
+
+int otool(int argc, char** argv)
+{
+    if (argc != 3 || strcmp(argv[1], "-l") != 0)
+    {
+        std::cerr << "otool stand-in: only -l <file> is supported" << std::endl;
+        return 1;
+    }
+    const std::string output = tools().loadCommands(argv[2]);
+    if (output.empty())
+    {
+        std::cerr << argv[2] << ": is not an object file" << std::endl;
+        return 1;
+    }
+    std::cout << output;
+    return 0;
+}
+
+int installNameTool(int argc, char** argv)
+{
+    bool ok = false;
+    if (argc == 5 && strcmp(argv[1], "-change") == 0) ok = tools().changeInstallName(argv[4], argv[2], argv[3]);
+    else if (argc == 4 && strcmp(argv[1], "-id") == 0) ok = tools().changeId(argv[3], argv[2]);
+    else if (argc == 5 && strcmp(argv[1], "-rpath") == 0) ok = tools().changeRpath(argv[4], argv[2], argv[3]);
+    else
+    {
+        std::cerr << "install_name_tool stand-in: only -change, -id and -rpath are supported" << std::endl;
+        return 1;
+    }
+    if (!ok) std::cerr << "install_name_tool stand-in: can't edit " << argv[argc - 1] << std::endl;
+    return ok ? 0 : 1;
+}
+
+int codesign(int argc, char** argv)
+{
+    // the options are always the same ones, for an ad-hoc signature
+    if (argc < 2 || !tools().codesign(argv[argc - 1]))
+    {
+        std::cerr << "codesign stand-in: can't sign " << (argc < 2 ? "" : argv[argc - 1]) << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// ---- generated Mach-O files ----
+
+// An arm64 image with the given id (for a library), dependencies and rpaths
+std::string image(uint32_t filetype, const std::string& id, const std::vector<std::string>& dependencies,
+                  const std::vector<std::string>& rpaths, uint32_t seed)
+{
+    Fixture::Image image;
+    image.filetype = filetype;
+    image.id = id;
+    image.dependencies = dependencies;
+    image.rpaths = rpaths;
+    image.seed = seed;
+    return Fixture::image(image);
+}
+
+// ---- the dependency graph ----
+
+struct Options
+{
+    std::string dylibbundler;
+    std::string name;
+    std::string backend = "native";
+    std::string budgets;
+    size_t libraries = 100;
+    size_t fanout = 4;        // dependencies of each library, at most
+    double symlinks = 0.2;    // libraries installed behind a versioned symlink
+    double rpaths = 0.5;      // dependencies given as @rpath/ rather than a full path
+    bool keep = false;
+};
+
+// same numbers on every platform, unlike the distributions of <random>
+class Random
+{
+    uint64_t state;
+public:
+    explicit Random(uint64_t seed) : state(seed){}
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    size_t below(size_t limit){ return size_t(next() % limit); }
+    bool chance(double probability){ return (next() % 1000000) < probability * 1000000; }
+};
+
+bool writeFile(const std::string& path, const std::string& contents)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file << contents;
+    return bool(file);
+}
+
+bool makeDirectories(const std::string& path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+    {
+        const std::string part = path.substr(0, slash);
+        if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
+
+// Library n depends on libraries 2n+1 and 2n+2, so that every one is reachable from the first,
+// which the executable depends on, and on others after it up to 'fanout' dependencies.
+bool generate(const std::string& root, const Options& options)
+{
+    if (!makeDirectories(root + "/lib") || !makeDirectories(root + "/app/Contents/MacOS")) return false;
+
+    Random random(0x9e3779b97f4a7c15ULL);
+    const std::string lib = root + "/lib/";
+    auto reference = [&](size_t n, bool& uses_rpath)
+    {
+        const std::string name = "lib" + std::to_string(n) + ".dylib";
+        if (!random.chance(options.rpaths)) return lib + name;
+        uses_rpath = true;
+        return "@rpath/" + name;
+    };
+
+    for (size_t n = 0; n < options.libraries; n++)
+    {
+        std::vector<size_t> picked;
+        for (size_t child = 2 * n + 1; child <= 2 * n + 2 && child < options.libraries; child++) picked.push_back(child);
+        const size_t after = options.libraries - n - 1;
+        for (size_t tries = 0; picked.size() < options.fanout && picked.size() < after && tries < 4 * options.fanout; tries++)
+        {
+            const size_t dependency = n + 1 + random.below(after);
+            if (std::find(picked.begin(), picked.end(), dependency) == picked.end()) picked.push_back(dependency);
+        }
+
+        std::vector<std::string> dependencies;
+        bool uses_rpath = false;
+        for (size_t dependency : picked) dependencies.push_back(reference(dependency, uses_rpath));
+        std::vector<std::string> rpaths;
+        if (uses_rpath) rpaths.push_back("@loader_path/");
+
+        const std::string name = "lib" + std::to_string(n) + ".dylib";
+        const bool behind_symlink = random.chance(options.symlinks);
+        const std::string file = behind_symlink ? "lib" + std::to_string(n) + ".1.dylib" : name;
+        const std::string contents = image(MachO::MH_DYLIB, lib + name, dependencies, rpaths, uint32_t(n));
+        if (contents.empty() || !writeFile(lib + file, contents)) return false;
+        if (behind_symlink && symlink(file.c_str(), (lib + name).c_str()) != 0) return false;
+    }
+
+    bool uses_rpath = false;
+    const std::vector<std::string> dependencies(1, reference(0, uses_rpath));
+    std::vector<std::string> rpaths;
+    if (uses_rpath) rpaths.push_back("@loader_path/../../../lib");
+    const std::string executable = root + "/app/Contents/MacOS/exe";
+    return writeFile(executable, image(MachO::MH_EXECUTE, "", dependencies, rpaths, 0)) && chmod(executable.c_str(), 0755) == 0;
+}
+
+// ---- running and measuring ----
+
+int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+size_t countFiles(const std::string& directory)
+{
+    size_t amount = 0;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return 0;
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.') amount++;
+    }
+    closedir(dir);
+    return amount;
+}
+
+// "name value" lines, as written by --stats
+std::map<std::string, long long> readStats(const std::string& path)
+{
+    std::map<std::string, long long> stats;
+    std::ifstream file(path.c_str());
+    std::string name;
+    long long value;
+    while (file >> name >> value) stats[name] = value;
+    return stats;
+}
+
+// Lines of "<benchmark> <metric> <maximum>", blank lines and lines starting with '#' are skipped.
+std::map<std::string, long long> readBudgets(const std::string& path, const std::string& benchmark)
+{
+    std::map<std::string, long long> budgets;
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        std::cerr << "\n\nError : Cannot read budgets file " << path << std::endl;
+        exit(1);
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+        char name[256], metric[256];
+        long long maximum;
+        if (sscanf(line.c_str(), "%255s %255s %lld", name, metric, &maximum) == 3 && benchmark == name) budgets[metric] = maximum;
+    }
+    return budgets;
+}
+
+std::string selfPath(const char* argv0)
+{
+    char resolved[PATH_MAX];
+    if (!realpath(argv0, resolved))
+    {
+        std::cerr << "\n\nError : Cannot find this program from " << argv0 << std::endl;
+        exit(1);
+    }
+    return resolved;
+}
+
+// runs dylibbundler in 'root' with the stand-in tools first in PATH, its output going to 'log'
+int runDylibbundler(const std::string& root, const Options& options, struct rusage& usage)
+{
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        const char* path = getenv("PATH");
+        setenv("PATH", (root + "/tools:" + (path ? path : "/usr/bin:/bin")).c_str(), 1);
+        const int log = open((root + "/log").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (chdir(root.c_str()) != 0 || log < 0) _exit(127);
+        dup2(log, 1);
+        dup2(log, 2);
+        const std::string stats = root + "/stats";
+        const char* args[] = { options.dylibbundler.c_str(), "-b", "-cd", "--no-prompt",
+                               "-x", "app/Contents/MacOS/exe", "-d", "app/Contents/Frameworks",
+                               "-p", "@executable_path/../Frameworks/",
+                               "--tool-backend", options.backend.c_str(), "--stats", stats.c_str(), nullptr };
+        execv(args[0], const_cast<char* const*>(args));
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int runBenchmark(const Options& options, const std::string& self)
+{
+    const char* tmp = getenv("TMPDIR");
+    std::string root_template = std::string(tmp && *tmp ? tmp : "/tmp") + "/dylibbundler-bench.XXXXXX";
+    if (!mkdtemp(&root_template[0]))
+    {
+        std::cerr << "\n\nError : Cannot create a directory in " << (tmp && *tmp ? tmp : "/tmp") << std::endl;
+        return 1;
+    }
+    const std::string root = root_template;
+
+    const char* stand_ins[] = { "otool", "install_name_tool", "codesign" };
+    bool ready = generate(root, options) && makeDirectories(root + "/tools");
+    for (const char* tool : stand_ins)
+    {
+        ready = ready && symlink(self.c_str(), (root + "/tools/" + tool).c_str()) == 0;
+    }
+    if (!ready)
+    {
+        std::cerr << "\n\nError : Cannot generate the libraries in " << root << std::endl;
+        return 1;
+    }
+
+    std::cout << "* " << options.name << ": " << options.libraries << " libraries, at most " << options.fanout
+              << " dependencies each, " << int(options.symlinks * 100) << "% behind symlinks, "
+              << int(options.rpaths * 100) << "% of dependencies through @rpath, " << options.backend << " tools" << std::endl;
+
+    struct rusage usage;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int status = runDylibbundler(root, options, usage);
+    const long long wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t bundled = countFiles(root + "/app/Contents/Frameworks");
+    if (status != 0 || bundled != options.libraries)
+    {
+        std::ifstream log((root + "/log").c_str());
+        std::cerr << log.rdbuf();
+        std::cerr << "\n\nError : dylibbundler exited with status " << status << " and bundled " << bundled
+                  << " of the " << options.libraries << " libraries, see " << root << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, long long> metrics = readStats(root + "/stats");
+    metrics["wall_ms"] = wall_ms;
+#ifdef __APPLE__
+    metrics["peak_rss_kb"] = usage.ru_maxrss / 1024;
+#else
+    metrics["peak_rss_kb"] = usage.ru_maxrss;
+#endif
+
+    const std::map<std::string, long long> budgets = options.budgets.empty() ? std::map<std::string, long long>() : readBudgets(options.budgets, options.name);
+    int over = 0;
+    for (const auto& metric : metrics)
+    {
+        printf("  %-18s %12lld", metric.first.c_str(), metric.second);
+        const auto budget = budgets.find(metric.first);
+        if (budget != budgets.end())
+        {
+            printf("   budget %12lld%s", budget->second, metric.second > budget->second ? "   OVER" : "");
+            if (metric.second > budget->second) over++;
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+
+    if (options.keep) std::cout << "* Kept " << root << std::endl;
+    else nftw(root.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    if (over > 0)
+    {
+        std::cerr << "\n\nError : " << options.name << " went over " << over << " of its budgets" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void showHelp()
+{
+    std::cout << "dylibbundler-bench --dylibbundler <path> [options]" << std::endl;
+    std::cout << "--name <name of the benchmark in the budgets file (by default, '<backend>-<libraries>')>" << std::endl;
+    std::cout << "--budgets <file of '<name> <metric> <maximum>' lines, the run fails if it goes over one>" << std::endl;
+    std::cout << "--backend <native|external (run with the stand-in tools)>" << std::endl;
+    std::cout << "--libraries <amount of libraries (by default, 100)>" << std::endl;
+    std::cout << "--fanout <dependencies of each library, at most (by default, 4)>" << std::endl;
+    std::cout << "--symlinks <fraction of libraries installed behind a versioned symlink (by default, 0.2)>" << std::endl;
+    std::cout << "--rpaths <fraction of dependencies given as @rpath/ (by default, 0.5)>" << std::endl;
+    std::cout << "--keep (don't remove the generated files)" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    const char* slash = strrchr(argv[0], '/');
+    const std::string program = slash ? slash + 1 : argv[0];
+    if (program == "otool" || program == "install_name_tool" || program == "codesign")
+    {
+        Settings::toolBackend("native");
+        selectTools();
+        if (program == "otool") return otool(argc, argv);
+        if (program == "install_name_tool") return installNameTool(argc, argv);
+        return codesign(argc, argv);
+    }
+
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--keep") options.keep = true;
+        else if (arg == "--dylibbundler" && has_value) options.dylibbundler = argv[++i];
+        else if (arg == "--name" && has_value) options.name = argv[++i];
+        else if (arg == "--budgets" && has_value) options.budgets = argv[++i];
+        else if (arg == "--backend" && has_value) options.backend = argv[++i];
+        else if (arg == "--libraries" && has_value) options.libraries = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--fanout" && has_value) options.fanout = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--symlinks" && has_value) options.symlinks = atof(argv[++i]);
+        else if (arg == "--rpaths" && has_value) options.rpaths = atof(argv[++i]);
+        else
+        {
+            showHelp();
+            return 1;
+        }
+    }
+    if (options.dylibbundler.empty() || options.libraries == 0 || (options.backend != "native" && options.backend != "external"))
+    {
+        showHelp();
+        return 1;
+    }
+    if (options.name.empty()) options.name = options.backend + "-" + std::to_string(options.libraries);
+    return runBenchmark(options, selfPath(argv[0]));
+}
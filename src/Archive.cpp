@@ -0,0 +1,606 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Archive.h"
+#include "Log.h"
+#include "Materialize.h"
+#include "Pipeline.h"
+#include "Reactor.h"
+#include "Settings.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace Archive
+{
+
+namespace
+{
+
+// how much of a tar stream is compressed at once, as one gzip member
+const size_t GZIP_CHUNK_SIZE = 1 << 20;
+
+bool endsWith(const std::string& text, const std::string& end)
+{
+    return text.size() >= end.size() && text.compare(text.size() - end.size(), end.size(), end) == 0;
+}
+
+// the components of 'path' made absolute, without "." or "..", and symbolic links left as they are
+std::vector<std::string> pathComponents(const std::string& path)
+{
+    std::string absolute = path;
+    char cwd[PATH_MAX];
+    if (path.empty() || path[0] != '/') absolute = std::string(getcwd(cwd, sizeof(cwd)) ? cwd : "") + "/" + path;
+    std::vector<std::string> components;
+    for (size_t start = 0; start <= absolute.size(); )
+    {
+        size_t end = absolute.find('/', start);
+        if (end == std::string::npos) end = absolute.size();
+        const std::string component = absolute.substr(start, end - start);
+        if (component == ".." && !components.empty()) components.pop_back();
+        else if (!component.empty() && component != "." && component != "..") components.push_back(component);
+        start = end + 1;
+    }
+    return components;
+}
+
+// Entries are relative to the folder holding the app bundle the libraries go to or, when they
+// don't go to one, to the parent of the dest folder, so that the archive unpacks anywhere.
+std::vector<std::string> root;
+
+std::string rootPath()
+{
+    std::string path;
+    for (const auto& component : root) path += "/" + component;
+    return path.empty() ? "/" : path;
+}
+
+// the name of 'path' in the archive, relative to the root; exits if it's outside of it
+std::string entryName(const std::string& path)
+{
+    const std::vector<std::string> components = pathComponents(path);
+    if (components.size() <= root.size() || !std::equal(root.begin(), root.end(), components.begin()))
+    {
+        std::cerr << "\n\nError : Cannot add " << path << " to the archive, as it's outside of " << rootPath()
+                  << ", where the archive starts" << std::endl;
+        exit(1);
+    }
+    std::string name = components[root.size()];
+    for (size_t n = root.size() + 1; n < components.size(); n++) name += "/" + components[n];
+    return name;
+}
+
+void putLittle16(std::string& out, uint16_t value)
+{
+    out += char(value & 0xff);
+    out += char(value >> 8);
+}
+
+void putLittle32(std::string& out, uint32_t value)
+{
+    putLittle16(out, value & 0xffff);
+    putLittle16(out, value >> 16);
+}
+
+// Runs tasks on Settings::jobs() threads. submit() waits while twice as many are pending.
+class TaskPool
+{
+    BoundedQueue<std::function<void()> > tasks;
+    std::vector<std::thread> threads;
+public:
+    TaskPool() : tasks(2*Settings::jobs())
+    {
+        for (int n=0; n<Settings::jobs(); n++)
+        {
+            threads.emplace_back([this]()
+            {
+                std::function<void()> task;
+                while (tasks.pop(task)) task();
+            });
+        }
+    }
+    ~TaskPool(){ finish(); }
+    void submit(std::function<void()> task){ tasks.push(std::move(task)); }
+    // runs what was submitted, and stops the threads
+    void finish()
+    {
+        tasks.close();
+        for (auto& thread : threads) if (thread.joinable()) thread.join();
+    }
+};
+
+// where the bytes of a tar stream go
+class Sink
+{
+public:
+    virtual ~Sink(){}
+    virtual void write(const std::string& data) = 0;
+    virtual bool close() = 0;
+};
+
+class FileSink : public Sink
+{
+    int fd;
+    bool failed;
+public:
+    explicit FileSink(int fd) : fd(fd), failed(fd < 0) {}
+    ~FileSink(){ if (fd >= 0) ::close(fd); }
+    void write(const std::string& data) override
+    {
+        for (size_t done = 0; !failed && done < data.size(); )
+        {
+            const ssize_t written = ::write(fd, data.data() + done, data.size() - done);
+            if (written < 0 && errno == EINTR) continue;
+            failed = written <= 0;
+            if (!failed) done += written;
+        }
+    }
+    bool close() override
+    {
+        const bool closed = fd >= 0 && ::close(fd) == 0;
+        fd = -1;
+        return closed && !failed;
+    }
+};
+
+// Compresses the stream in chunks on all cores, each chunk as a gzip member of its own.
+// Members are written in order, and one after the other they make a valid gzip file.
+class GzipSink : public Sink
+{
+    FileSink& out;
+    TaskPool pool;
+    std::string chunk;
+    std::mutex mutex;
+    std::map<size_t, std::string> compressed; // finished out of order, by chunk number
+    size_t submitted;
+    size_t written;
+    bool failed;
+
+    // compresses the first 'size' bytes of what's pending
+    void submit(size_t size)
+    {
+        std::shared_ptr<std::string> data(new std::string(chunk, 0, size));
+        chunk.erase(0, size);
+        const size_t number = submitted++;
+        pool.submit([this, data, number]()
+        {
+            std::string member;
+            const bool ok = compress(*data, member);
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = failed || !ok;
+            compressed[number].swap(member);
+            for (auto next = compressed.find(written); next != compressed.end(); next = compressed.find(written))
+            {
+                out.write(next->second);
+                compressed.erase(next);
+                written++;
+            }
+        });
+    }
+
+    static bool compress(const std::string& data, std::string& member)
+    {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        // 16 more window bits ask for a gzip header and trailer
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+        member.resize(deflateBound(&stream, data.size()));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = data.size();
+        stream.next_out = reinterpret_cast<Bytef*>(&member[0]);
+        stream.avail_out = member.size();
+        const bool ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+        member.resize(stream.total_out);
+        deflateEnd(&stream);
+        return ok;
+    }
+
+public:
+    explicit GzipSink(FileSink& out) : out(out), submitted(0), written(0), failed(false) {}
+    void write(const std::string& data) override
+    {
+        chunk += data;
+        while (chunk.size() >= GZIP_CHUNK_SIZE) submit(GZIP_CHUNK_SIZE);
+    }
+    bool close() override
+    {
+        if (!chunk.empty() || submitted == 0) submit(chunk.size());
+        pool.finish();
+        return !failed && written == submitted && out.close();
+    }
+};
+
+// compresses through the zstd tool, which uses all cores itself
+class ZstdSink : public Sink
+{
+    FILE* pipe;
+    bool failed;
+public:
+    explicit ZstdSink(const std::string& path) : failed(false)
+    {
+        std::string quoted = "'";
+        for (char c : path) quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        quoted += "'";
+        pipe = popen(("zstd -q -f -T0 -o " + quoted).c_str(), "w");
+    }
+    ~ZstdSink(){ if (pipe) pclose(pipe); }
+    bool valid() const{ return pipe != NULL; }
+    void write(const std::string& data) override
+    {
+        failed = failed || fwrite(data.data(), 1, data.size(), pipe) != data.size();
+    }
+    bool close() override
+    {
+        const int status = pclose(pipe);
+        pipe = NULL;
+        return status == 0 && !failed;
+    }
+};
+
+class Writer
+{
+public:
+    virtual ~Writer(){}
+    // 'contents' is the target of a symbolic link if 'symlink' is set
+    virtual void add(const std::string& name, const std::string& contents, mode_t mode, bool symlink) = 0;
+    virtual bool finish() = 0;
+};
+
+// ustar, with pax headers for names that don't fit in one
+class TarWriter : public Writer
+{
+    std::unique_ptr<FileSink> file;
+    std::unique_ptr<Sink> compressor;
+    Sink* sink;
+    std::mutex mutex;
+    const time_t mtime;
+
+    static void putOctal(std::string& header, size_t offset, size_t width, unsigned long long value)
+    {
+        char field[32];
+        snprintf(field, sizeof(field), "%0*llo", int(width - 1), value);
+        memcpy(&header[offset], field, width - 1);
+    }
+
+    std::string header(const std::string& name, size_t size, mode_t mode, char type, const std::string& link) const
+    {
+        std::string block(512, '\0');
+        // names that don't fit are split at a slash between the prefix and name fields,
+        // or truncated when there's a pax header with the whole name
+        std::string prefix;
+        std::string base = name;
+        if (name.size() > 100)
+        {
+            const size_t slash = name.rfind('/', 155);
+            if (slash != std::string::npos && name.size() - slash - 1 <= 100)
+            {
+                prefix = name.substr(0, slash);
+                base = name.substr(slash + 1);
+            }
+            else base = name.substr(0, 100);
+        }
+        memcpy(&block[0], base.data(), base.size());
+        putOctal(block, 100, 8, mode & 07777);
+        putOctal(block, 108, 8, 0);
+        putOctal(block, 116, 8, 0);
+        putOctal(block, 124, 12, size);
+        putOctal(block, 136, 12, mtime);
+        block[156] = type;
+        memcpy(&block[157], link.data(), link.size() < 100 ? link.size() : 100);
+        memcpy(&block[257], "ustar\0" "00", 8);
+        memcpy(&block[345], prefix.data(), prefix.size());
+        // the checksum is computed with its own field made of spaces
+        memset(&block[148], ' ', 8);
+        unsigned int checksum = 0;
+        for (unsigned char c : block) checksum += c;
+        putOctal(block, 148, 7, checksum);
+        return block;
+    }
+
+    static std::string padding(size_t size)
+    {
+        return std::string((512 - size % 512) % 512, '\0');
+    }
+
+    // a pax record holding what doesn't fit in the ustar header
+    static std::string paxRecord(const std::string& key, const std::string& value)
+    {
+        // the length counts itself
+        const std::string text = " " + key + "=" + value + "\n";
+        size_t length = text.size() + 1;
+        while (std::to_string(length).size() + text.size() != length) length++;
+        return std::to_string(length) + text;
+    }
+
+    static bool fitsUstar(const std::string& name)
+    {
+        if (name.size() <= 100) return true;
+        const size_t slash = name.rfind('/', 155);
+        return slash != std::string::npos && name.size() - slash - 1 <= 100;
+    }
+
+public:
+    TarWriter(std::unique_ptr<FileSink> file_sink, std::unique_ptr<Sink> compressor_sink)
+        : file(std::move(file_sink)), compressor(std::move(compressor_sink)), mtime(time(NULL))
+    {
+        sink = compressor ? compressor.get() : static_cast<Sink*>(file.get());
+    }
+
+    void add(const std::string& name, const std::string& contents, mode_t mode, bool symlink) override
+    {
+        std::string records;
+        if (!fitsUstar(name)) records += paxRecord("path", name);
+        if (symlink && contents.size() > 100) records += paxRecord("linkpath", contents);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!records.empty())
+        {
+            sink->write(header("PaxHeader", records.size(), 0644, 'x', ""));
+            sink->write(records + padding(records.size()));
+        }
+        if (symlink)
+        {
+            sink->write(header(name, 0, mode, '2', contents));
+            return;
+        }
+        sink->write(header(name, contents.size(), mode, '0', ""));
+        sink->write(contents);
+        sink->write(padding(contents.size()));
+    }
+
+    bool finish() override
+    {
+        sink->write(std::string(1024, '\0'));
+        if (compressor) return compressor->close();
+        return file->close();
+    }
+};
+
+// Every entry is compressed on its own, so entries are compressed at the same time on all
+// cores, and written as they are done.
+class ZipWriter : public Writer
+{
+    FileSink file;
+    TaskPool pool;
+    std::mutex mutex;
+    std::string directory; // the central directory, written at the end
+    uint64_t offset;
+    size_t entries;
+    bool failed;
+
+    static const uint16_t DOS_DATE = (0 << 9) | (1 << 5) | 1; // 1980-01-01, for reproducible archives
+
+    static bool deflateRaw(const std::string& data, std::string& out)
+    {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        // negative window bits: no zlib header, as zip entries have their own
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+        out.resize(deflateBound(&stream, data.size()));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = data.size();
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = out.size();
+        const bool ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return ok;
+    }
+
+    void write(const std::string& name, const std::string& contents, mode_t mode, bool symlink)
+    {
+        const uint32_t crc = crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(contents.data()), contents.size());
+        std::string compressed;
+        const bool deflated = !symlink && deflateRaw(contents, compressed) && compressed.size() < contents.size();
+        const std::string& data = deflated ? compressed : contents;
+        const uint16_t method = deflated ? 8 : 0;
+
+        std::string local;
+        putLittle32(local, 0x04034b50);
+        putLittle16(local, 20);          // version needed: 2.0
+        putLittle16(local, 0x800);       // names are UTF-8
+        putLittle16(local, method);
+        putLittle16(local, 0);           // time
+        putLittle16(local, DOS_DATE);
+        putLittle32(local, crc);
+        putLittle32(local, data.size());
+        putLittle32(local, contents.size());
+        putLittle16(local, name.size());
+        putLittle16(local, 0);           // extra field length
+        local += name;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (offset + local.size() + data.size() > 0xffffffffULL)
+        {
+            // would need zip64
+            failed = true;
+            return;
+        }
+        std::string central;
+        putLittle32(central, 0x02014b50);
+        putLittle16(central, (3 << 8) | 20); // made by unix, so attributes hold the mode
+        central.append(local, 4, 26);        // same fields as the local header
+        putLittle16(central, 0);             // comment length
+        putLittle16(central, 0);             // disk number
+        putLittle16(central, 0);             // internal attributes
+        putLittle32(central, uint32_t((symlink ? S_IFLNK : S_IFREG) | (mode & 07777)) << 16);
+        putLittle32(central, offset);
+        central += name;
+        directory += central;
+        entries++;
+
+        file.write(local);
+        file.write(data);
+        offset += local.size() + data.size();
+    }
+
+public:
+    explicit ZipWriter(int fd) : file(fd), offset(0), entries(0), failed(false) {}
+
+    void add(const std::string& name, const std::string& contents, mode_t mode, bool symlink) override
+    {
+        std::shared_ptr<std::string> data(new std::string(contents));
+        pool.submit([this, name, data, mode, symlink](){ write(name, *data, mode, symlink); });
+    }
+
+    bool finish() override
+    {
+        pool.finish();
+        if (failed || entries > 0xffff) return false;
+        std::string end;
+        putLittle32(end, 0x06054b50);
+        putLittle16(end, 0);              // this disk
+        putLittle16(end, 0);              // disk with the central directory
+        putLittle16(end, entries);
+        putLittle16(end, entries);
+        putLittle32(end, directory.size());
+        putLittle32(end, offset);
+        putLittle16(end, 0);              // comment length
+        file.write(directory + end);
+        return file.close();
+    }
+};
+
+std::unique_ptr<Writer> writer;
+
+}
+
+bool enabled()
+{
+    return !Settings::archive().empty();
+}
+
+bool replacesFiles()
+{
+    return enabled() && singleWrite();
+}
+
+void open()
+{
+    const std::string path = Settings::archive();
+    const bool zst = endsWith(path, ".tar.zst") || endsWith(path, ".tzst");
+    const bool gz = endsWith(path, ".tar.gz") || endsWith(path, ".tgz");
+    const bool zip = endsWith(path, ".zip");
+    if (!zst && !gz && !zip && !endsWith(path, ".tar"))
+    {
+        std::cerr << "\n\nError : Unknown archive format for " << path << ", use .tar, .tar.gz, .tar.zst or .zip" << std::endl;
+        exit(1);
+    }
+
+    root = pathComponents(Settings::destFolder());
+    size_t bundle = root.size();
+    for (size_t n = 0; n < root.size(); n++)
+    {
+        if (endsWith(root[n], ".app")) bundle = n;
+    }
+    root.resize(bundle < root.size() ? bundle : (root.empty() ? 0 : root.size() - 1));
+    // known now, unlike most libraries, so that it fails before bundling anything
+    for (int n = 0; n < Settings::fileToFixAmount(); n++) entryName(Settings::fileToFix(n));
+
+    // the tool only runs once everything is bundled
+    if (zst && Reactor::run("zstd -V").get().status != 0)
+    {
+        std::cerr << "\n\nError : Cannot run zstd, which writes .tar.zst archives. Install it, or use .tar.gz or .zip" << std::endl;
+        exit(1);
+    }
+
+    if (zst)
+    {
+        std::unique_ptr<ZstdSink> sink(new ZstdSink(path));
+        if (sink->valid()) writer.reset(new TarWriter(nullptr, std::move(sink)));
+    }
+    else
+    {
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0 && zip) writer.reset(new ZipWriter(fd));
+        else if (fd >= 0)
+        {
+            std::unique_ptr<FileSink> file(new FileSink(fd));
+            std::unique_ptr<Sink> compressor;
+            if (gz) compressor.reset(new GzipSink(*file));
+            writer.reset(new TarWriter(std::move(file), std::move(compressor)));
+        }
+    }
+    if (!writer)
+    {
+        std::cerr << "\n\nError : Cannot create archive " << path << std::endl;
+        exit(1);
+    }
+}
+
+void addFile(const std::string& path, const std::string& contents, mode_t mode)
+{
+    writer->add(entryName(path), contents, mode, false);
+}
+
+void addFromDisk(const std::string& path)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0)
+    {
+        std::cerr << "\n\nError : Cannot read " << path << " to add it to the archive" << std::endl;
+        exit(1);
+    }
+    if (S_ISLNK(st.st_mode))
+    {
+        std::string target(st.st_size + 1, '\0');
+        const ssize_t length = readlink(path.c_str(), &target[0], target.size());
+        target.resize(length > 0 ? length : 0);
+        writer->add(entryName(path), target, st.st_mode & 07777, true);
+        return;
+    }
+    std::ifstream in(path.c_str(), std::ios::binary);
+    const std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    writer->add(entryName(path), contents, st.st_mode & 07777, false);
+}
+
+void close()
+{
+    if (!writer) return;
+    const bool ok = writer->finish();
+    writer.reset();
+    if (!ok)
+    {
+        std::cerr << "\n\nError : An error occured while writing archive " << Settings::archive() << std::endl;
+        exit(1);
+    }
+    Log::info() << "\n* Archive written to " << Settings::archive();
+}
+
+}
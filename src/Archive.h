@@ -0,0 +1,57 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _archive_h_
+#define _archive_h_
+
+#include <string>
+#include <sys/types.h>
+
+// The archive given with --archive, which the bundled libraries and fixed files are written to.
+// The format comes from its extension: .tar, .tar.gz (or .tgz), .tar.zst or .zip.
+namespace Archive
+{
+
+bool enabled();
+
+// Whether files only go to the archive, and aren't written to disk at all. That's the case
+// when they're produced in memory, with the native tools; otherwise they are written as
+// usual, then read back into the archive.
+bool replacesFiles();
+
+// creates the archive, exits if it can't
+void open();
+
+// Adds a file to the archive as 'path', made relative. May be called from several threads.
+// Compression runs on other threads, this only waits when too much of it is pending.
+void addFile(const std::string& path, const std::string& contents, mode_t mode);
+// adds the file at 'path' as it is on disk; symbolic links are added as such
+void addFromDisk(const std::string& path);
+
+// writes the end of the archive, exits if it can't
+void close();
+
+}
+
+#endif
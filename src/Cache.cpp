@@ -0,0 +1,278 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Cache.h"
+#include "Utils.h"
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+namespace Cache
+{
+
+struct Stamp
+{
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtime_sec = 0;
+    int64_t mtime_nsec = 0;
+
+    bool operator==(const Stamp& other) const
+    {
+        return dev == other.dev && ino == other.ino && size == other.size &&
+               mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec;
+    }
+};
+
+struct OutputEntry
+{
+    Stamp stamp;
+    std::string output;
+};
+
+struct DirectoryEntry
+{
+    Stamp stamp;
+    // name -> whether it is a symlink (which could be dangling)
+    std::map<std::string, bool> names;
+};
+
+// the pipeline and --jobs threads look things up concurrently
+std::mutex mutex;
+std::map<std::string, OutputEntry> outputs;
+std::map<std::string, DirectoryEntry> directories;
+std::set<std::string> new_outputs;
+std::set<std::string> new_directories;
+
+bool getStamp(const std::string& path, Stamp& stamp)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    stamp.dev = st.st_dev;
+    stamp.ino = st.st_ino;
+    stamp.size = st.st_size;
+    stamp.mtime_sec = st.st_mtime;
+#ifdef __APPLE__
+    stamp.mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+bool findLoadCommands(const std::string& file, std::string& output)
+{
+    Stamp stamp;
+    const bool stamped = getStamp(file, stamp);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, OutputEntry>::iterator found = outputs.find(file);
+    if (found == outputs.end()) return false;
+
+    if (!stamped || !(stamp == found->second.stamp))
+    {
+        outputs.erase(found);
+        return false;
+    }
+    output = found->second.output;
+    return true;
+}
+
+void storeLoadCommands(const std::string& file, const std::string& output)
+{
+    OutputEntry entry;
+    if (!getStamp(file, entry.stamp)) return;
+    entry.output = output;
+    std::lock_guard<std::mutex> lock(mutex);
+    outputs[file] = entry;
+    new_outputs.insert(file);
+}
+
+bool directoryContains(const std::string& dir, const std::string& name)
+{
+    // only direct children are indexed
+    if (name.empty() || name.find('/') != std::string::npos) return fileExists(dir + name);
+
+    Stamp stamp;
+    if (!getStamp(dir, stamp)) return false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    std::map<std::string, DirectoryEntry>::iterator found = directories.find(dir);
+    if (found == directories.end() || !(found->second.stamp == stamp))
+    {
+        DIR* handle = opendir(dir.c_str());
+        if (handle == NULL)
+        {
+            lock.unlock();
+            return fileExists(dir + name);
+        }
+
+        DirectoryEntry entry;
+        entry.stamp = stamp;
+        while (struct dirent* ent = readdir(handle))
+        {
+            bool is_link = true; // when unknown, check it like a link
+#ifdef DT_LNK
+            if (ent->d_type != DT_UNKNOWN) is_link = ent->d_type == DT_LNK;
+#endif
+            entry.names[ent->d_name] = is_link;
+        }
+        closedir(handle);
+
+        found = directories.insert(std::make_pair(dir, DirectoryEntry())).first;
+        found->second = entry;
+        new_directories.insert(dir);
+    }
+
+    std::map<std::string, bool>::const_iterator it = found->second.names.find(name);
+    if (it == found->second.names.end()) return false;
+    const bool is_link = it->second;
+    lock.unlock();
+    if (is_link) return fileExists(dir + name);
+    return true;
+}
+
+// ----------- serialization, used to carry entries between processes ----------
+
+void putNumber(std::string& out, uint64_t value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& out, const std::string& value)
+{
+    putNumber(out, value.size());
+    out += value;
+}
+
+void putStamp(std::string& out, const Stamp& stamp)
+{
+    putNumber(out, stamp.dev);
+    putNumber(out, stamp.ino);
+    putNumber(out, stamp.size);
+    putNumber(out, stamp.mtime_sec);
+    putNumber(out, stamp.mtime_nsec);
+}
+
+bool getNumber(const std::string& in, size_t& pos, uint64_t& value)
+{
+    if (pos + sizeof(value) > in.size()) return false;
+    memcpy(&value, in.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+bool getString(const std::string& in, size_t& pos, std::string& value)
+{
+    uint64_t size;
+    if (!getNumber(in, pos, size) || pos + size > in.size()) return false;
+    value = in.substr(pos, size);
+    pos += size;
+    return true;
+}
+
+bool getStamp(const std::string& in, size_t& pos, Stamp& stamp)
+{
+    uint64_t sec = 0, nsec = 0;
+    bool ok = getNumber(in, pos, stamp.dev) && getNumber(in, pos, stamp.ino) &&
+              getNumber(in, pos, stamp.size) && getNumber(in, pos, sec) && getNumber(in, pos, nsec);
+    stamp.mtime_sec = sec;
+    stamp.mtime_nsec = nsec;
+    return ok;
+}
+
+std::string takeNewEntries()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string out;
+    for (const auto& file : new_outputs)
+    {
+        std::map<std::string, OutputEntry>::const_iterator found = outputs.find(file);
+        if (found == outputs.end()) continue;
+        out += 'O';
+        putString(out, file);
+        putStamp(out, found->second.stamp);
+        putString(out, found->second.output);
+    }
+    for (const auto& dir : new_directories)
+    {
+        std::map<std::string, DirectoryEntry>::const_iterator found = directories.find(dir);
+        if (found == directories.end()) continue;
+        out += 'D';
+        putString(out, dir);
+        putStamp(out, found->second.stamp);
+        putNumber(out, found->second.names.size());
+        for (const auto& name : found->second.names)
+        {
+            putString(out, name.first);
+            out += name.second ? '1' : '0';
+        }
+    }
+    new_outputs.clear();
+    new_directories.clear();
+    return out;
+}
+
+void merge(const std::string& in)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t pos = 0;
+    while (pos < in.size())
+    {
+        const char kind = in[pos++];
+        std::string path;
+        Stamp stamp;
+        if (!getString(in, pos, path) || !getStamp(in, pos, stamp)) return;
+
+        if (kind == 'O')
+        {
+            OutputEntry entry;
+            entry.stamp = stamp;
+            if (!getString(in, pos, entry.output)) return;
+            outputs[path] = entry;
+        }
+        else if (kind == 'D')
+        {
+            DirectoryEntry entry;
+            entry.stamp = stamp;
+            uint64_t count;
+            if (!getNumber(in, pos, count)) return;
+            for (uint64_t n=0; n<count; n++)
+            {
+                std::string name;
+                if (!getString(in, pos, name) || pos >= in.size()) return;
+                entry.names[name] = in[pos++] == '1';
+            }
+            directories[path] = entry;
+        }
+        else return;
+    }
+}
+
+}
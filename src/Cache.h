@@ -0,0 +1,52 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _cache_h_
+#define _cache_h_
+
+#include <string>
+
+// Caches of things that are expensive to recompute from one job to the next:
+// the load commands printed by otool, and the content of search directories.
+// Every entry remembers the inode, size and modification time of what it
+// describes, and is dropped as soon as these no longer match. They may be
+// used from several threads at once.
+namespace Cache
+{
+
+// otool -l output for 'file', if a still-valid entry exists
+bool findLoadCommands(const std::string& file, std::string& output);
+void storeLoadCommands(const std::string& file, const std::string& output);
+
+// whether directory 'dir' contains an entry named 'name'. Directories are
+// listed once and then answered from memory until they are modified.
+bool directoryContains(const std::string& dir, const std::string& name);
+
+// entries added since the last call, in a form 'merge' understands
+std::string takeNewEntries();
+void merge(const std::string& serialized);
+
+}
+
+#endif
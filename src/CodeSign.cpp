@@ -0,0 +1,421 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "CodeSign.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <utility>
+
+namespace CodeSign
+{
+
+namespace
+{
+
+const uint32_t SUPERBLOB_MAGIC = 0xfade0cc0;
+const uint32_t CODEDIRECTORY_MAGIC = 0xfade0c02;
+const uint32_t REQUIREMENTS_MAGIC = 0xfade0c01;
+const uint32_t BLOBWRAPPER_MAGIC = 0xfade0b01;
+
+// blob types in a superblob, which are also the special slots their hash goes to
+const uint32_t SLOT_CODEDIRECTORY = 0;
+const uint32_t SLOT_REQUIREMENTS = 2;
+const uint32_t SLOT_ENTITLEMENTS = 5;
+const uint32_t SLOT_DER_ENTITLEMENTS = 7;
+const uint32_t SLOT_SIGNATURE = 0x10000;
+// where code directories with other hash types go, next to the one in SLOT_CODEDIRECTORY
+const uint32_t SLOT_ALTERNATE_CODEDIRECTORIES = 0x1000;
+const uint32_t MAX_ALTERNATE_CODEDIRECTORIES = 5;
+
+const uint32_t CS_ADHOC = 0x2;
+const uint32_t CS_LINKER_SIGNED = 0x20000;
+const uint32_t CS_EXECSEG_MAIN_BINARY = 0x1;
+
+const uint32_t PAGE_SHIFT = 12;
+const uint32_t PAGE_SIZE = 1 << PAGE_SHIFT;
+const uint32_t HASH_SIZE = 32;
+const uint8_t HASH_TYPE_SHA256 = 2;
+
+// signatures are big-endian, unlike the Mach-O files we handle
+uint32_t readBig32(const std::string& data, size_t offset)
+{
+    if (offset + 4 > data.size()) return 0;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data() + offset);
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void appendBig32(std::string& out, uint32_t value)
+{
+    for (int shift=24; shift>=0; shift-=8) out += char((value >> shift) & 0xff);
+}
+
+void appendBig64(std::string& out, uint64_t value)
+{
+    appendBig32(out, value >> 32);
+    appendBig32(out, value & 0xffffffff);
+}
+
+// what we keep from the signature being replaced
+struct Previous
+{
+    std::map<uint32_t, std::string> blobs; // requirements and entitlements, by slot
+    uint32_t flags = 0;
+    uint32_t runtime = 0;
+};
+
+Previous readPrevious(const std::string& signature)
+{
+    Previous previous;
+    if (readBig32(signature, 0) != SUPERBLOB_MAGIC) return previous;
+    const uint32_t count = readBig32(signature, 8);
+    for (uint32_t n=0; n<count && 12 + n*8 + 8 <= signature.size(); n++)
+    {
+        const uint32_t type = readBig32(signature, 12 + n*8);
+        const uint32_t offset = readBig32(signature, 12 + n*8 + 4);
+        const uint32_t length = readBig32(signature, offset + 4);
+        if (length < 8 || uint64_t(offset) + length > signature.size()) continue;
+        const std::string blob = signature.substr(offset, length);
+        if (type == SLOT_REQUIREMENTS || type == SLOT_ENTITLEMENTS || type == SLOT_DER_ENTITLEMENTS)
+        {
+            previous.blobs[type] = blob;
+        }
+        else if (type == SLOT_CODEDIRECTORY && readBig32(blob, 0) == CODEDIRECTORY_MAGIC)
+        {
+            previous.flags = readBig32(blob, 12) & ~CS_LINKER_SIGNED;
+            if (readBig32(blob, 8) >= 0x20500) previous.runtime = readBig32(blob, 88);
+        }
+    }
+    return previous;
+}
+
+// index in slice.commands of the segment named 'name', -1 if none
+int findSegment(const MachO::Slice& slice, const char* name)
+{
+    for (size_t n=0; n<slice.commands.size(); n++)
+    {
+        const MachO::LoadCommand& lc = slice.commands[n];
+        if (lc.cmd != MachO::LC_SEGMENT && lc.cmd != MachO::LC_SEGMENT_64) continue;
+        if (strncmp(slice.data.data() + lc.offset + 8, name, 16) == 0) return n;
+    }
+    return -1;
+}
+
+// fileoff and filesize of the segment command at 'lc'
+void segmentRange(const MachO::Slice& slice, const MachO::LoadCommand& lc, uint64_t& fileoff, uint64_t& filesize)
+{
+    if (lc.cmd == MachO::LC_SEGMENT_64)
+    {
+        fileoff = MachO::read64(slice.data, lc.offset + 40);
+        filesize = MachO::read64(slice.data, lc.offset + 48);
+    }
+    else
+    {
+        fileoff = MachO::read32(slice.data, lc.offset + 32);
+        filesize = MachO::read32(slice.data, lc.offset + 36);
+    }
+}
+
+// whether 'page' of 'data' is as it was in 'before', so it still has the hash 'before' gives it
+bool samePage(const Snapshot::SignedSlice* before, const std::string& data, uint32_t page, uint32_t start, uint32_t size)
+{
+    if (before == nullptr || (page + 1) * size_t(HASH_SIZE) > before->hashes.size()) return false;
+    if (start + size_t(size) > before->data.size()) return false;
+    // the page must have ended at the same place too
+    if (size < PAGE_SIZE && start + size_t(size) != before->data.size()) return false;
+    return memcmp(data.data() + start, before->data.data() + start, size) == 0;
+}
+
+// the signature of 'slice' as it is: the code directory with SHA-256 page hashes, if any,
+// and the code limit it covers
+bool readPageHashes(const MachO::Slice& slice, std::string& hashes, uint32_t& code_limit)
+{
+    const int command = MachO::findCommand(slice, MachO::LC_CODE_SIGNATURE);
+    if (command < 0) return false;
+    const MachO::LoadCommand& lc = slice.commands[command];
+    const uint32_t offset = MachO::read32(slice.data, lc.offset + 8);
+    const uint32_t size = MachO::read32(slice.data, lc.offset + 12);
+    if (uint64_t(offset) + size > slice.data.size()) return false;
+    const std::string signature = slice.data.substr(offset, size);
+    if (readBig32(signature, 0) != SUPERBLOB_MAGIC) return false;
+
+    const uint32_t count = readBig32(signature, 8);
+    for (uint32_t n=0; n<count && 12 + n*8 + 8 <= signature.size(); n++)
+    {
+        const uint32_t type = readBig32(signature, 12 + n*8);
+        if (type != SLOT_CODEDIRECTORY && (type < SLOT_ALTERNATE_CODEDIRECTORIES || type >= SLOT_ALTERNATE_CODEDIRECTORIES + MAX_ALTERNATE_CODEDIRECTORIES)) continue;
+        const uint32_t blob_offset = readBig32(signature, 12 + n*8 + 4);
+        const uint32_t length = readBig32(signature, blob_offset + 4);
+        if (length < 44 || uint64_t(blob_offset) + length > signature.size()) continue;
+        const std::string cd = signature.substr(blob_offset, length);
+        const uint32_t hash_offset = readBig32(cd, 16);
+        const uint32_t pages = readBig32(cd, 28);
+        const uint32_t limit = readBig32(cd, 32);
+        // only a layout like the one we write can be taken over: the signature right after
+        // the code, hashed in 4 KB pages with SHA-256, and only from an ad-hoc or linker
+        // signature, as those of others can't be trusted without checking their certificates
+        if (readBig32(cd, 0) != CODEDIRECTORY_MAGIC || (readBig32(cd, 12) & (CS_ADHOC | CS_LINKER_SIGNED)) == 0 ||
+            uint8_t(cd[36]) != HASH_SIZE || uint8_t(cd[37]) != HASH_TYPE_SHA256 ||
+            uint8_t(cd[39]) != PAGE_SHIFT || limit != offset || pages != (limit + PAGE_SIZE - 1) / PAGE_SIZE ||
+            uint64_t(hash_offset) + uint64_t(pages)*HASH_SIZE > cd.size()) continue;
+        hashes = cd.substr(hash_offset, pages*HASH_SIZE);
+        code_limit = limit;
+        return true;
+    }
+    return false;
+}
+
+// Whether the hashes 'before' gives its pages 'kept' are right, as a file changed after it was
+// signed has pages that don't match theirs. Every one of them is checked, since a change can be
+// in any page: that hashes them, so keeping their hashes costs as much as hashing them again.
+bool hashesHold(const Snapshot::SignedSlice& before, const std::vector<bool>& kept)
+{
+    for (uint32_t page=0; page<kept.size(); page++)
+    {
+        const size_t start = size_t(page)*PAGE_SIZE;
+        if (!kept[page] || (page + 1) * size_t(HASH_SIZE) > before.hashes.size() || start >= before.data.size()) continue;
+        const size_t size = std::min<size_t>(PAGE_SIZE, before.data.size() - start);
+        if (Sha256::digest(before.data.data() + start, size) != before.hashes.substr(page*HASH_SIZE, HASH_SIZE)) return false;
+    }
+    return true;
+}
+
+std::string codeDirectory(const MachO::Slice& slice, const std::string& identifier, uint32_t code_limit,
+                          const Previous& previous, const std::map<uint32_t, std::string>& special_blobs,
+                          const Snapshot::SignedSlice* before)
+{
+    uint32_t special_slots = 0;
+    for (const auto& blob : special_blobs) special_slots = blob.first;
+    const uint32_t pages = (code_limit + PAGE_SIZE - 1) / PAGE_SIZE;
+    const uint32_t version = previous.runtime ? 0x20500 : 0x20400;
+    const uint32_t header_size = version >= 0x20500 ? 96 : 88;
+    const uint32_t hash_offset = header_size + identifier.size() + 1 + special_slots*HASH_SIZE;
+
+    uint64_t text_base = 0, text_size = 0;
+    const int text = findSegment(slice, "__TEXT");
+    if (text >= 0) segmentRange(slice, slice.commands[text], text_base, text_size);
+
+    std::string cd;
+    appendBig32(cd, CODEDIRECTORY_MAGIC);
+    appendBig32(cd, hash_offset + pages*HASH_SIZE);
+    appendBig32(cd, version);
+    appendBig32(cd, previous.flags | CS_ADHOC);
+    appendBig32(cd, hash_offset);
+    appendBig32(cd, header_size); // identifier offset
+    appendBig32(cd, special_slots);
+    appendBig32(cd, pages);
+    appendBig32(cd, code_limit);
+    cd += char(HASH_SIZE);
+    cd += char(HASH_TYPE_SHA256);
+    cd += char(0);                // platform
+    cd += char(PAGE_SHIFT);
+    appendBig32(cd, 0);           // spare2
+    appendBig32(cd, 0);           // scatter offset
+    appendBig32(cd, 0);           // team offset
+    appendBig32(cd, 0);           // spare3
+    appendBig64(cd, 0);           // 64 bit code limit, unused below 4GB
+    appendBig64(cd, text_base);
+    appendBig64(cd, text_size);
+    appendBig64(cd, slice.filetype == MachO::MH_EXECUTE ? CS_EXECSEG_MAIN_BINARY : 0);
+    if (version >= 0x20500)
+    {
+        appendBig32(cd, previous.runtime);
+        appendBig32(cd, 0);       // pre-encrypt offset
+    }
+    cd += identifier;
+    cd += '\0';
+
+    // special slots are stored backwards before the page hashes, slot 1 last
+    for (uint32_t slot=special_slots; slot>0; slot--)
+    {
+        const auto blob = special_blobs.find(slot);
+        if (blob == special_blobs.end()) cd += std::string(HASH_SIZE, '\0');
+        else cd += Sha256::digest(blob->second);
+    }
+    std::vector<bool> kept(pages);
+    for (uint32_t page=0; page<pages; page++)
+    {
+        const uint32_t start = page*PAGE_SIZE;
+        const uint32_t size = code_limit - start < PAGE_SIZE ? code_limit - start : PAGE_SIZE;
+        kept[page] = samePage(before, slice.data, page, start, size);
+    }
+    // hashed again in full otherwise
+    if (before != nullptr && !hashesHold(*before, kept)) kept.assign(pages, false);
+    for (uint32_t page=0; page<pages; page++)
+    {
+        const uint32_t start = page*PAGE_SIZE;
+        const uint32_t size = code_limit - start < PAGE_SIZE ? code_limit - start : PAGE_SIZE;
+        if (kept[page]) cd.append(before->hashes, page*HASH_SIZE, HASH_SIZE);
+        else cd += Sha256::digest(slice.data.data() + start, size);
+    }
+    return cd;
+}
+
+bool signSlice(MachO::Slice& slice, const std::string& identifier, const Snapshot::SignedSlice* before)
+{
+    const int linkedit = findSegment(slice, "__LINKEDIT");
+    if (linkedit < 0) return false;
+    uint64_t linkedit_offset = 0, linkedit_size = 0;
+    segmentRange(slice, slice.commands[linkedit], linkedit_offset, linkedit_size);
+
+    Previous previous;
+    uint32_t code_limit;
+    int command = MachO::findCommand(slice, MachO::LC_CODE_SIGNATURE);
+    if (command >= 0)
+    {
+        const MachO::LoadCommand& lc = slice.commands[command];
+        code_limit = MachO::read32(slice.data, lc.offset + 8);
+        const uint32_t size = MachO::read32(slice.data, lc.offset + 12);
+        if (code_limit > slice.data.size()) return false;
+        previous = readPrevious(slice.data.substr(code_limit, size));
+    }
+    else
+    {
+        // the signature goes at the end of __LINKEDIT, which must be the end of the slice
+        if (linkedit_offset + linkedit_size != slice.data.size()) return false;
+        code_limit = (slice.data.size() + 15) / 16 * 16;
+        std::string lc;
+        for (uint32_t value : { MachO::LC_CODE_SIGNATURE, 16u, code_limit, 0u })
+        {
+            lc.append(reinterpret_cast<const char*>(&value), 4);
+        }
+        if (!MachO::addCommand(slice, lc)) return false;
+        command = MachO::findCommand(slice, MachO::LC_CODE_SIGNATURE);
+    }
+
+    std::map<uint32_t, std::string> special_blobs = previous.blobs;
+    if (!special_blobs.count(SLOT_REQUIREMENTS))
+    {
+        // an empty requirement set
+        std::string requirements;
+        appendBig32(requirements, REQUIREMENTS_MAGIC);
+        appendBig32(requirements, 12);
+        appendBig32(requirements, 0);
+        special_blobs[SLOT_REQUIREMENTS] = requirements;
+    }
+
+    // The size of the signature doesn't depend on the hashes, so the header can be
+    // finished before hashing the pages it is part of.
+    const uint32_t pages = (code_limit + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t special_slots = 0;
+    for (const auto& blob : special_blobs) special_slots = blob.first;
+    const uint32_t header_size = previous.runtime ? 96 : 88;
+    const uint32_t cd_size = header_size + identifier.size() + 1 + (special_slots + pages)*HASH_SIZE;
+    const uint32_t blob_amount = 2 + special_blobs.size();
+    uint32_t signature_size = 12 + blob_amount*8 + cd_size + 8;
+    for (const auto& blob : special_blobs) signature_size += blob.second.size();
+    const uint32_t padded_size = (signature_size + 15) / 16 * 16;
+
+    const MachO::LoadCommand lc = slice.commands[command];
+    MachO::write32(slice.data, lc.offset + 8, code_limit);
+    MachO::write32(slice.data, lc.offset + 12, padded_size);
+    const uint64_t new_linkedit_size = code_limit + padded_size - linkedit_offset;
+    const MachO::LoadCommand& segment = slice.commands[linkedit];
+    const uint64_t vm_page = slice.cputype == MachO::CPU_TYPE_ARM64 ? 0x4000 : 0x1000;
+    const uint64_t vm_size = (new_linkedit_size + vm_page - 1) / vm_page * vm_page;
+    if (segment.cmd == MachO::LC_SEGMENT_64)
+    {
+        MachO::write64(slice.data, segment.offset + 48, new_linkedit_size);
+        if (MachO::read64(slice.data, segment.offset + 32) < vm_size) MachO::write64(slice.data, segment.offset + 32, vm_size);
+    }
+    else
+    {
+        MachO::write32(slice.data, segment.offset + 36, new_linkedit_size);
+        if (MachO::read32(slice.data, segment.offset + 28) < vm_size) MachO::write32(slice.data, segment.offset + 28, vm_size);
+    }
+    slice.data.resize(code_limit, '\0');
+    slice.header = slice.data.substr(0, slice.header.size());
+
+    const std::string cd = codeDirectory(slice, identifier, code_limit, previous, special_blobs, before);
+    std::string signature;
+    appendBig32(signature, SUPERBLOB_MAGIC);
+    appendBig32(signature, signature_size);
+    appendBig32(signature, blob_amount);
+    uint32_t offset = 12 + blob_amount*8;
+    appendBig32(signature, SLOT_CODEDIRECTORY);
+    appendBig32(signature, offset);
+    offset += cd.size();
+    for (const auto& blob : special_blobs)
+    {
+        appendBig32(signature, blob.first);
+        appendBig32(signature, offset);
+        offset += blob.second.size();
+    }
+    appendBig32(signature, SLOT_SIGNATURE);
+    appendBig32(signature, offset);
+    signature += cd;
+    for (const auto& blob : special_blobs) signature += blob.second;
+    // an empty CMS signature, as ad-hoc signatures have no certificate
+    appendBig32(signature, BLOBWRAPPER_MAGIC);
+    appendBig32(signature, 8);
+    signature.resize(padded_size, '\0');
+
+    slice.data += signature;
+    return true;
+}
+
+}
+
+std::string identifierFor(const std::string& path)
+{
+    std::string name = path.substr(path.rfind('/') + 1);
+    const size_t dot = name.rfind('.');
+    if (dot != std::string::npos && dot > 0) name.erase(dot);
+    return name;
+}
+
+Snapshot snapshot(const MachO::File& file)
+{
+    Snapshot taken;
+    for (size_t n=0; n<file.sliceAmount(); n++)
+    {
+        const MachO::Slice& slice = file.slice(n);
+        Snapshot::SignedSlice signed_slice;
+        uint32_t code_limit;
+        if (!readPageHashes(slice, signed_slice.hashes, code_limit)) continue;
+        signed_slice.cputype = slice.cputype;
+        signed_slice.cpusubtype = slice.cpusubtype;
+        signed_slice.data = slice.data.substr(0, code_limit);
+        taken.slices.push_back(std::move(signed_slice));
+    }
+    return taken;
+}
+
+bool adhocSign(MachO::File& file, const std::string& identifier, const Snapshot& before)
+{
+    for (size_t n=0; n<file.sliceAmount(); n++)
+    {
+        MachO::Slice& slice = file.slice(n);
+        const Snapshot::SignedSlice* signed_before = nullptr;
+        for (const auto& candidate : before.slices)
+        {
+            if (candidate.cputype == slice.cputype && candidate.cpusubtype == slice.cpusubtype) signed_before = &candidate;
+        }
+        if (!signSlice(slice, identifier, signed_before) || !file.reparse(n)) return false;
+    }
+    return true;
+}
+
+}
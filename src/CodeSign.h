@@ -0,0 +1,65 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _codesign_h_
+#define _codesign_h_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MachO.h"
+
+// Ad-hoc code signatures made in-process, like 'codesign --sign -' does
+namespace CodeSign
+{
+
+// the identifier codesign gives a file by default: its name without the last extension
+std::string identifierFor(const std::string& path);
+
+// The signed slices of a file as it was read, with the hashes their ad-hoc or linker signature
+// gives each page. Taken before editing a file, so that signing it again keeps the hashes of the
+// pages the edits didn't change, once all of those are found to match their pages.
+struct Snapshot
+{
+    struct SignedSlice
+    {
+        uint32_t cputype;
+        uint32_t cpusubtype;
+        std::string data;   // up to where the signature starts
+        std::string hashes; // SHA-256 of each 4 KB page of 'data'
+    };
+    std::vector<SignedSlice> slices;
+};
+Snapshot snapshot(const MachO::File& file);
+
+// Replaces the signature of every slice of 'file' with an ad-hoc one over its current contents,
+// keeping the entitlements, requirements, flags and runtime version of the previous one.
+// Slices that weren't signed get a LC_CODE_SIGNATURE command and room at the end of __LINKEDIT.
+// Pages that are still the same, at the same place, as in 'before' keep their hash from it.
+// Returns false if a slice can't be signed, e.g. when there's no room for the load command.
+bool adhocSign(MachO::File& file, const std::string& identifier, const Snapshot& before = Snapshot());
+
+}
+
+#endif
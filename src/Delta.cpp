@@ -0,0 +1,380 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Delta.h"
+#include "Log.h"
+#include "Parallel.h"
+#include "Settings.h"
+#include "Sha256.h"
+#include "ToolBackend.h"
+#include "Utils.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+namespace Delta
+{
+
+namespace
+{
+
+const char MAGIC[] = "DBDELTA1";
+// candidates checked for a block that hashes the same, as runs of identical blocks all do
+const size_t MAX_CANDIDATES = 32;
+
+// the rolling checksum of rsync: sums of the bytes, and of the partial sums
+class RollingHash
+{
+    uint32_t a;
+    uint32_t b;
+    size_t size;
+public:
+    RollingHash(const unsigned char* data, size_t size) : a(0), b(0), size(size)
+    {
+        for (size_t n = 0; n < size; n++)
+        {
+            a += data[n];
+            b += (size - n) * data[n];
+        }
+    }
+    // moves the window one byte forward
+    void roll(unsigned char out, unsigned char in)
+    {
+        a += in - out;
+        b += a - size * out;
+    }
+    uint32_t value() const{ return (a & 0xffff) | (b << 16); }
+};
+
+void putNumber(std::string& out, uint64_t value)
+{
+    for (int n = 0; n < 8; n++) out += char((value >> (8 * n)) & 0xff);
+}
+
+// the instructions making the new file: copies from the old one, and literal bytes
+class Instructions
+{
+    std::string text;
+    uint64_t copy_offset = 0;
+    uint64_t copy_length = 0;
+
+    void flushCopy()
+    {
+        if (copy_length == 0) return;
+        text += 'C';
+        putNumber(text, copy_offset);
+        putNumber(text, copy_length);
+        copy_length = 0;
+    }
+public:
+    void copy(uint64_t offset, uint64_t length)
+    {
+        // contiguous copies are merged
+        if (copy_length > 0 && copy_offset + copy_length == offset)
+        {
+            copy_length += length;
+            return;
+        }
+        flushCopy();
+        copy_offset = offset;
+        copy_length = length;
+    }
+    void literal(const char* data, size_t length)
+    {
+        if (length == 0) return;
+        flushCopy();
+        text += 'L';
+        putNumber(text, length);
+        text.append(data, length);
+    }
+    std::string finish()
+    {
+        flushCopy();
+        return text;
+    }
+};
+
+// blocks about as long as there are of them, like rsync
+size_t blockSizeFor(size_t size)
+{
+    size_t block = size_t(std::sqrt(double(size))) & ~size_t(7);
+    if (block < 512) block = 512;
+    if (block > 65536) block = 65536;
+    return block;
+}
+
+bool readFile(const std::string& path, std::string& contents)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) return false;
+    contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// regular files below 'dir', by path relative to it
+void listFiles(const std::string& dir, const std::string& relative, std::map<std::string, std::string>& files)
+{
+    DIR* handle = opendir((dir + relative).c_str());
+    if (handle == NULL) return;
+    while (struct dirent* entry = readdir(handle))
+    {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        const std::string path = relative + name;
+        struct stat st;
+        if (lstat((dir + path).c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) listFiles(dir, path + "/", files);
+        else if (S_ISREG(st.st_mode)) files[path] = dir + path;
+    }
+    closedir(handle);
+}
+
+void createDirectories(const std::string& path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+    {
+        mkdir(path.substr(0, slash).c_str(), 0777);
+        if (slash == std::string::npos) break;
+    }
+}
+
+std::string withSlash(std::string dir)
+{
+    if (!dir.empty() && dir[dir.size() - 1] != '/') dir += "/";
+    return dir;
+}
+
+// a file of the new bundle, and what goes in the package for it
+struct Change
+{
+    std::string path;    // relative to the dest folder
+    std::string old_hash;
+    std::string new_hash;
+    std::string patch;   // empty if the file is given whole
+};
+
+}
+
+std::string encode(const std::string& old, const std::string& now)
+{
+    Instructions instructions;
+    const unsigned char* old_data = reinterpret_cast<const unsigned char*>(old.data());
+    const unsigned char* new_data = reinterpret_cast<const unsigned char*>(now.data());
+    const size_t block = blockSizeFor(old.size());
+
+    // every block of the old file, by weak hash
+    std::unordered_map<uint32_t, std::vector<size_t> > blocks;
+    for (size_t offset = 0; offset + block <= old.size(); offset += block)
+    {
+        std::vector<size_t>& candidates = blocks[RollingHash(old_data + offset, block).value()];
+        if (candidates.size() < MAX_CANDIDATES) candidates.push_back(offset);
+    }
+
+    size_t literal_start = 0;
+    size_t position = 0;
+    if (!blocks.empty() && now.size() >= block)
+    {
+        RollingHash hash(new_data, block);
+        while (position + block <= now.size())
+        {
+            size_t match = std::string::npos;
+            const auto found = blocks.find(hash.value());
+            if (found != blocks.end())
+            {
+                for (size_t candidate : found->second)
+                {
+                    if (memcmp(old_data + candidate, new_data + position, block) != 0) continue;
+                    match = candidate;
+                    break;
+                }
+            }
+            if (match == std::string::npos)
+            {
+                if (position + block < now.size()) hash.roll(new_data[position], new_data[position + block]);
+                position++;
+                continue;
+            }
+
+            // the match may go on before and after the block
+            size_t start = position;
+            size_t old_start = match;
+            while (start > literal_start && old_start > 0 && old_data[old_start - 1] == new_data[start - 1])
+            {
+                start--;
+                old_start--;
+            }
+            size_t length = position + block - start;
+            while (old_start + length < old.size() && start + length < now.size() &&
+                   old_data[old_start + length] == new_data[start + length]) length++;
+
+            instructions.literal(now.data() + literal_start, start - literal_start);
+            instructions.copy(old_start, length);
+            position = start + length;
+            literal_start = position;
+            if (position + block <= now.size()) hash = RollingHash(new_data + position, block);
+        }
+    }
+    instructions.literal(now.data() + literal_start, now.size() - literal_start);
+
+    const std::string text = instructions.finish();
+    uLongf size = compressBound(text.size());
+    std::string compressed(size, '\0');
+    if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &size, reinterpret_cast<const Bytef*>(text.data()), text.size(), Z_BEST_COMPRESSION) != Z_OK)
+    {
+        return "";
+    }
+    compressed.resize(size);
+
+    std::string delta(MAGIC, sizeof(MAGIC) - 1);
+    putNumber(delta, now.size());
+    putNumber(delta, text.size());
+    return delta + compressed;
+}
+
+void write()
+{
+    const std::string new_dir = withSlash(Settings::destFolder());
+    const std::string old_dir = withSlash(Settings::deltaFrom());
+    const std::string out_dir = withSlash(Settings::deltaOutput());
+    Log::info() << "\n* Writing the changes since " << old_dir << " to " << out_dir;
+
+    if (tools().fileExists(out_dir))
+    {
+        if (!Settings::canOverwriteDir())
+        {
+            std::cerr << "\n\nError : Delta output directory " << out_dir << " already exists. Remove it or enable overwriting." << std::endl;
+            exit(1);
+        }
+        if (!tools().removeTree(out_dir))
+        {
+            std::cerr << "\n\nError : An error occured while attempting to overwrite " << out_dir << std::endl;
+            exit(1);
+        }
+    }
+
+    std::map<std::string, std::string> old_files;
+    std::map<std::string, std::string> new_files;
+    listFiles(old_dir, "", old_files);
+    listFiles(new_dir, "", new_files);
+    if (old_files.empty())
+    {
+        std::cerr << "\n/!\\ WARNING : " << old_dir << " has no files, every file is given whole" << std::endl;
+    }
+
+    std::vector<Change> changes;
+    for (const auto& file : new_files)
+    {
+        Change change;
+        change.path = file.first;
+        changes.push_back(change);
+    }
+    // not vector<bool>, which can't be written concurrently
+    std::vector<char> failed(changes.size());
+    std::vector<char> same(changes.size());
+    std::atomic<size_t> package_size(0);
+    std::atomic<size_t> bundle_size(0);
+    parallelFor(changes.size(), [&](size_t n)
+    {
+        Change& change = changes[n];
+        std::string now;
+        if (!readFile(new_files.at(change.path), now))
+        {
+            failed[n] = true;
+            return;
+        }
+        change.new_hash = Sha256::hex(Sha256::digest(now));
+        bundle_size += now.size();
+
+        std::string old;
+        const auto previous = old_files.find(change.path);
+        if (previous != old_files.end() && readFile(previous->second, old))
+        {
+            change.old_hash = Sha256::hex(Sha256::digest(old));
+            same[n] = change.old_hash == change.new_hash;
+            if (same[n]) return;
+            change.patch = encode(old, now);
+            // not worth it when most of the file changed
+            if (change.patch.size() >= now.size()) change.patch.clear();
+        }
+
+        const std::string& contents = change.patch.empty() ? now : change.patch;
+        const std::string path = out_dir + change.path + (change.patch.empty() ? "" : ".delta");
+        createDirectories(path.substr(0, path.rfind('/')));
+        failed[n] = !writeFileAtomically(path, contents, 0644);
+        package_size += contents.size();
+    });
+
+    // files are listed in the order they're applied, the removed ones last
+    std::string manifest = "dylibbundler delta 1\n";
+    size_t patched = 0;
+    size_t added = 0;
+    size_t removed = 0;
+    for (size_t n = 0; n < changes.size(); n++)
+    {
+        const Change& change = changes[n];
+        if (failed[n])
+        {
+            std::cerr << "\n\nError : An error occured while writing the changes of " << change.path << " to " << out_dir << std::endl;
+            exit(1);
+        }
+        // a changed file is patched even when given whole, so that its old version is checked
+        if (same[n]) manifest += "same " + change.new_hash + " " + change.path + "\n";
+        else if (!change.old_hash.empty()) manifest += "patch " + change.old_hash + " " + change.new_hash + " " + change.path + "\n";
+        else manifest += "add " + change.new_hash + " " + change.path + "\n";
+        if (same[n]) continue;
+        if (change.old_hash.empty()) added++;
+        else patched++;
+    }
+    for (const auto& file : old_files)
+    {
+        if (new_files.count(file.first)) continue;
+        std::string old;
+        if (!readFile(file.second, old)) continue;
+        manifest += "remove " + Sha256::hex(Sha256::digest(old)) + " " + file.first + "\n";
+        removed++;
+    }
+    createDirectories(out_dir.substr(0, out_dir.size() - 1));
+    if (!writeFileAtomically(out_dir + "manifest", manifest, 0644))
+    {
+        std::cerr << "\n\nError : An error occured while writing " << out_dir << "manifest" << std::endl;
+        exit(1);
+    }
+
+    Log::info() << "* " << (changes.size() - patched - added) << " files unchanged, " << patched << " patched, "
+                << added << " added, " << removed << " removed";
+    Log::info() << "* " << (package_size >> 10) << " KB to download instead of " << (bundle_size >> 10) << " KB";
+}
+
+}
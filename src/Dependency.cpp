@@ -34,6 +34,8 @@ THE SOFTWARE.
 #include "Utils.h"
 #include "Settings.h"
 #include "DylibBundler.h"
+#include "Log.h"
+#include "ToolBackend.h"
 
 #include <stdlib.h>
 #include <sstream>
@@ -80,28 +82,25 @@ void initSearchPaths(){
     }
 }
 
-// if some libs are missing prefixes, this will be set to true
-// more stuff will then be necessary to do
-bool missing_prefixes = false;
-
 Dependency::Dependency(std::string path, const std::string& dependent_file)
 {
-    char original_file_buffer[PATH_MAX];
     std::string original_file;
 
     rtrim(path);
     if (isRpath(path))
     {
         original_file = searchFilenameInRpaths(path, dependent_file);
-    }
-    else if (realpath(rtrim(path).c_str(), original_file_buffer))
-    {
-        original_file = original_file_buffer;
+        // not found, and recorded as unresolved
+        if (original_file.empty()) original_file = path;
     }
     else
     {
-        std::cerr << "\n/!\\ WARNING : Cannot resolve path '" << path.c_str() << "'" << std::endl;
-        original_file = path;
+        original_file = tools().realPath(path);
+        if (original_file.empty())
+        {
+            std::cerr << "\n/!\\ WARNING : Cannot resolve path '" << path.c_str() << "'" << std::endl;
+            original_file = path;
+        }
     }
 
     // check if given path is a symlink
@@ -113,10 +112,10 @@ Dependency::Dependency(std::string path, const std::string& dependent_file)
     if( !prefix.empty() && prefix[ prefix.size()-1 ] != '/' ) prefix += "/";
 
     // check if this dependency is in /usr/lib, /System/Library, or in ignored list
-    if (!Settings::isPrefixBundled(prefix)) return;
+    if (!Settings::isPrefixBundled(prefix+filename)) return;
 
     // check if the lib is in a known location
-    if( prefix.empty() || !fileExists( prefix+filename ) )
+    if( prefix.empty() || !tools().fileExists( prefix+filename ) )
     {
         //the paths contains at least /usr/lib so if it is empty we have not initialized it
         int searchPathAmount = Settings::searchPathAmount();
@@ -130,24 +129,25 @@ Dependency::Dependency(std::string path, const std::string& dependent_file)
         for( int i=0; i<searchPathAmount; ++i)
         {
             std::string search_path = Settings::searchPath(i);
-            if (fileExists( search_path+filename ))
+            if (tools().directoryContains( search_path, filename ))
             {
-                std::cout << "FOUND " << filename << " in " << search_path << std::endl;
+                Log::info() << "FOUND " << filename << " in " << search_path;
                 prefix = search_path;
-                missing_prefixes = true; //the prefix was missing
+                missing_prefix = true;
                 break;
             }
         }
     }
     
     //If the location is still unknown, ask the user for search path
-    if( !Settings::isPrefixIgnored(prefix)
-        && ( prefix.empty() || !fileExists( prefix+filename ) ) )
+    if( !Settings::isPrefixIgnored(prefix+filename)
+        && ( prefix.empty() || !tools().fileExists( prefix+filename ) ) )
     {
         std::cerr << "\n/!\\ WARNING : Library " << filename << " has an incomplete name (location unknown)" << std::endl;
-        missing_prefixes = true;
+        missing_prefix = true;
 
-        Settings::addSearchPath(getUserInputDirForFile(filename));
+        prefix = getUserInputDirForFile(filename, dependent_file);
+        if( !prefix.empty() ) Settings::addSearchPath(prefix);
     }
 
     new_name = filename;
@@ -155,19 +155,18 @@ Dependency::Dependency(std::string path, const std::string& dependent_file)
 
 void Dependency::print()
 {
-    std::cout << std::endl;
-    std::cout << " * " << filename.c_str() << " from " << prefix.c_str() << std::endl;
+    Log::info() << "\n * " << filename.c_str() << " from " << prefix.c_str();
     
     const int symamount = symlinks.size();
     for(int n=0; n<symamount; n++)
-        std::cout << "     symlink --> " << symlinks[n].c_str() << std::endl;;
+        Log::info() << "     symlink --> " << symlinks[n].c_str();
 }
 
-std::string Dependency::getInstallPath()
+std::string Dependency::getInstallPath() const
 {
     return Settings::destFolder() + new_name;
 }
-std::string Dependency::getInnerPath()
+std::string Dependency::getInnerPath() const
 {
     return Settings::inside_lib_path() + new_name;
 }
@@ -189,18 +188,21 @@ bool Dependency::mergeIfSameAs(Dependency& dep2)
         for(int n=0; n<samount; n++) {
             dep2.addSymlink(getSymlink(n));
         }
+        if(missing_prefix) dep2.missing_prefix = true;
         return true;
     }
     return false;
 }
 
-void Dependency::copyYourself()
+void Dependency::copyYourself() const
 {
-    copyFile(getOriginalPath(), getInstallPath());
+    if( !Settings::thinArch().empty() || Settings::stripDebug() )
+        copyFileTrimmed(getOriginalPath(), getInstallPath());
+    else
+        copyFile(getOriginalPath(), getInstallPath());
     
     // Fix the lib's inner name
-    std::string command = std::string("install_name_tool -id \"") + getInnerPath() + "\" \"" + getInstallPath() + "\"";
-    if( systemp( command ) != 0 )
+    if( !tools().changeId(getInstallPath(), getInnerPath()) )
     {
         std::cerr << "\n\nError : An error occured while trying to change identity of library " << getInstallPath() << std::endl;
         exit(1);
@@ -209,25 +211,24 @@ void Dependency::copyYourself()
 
 void Dependency::fixFileThatDependsOnMe(const std::string& file_to_fix)
 {
-    // for main lib file
-    changeInstallName(file_to_fix, getOriginalPath(), getInnerPath());
-    // for symlinks
-    const int symamount = symlinks.size();
-    for(int n=0; n<symamount; n++)
+    const std::vector<std::string> names = namesToFix();
+    for(const auto& name : names)
     {
-        changeInstallName(file_to_fix, symlinks[n], getInnerPath());
+        changeInstallName(file_to_fix, name, getInnerPath());
     }
+}
+
+std::vector<std::string> Dependency::namesToFix() const
+{
+    // for main lib file, then symlinks
+    std::vector<std::string> names(1, getOriginalPath());
+    names.insert(names.end(), symlinks.begin(), symlinks.end());
     
     // FIXME - hackish
-    if(missing_prefixes)
+    if(missing_prefix)
     {
-        // for main lib file
-        changeInstallName(file_to_fix, filename, getInnerPath());
-        // for symlinks
-        const int symamount = symlinks.size();
-        for(int n=0; n<symamount; n++)
-        {
-            changeInstallName(file_to_fix, symlinks[n], getInnerPath());
-        }
+        names.push_back(filename);
+        names.insert(names.end(), symlinks.begin(), symlinks.end());
     }
+    return names;
 }
@@ -35,6 +35,10 @@ class Dependency
     std::string filename;
     std::string prefix;
     std::vector<std::string> symlinks;
+    // The name it was found by lacked its location, so files may also refer to it by its bare
+    // name. Kept with each dependency rather than for the whole run, as files are fixed while
+    // others are still being looked at.
+    bool missing_prefix = false;
     
     // installation
     std::string new_name;
@@ -45,8 +49,8 @@ public:
 
     std::string getOriginalFileName() const{ return filename; }
     std::string getOriginalPath() const{ return prefix+filename; }
-    std::string getInstallPath();
-    std::string getInnerPath();
+    std::string getInstallPath() const;
+    std::string getInnerPath() const;
         
     void addSymlink(const std::string& s);
     int getSymlinkAmount() const{ return symlinks.size(); }
@@ -54,8 +58,10 @@ public:
     std::string getSymlink(const int i) const{ return symlinks[i]; }
     std::string getPrefix() const{ return prefix; }
 
-    void copyYourself();
+    void copyYourself() const;
     void fixFileThatDependsOnMe(const std::string& file);
+    // names a file may use to refer to this library, which fixFileThatDependsOnMe changes
+    std::vector<std::string> namesToFix() const;
     
     // Compares the given dependency with this one. If both refer to the same file,
     // it returns true and merges both entries into one.
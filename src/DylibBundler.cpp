@@ -24,18 +24,41 @@ THE SOFTWARE.
 
 #include "DylibBundler.h"
 #include <iostream>
+#include <fstream>
+#include <iterator>
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
+#include <atomic>
 #include <set>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <sys/param.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #ifdef __linux
 #include <linux/limits.h>
 #endif
 #include "Utils.h"
 #include "Settings.h"
 #include "Dependency.h"
+#include "Cache.h"
+#include "MachO.h"
+#include "Parallel.h"
+#include "Pipeline.h"
+#include "UnusedDependencies.h"
+#include "LoadPaths.h"
+#include "Log.h"
+#include "Materialize.h"
+#include "Store.h"
+#include "Archive.h"
+#include "Jobserver.h"
+#include "Interrupt.h"
+#include "Journal.h"
+#include "Vfs.h"
+#include "ToolBackend.h"
 
 
 std::vector<Dependency> deps;
@@ -43,18 +66,13 @@ std::map<std::string, std::vector<Dependency> > deps_per_file;
 std::map<std::string, bool> deps_collected;
 std::map<std::string, std::vector<std::string> > rpaths_per_file;
 std::map<std::string, std::string> rpath_to_fullpath;
+std::map<std::string, std::set<std::string> > unused_per_file;
 
-void changeLibPathsOnFile(std::string file_to_fix)
+// points the load commands of 'file_to_fix' that name one of 'deps_in_file' to its bundled copy
+void fixDependenciesOf(const std::string& file_to_fix, std::vector<Dependency> deps_in_file)
 {
-    if (deps_collected.find(file_to_fix) == deps_collected.end())
-    {
-        std::cout << "    ";
-        collectDependencies(file_to_fix);
-        std::cout << "\n";
-    }
-    std::cout << "  * Fixing dependencies on " << file_to_fix.c_str() << std::endl;
+    Log::info() << "  * Fixing dependencies on " << file_to_fix.c_str();
     
-    std::vector<Dependency> deps_in_file = deps_per_file[file_to_fix];
     const int dep_amount = deps_in_file.size();
     for(int n=0; n<dep_amount; n++)
     {
@@ -62,6 +80,26 @@ void changeLibPathsOnFile(std::string file_to_fix)
     }
 }
 
+void changeLibPathsOnFile(std::string file_to_fix)
+{
+    if (deps_collected.find(file_to_fix) == deps_collected.end())
+    {
+        collectDependencies(file_to_fix);
+    }
+    fixDependenciesOf(file_to_fix, deps_per_file[file_to_fix]);
+}
+
+// runs "otool -l" on the given file, unless its output is already known
+std::string getLoadCommands(const std::string& filename)
+{
+    std::string output;
+    if (Cache::findLoadCommands(filename, output)) return output;
+
+    output = tools().loadCommands(filename);
+    if (!output.empty()) Cache::storeLoadCommands(filename, output);
+    return output;
+}
+
 bool isRpath(const std::string& path)
 {
     return path.find("@rpath") == 0 || path.find("@loader_path") == 0;
@@ -69,14 +107,13 @@ bool isRpath(const std::string& path)
 
 void collectRpaths(const std::string& filename)
 {
-    if (!fileExists(filename))
+    if (!tools().fileExists(filename))
     {
         std::cerr << "\n/!\\ WARNING : can't collect rpaths for nonexistent file '" << filename << "'\n";
         return;
     }
 
-    std::string cmd = "otool -l \"" + filename + "\"";
-    std::string output = system_get_output(cmd);
+    std::string output = getLoadCommands(filename);
 
     std::vector<std::string> lc_lines;
     tokenize(output, "\n", &lc_lines);
@@ -114,13 +151,11 @@ void collectRpaths(const std::string& filename)
 
 std::string searchFilenameInRpaths(const std::string& rpath_file, const std::string& dependent_file)
 {
-    char buffer[PATH_MAX];
     std::string fullpath;
     std::string suffix = std::regex_replace(rpath_file, std::regex("^@[a-z_]+path/"), "");
 
     const auto check_path = [&](std::string path)
     {
-        char buffer[PATH_MAX];
         std::string file_prefix = dependent_file.substr(0, dependent_file.rfind('/')+1);
         if (dependent_file != rpath_file)
         {
@@ -133,9 +168,10 @@ std::string searchFilenameInRpaths(const std::string& rpath_file, const std::str
             {
                 path_to_check = std::regex_replace(path, std::regex("@rpath/"), file_prefix);
             }
-            if (realpath(path_to_check.c_str(), buffer))
+            const std::string real_path = tools().realPath(path_to_check);
+            if (!real_path.empty())
             {
-                fullpath = buffer;
+                fullpath = real_path;
                 rpath_to_fullpath[rpath_file] = fullpath;
                 return true;
             }
@@ -167,7 +203,7 @@ std::string searchFilenameInRpaths(const std::string& rpath_file, const std::str
         for (int n=0; n<searchPathAmount; n++)
         {
             std::string search_path = Settings::searchPath(n);
-            if (fileExists(search_path+suffix))
+            if (tools().directoryContains(search_path, suffix))
             {
                 fullpath = search_path + suffix;
                 break;
@@ -177,11 +213,12 @@ std::string searchFilenameInRpaths(const std::string& rpath_file, const std::str
         if (fullpath.empty())
         {
             std::cerr << "\n/!\\ WARNING : can't get path for '" << rpath_file << "'\n";
-            fullpath = getUserInputDirForFile(suffix) + suffix;
-            if (realpath(fullpath.c_str(), buffer))
-            {
-                fullpath = buffer;
-            }
+            const std::string prefix = getUserInputDirForFile(suffix, dependent_file);
+            // recorded as unresolved, rather than looked for relative to the working directory
+            if (prefix.empty()) return "";
+            fullpath = prefix + suffix;
+            const std::string real_path = tools().realPath(fullpath);
+            if (!real_path.empty()) fullpath = real_path;
         }
     }
 
@@ -193,26 +230,63 @@ std::string searchFilenameInRpaths(const std::string& rpath_dep)
     return searchFilenameInRpaths(rpath_dep, rpath_dep);
 }
 
-void fixRpathsOnFile(const std::string& original_file, const std::string& file_to_fix)
+std::vector<std::string> rpathsOf(const std::string& original_file)
 {
-    std::vector<std::string> rpaths_to_fix;
     std::map<std::string, std::vector<std::string> >::iterator found = rpaths_per_file.find(original_file);
-    if (found != rpaths_per_file.end())
-    {
-        rpaths_to_fix = found->second;
-    }
+    if (found == rpaths_per_file.end()) return std::vector<std::string>();
+    return found->second;
+}
 
+void fixRpaths(const std::string& file_to_fix, const std::vector<std::string>& rpaths_to_fix)
+{
     for (size_t i=0; i < rpaths_to_fix.size(); ++i)
     {
-        std::string command = std::string("install_name_tool -rpath \"") +
-                rpaths_to_fix[i] + "\" \"" + Settings::inside_lib_path() + "\" \"" + file_to_fix + "\"";
-        if ( systemp(command) != 0)
+        if (!tools().changeRpath(file_to_fix, rpaths_to_fix[i], Settings::inside_lib_path()))
         {
             std::cerr << "\n\nError : An error occured while trying to fix dependencies of " << file_to_fix << std::endl;
         }
+        Journal::edited(file_to_fix);
     }
 }
 
+void fixRpathsOnFile(const std::string& original_file, const std::string& file_to_fix)
+{
+    fixRpaths(file_to_fix, rpathsOf(original_file));
+}
+
+// what fixing 'dependencies' and 'rpaths', removing 'unused' and signing change in a file,
+// to make all of it in a single write
+FileEdits editsFor(const std::vector<Dependency>& dependencies, const std::vector<std::string>& rpaths,
+                   const std::set<std::string>& unused)
+{
+    FileEdits edits;
+    edits.unused = unused;
+    for(const auto& dep : dependencies)
+    {
+        for(const auto& name : dep.namesToFix()) edits.install_names.push_back(std::make_pair(name, dep.getInnerPath()));
+    }
+    edits.rpaths = rpaths;
+    edits.sign = Settings::canCodesign();
+    return edits;
+}
+
+// Takes the processed copy of a library from the store, if it's there. Otherwise, 'key'
+// is where to add it once processed, or empty without --store.
+bool fetchFromStore(const std::string& original, const std::string& install_path, const FileEdits& edits, std::string& key)
+{
+    if(not Store::enabled()) return false;
+    if(!Settings::canOverwriteFiles() && !Archive::replacesFiles() && tools().fileExists(install_path))
+    {
+        std::cerr << "\n\nError : File " << install_path << " already exists. Remove it or enable overwriting." << std::endl;
+        exit(1);
+    }
+    std::ifstream in(original.c_str(), std::ios::binary);
+    const std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if(!in.good() && !in.eof()) return false;
+    key = Store::key(contents, edits, install_path);
+    return Store::fetch(key, install_path);
+}
+
 void addDependency(const std::string& path, const std::string& filename)
 {
     Dependency dep(path, filename);
@@ -234,20 +308,101 @@ void addDependency(const std::string& path, const std::string& filename)
         if(dep.mergeIfSameAs(deps_in_file[n])) in_deps_per_file = true;
     }
 
-    if(!Settings::isPrefixBundled(dep.getPrefix())) return;
+    if(!Settings::isPrefixBundled(dep.getOriginalPath())) return;
     
     if(!in_deps) deps.push_back(dep);
     if(!in_deps_per_file) deps_per_file[filename].push_back(dep);
 }
 
+// resource types commonly found in bundles by the thousands, which can't be Mach-O files
+bool isResourceFile(const std::string& name)
+{
+    static const char* const extensions[] = { ".plist", ".strings", ".stringsdict", ".nib", ".png", ".jpg",
+        ".icns", ".tiff", ".car", ".svg", ".txt", ".json", ".xml", ".html", ".css", ".js", ".h", ".qm", ".ttf" };
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos) return false;
+    const std::string extension = name.substr(dot);
+    for (const char* known : extensions)
+    {
+        if (extension == known) return true;
+    }
+    return false;
+}
+
+void addFilesToFixFromBundle(const std::string& bundle)
+{
+    char buffer[PATH_MAX];
+    if (!realpath(bundle.c_str(), buffer))
+    {
+        std::cerr << "\n\nError : Cannot find bundle " << bundle << std::endl;
+        exit(1);
+    }
+    const std::string root = buffer;
+
+    // the dest folder may not exist yet, in which case nothing inside the bundle can be in it
+    std::string dest_folder;
+    if (realpath(Settings::destFolder().c_str(), buffer)) dest_folder = buffer;
+
+    std::mutex mutex;
+    std::vector<std::string> found;
+    parallelWalk(std::vector<std::string>(1, root), [&](const std::string& dir, std::vector<std::string>& subdirs)
+    {
+        if (dir == dest_folder) return;
+        DIR* handle = opendir(dir.c_str());
+        if (handle == NULL) return;
+
+        std::vector<std::string> binaries;
+        while (struct dirent* ent = readdir(handle))
+        {
+            const std::string name = ent->d_name;
+            if (name == "." || name == "..") continue;
+            const std::string path = dir + "/" + name;
+
+            bool is_dir, is_file;
+#ifdef DT_DIR
+            if (ent->d_type != DT_UNKNOWN)
+            {
+                is_dir = ent->d_type == DT_DIR;
+                is_file = ent->d_type == DT_REG;
+            }
+            else
+#endif
+            {
+                struct stat st;
+                if (lstat(path.c_str(), &st) != 0) continue;
+                is_dir = S_ISDIR(st.st_mode);
+                is_file = S_ISREG(st.st_mode);
+            }
+
+            // symlinks are skipped: framework symlinks would make us fix the same files twice
+            if (is_dir)
+            {
+                // debug symbols are Mach-O files too, but there's nothing to fix in them
+                if (name.size() < 5 || name.compare(name.size()-5, 5, ".dSYM") != 0) subdirs.push_back(path);
+            }
+            else if (is_file && !isResourceFile(name) && MachO::isMachO(path))
+            {
+                binaries.push_back(path);
+            }
+        }
+        closedir(handle);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        found.insert(found.end(), binaries.begin(), binaries.end());
+    });
+
+    // the walk order depends on thread scheduling, keep the output stable
+    std::sort(found.begin(), found.end());
+    for (const auto& file : found) Settings::addFileToFix(file);
+}
+
 /*
  *  Fill vector 'lines' with dependencies of given 'filename'
  */
 void collectDependencies(const std::string& filename, std::vector<std::string>& lines)
 {
     // execute "otool -l" on the given file and collect the command's output
-    std::string cmd = "otool -l \"" + filename + "\"";
-    std::string output = system_get_output(cmd);
+    std::string output = getLoadCommands(filename);
 
     if(output.find("can't open file")!=std::string::npos or output.find("No such file")!=std::string::npos or output.size()<1)
     {
@@ -292,12 +447,9 @@ void collectDependencies(const std::string& filename)
 
     std::vector<std::string> lines;
     collectDependencies(filename, lines);
-       
-    std::cout << "."; fflush(stdout);
 
     for (const auto& line : lines)
     {
-        std::cout << "."; fflush(stdout);
         if (line[0] != '\t') continue; // only lines beginning with a tab interest us
         if (line.find(".framework") != std::string::npos) continue; //Ignore frameworks, we can not handle them
 
@@ -309,6 +461,7 @@ void collectDependencies(const std::string& filename)
     }
 
     deps_collected[filename] = true;
+    Log::progress("Collecting dependencies", deps_collected.size(), deps.size() + Settings::fileToFixAmount());
 }
 
 void collectSubDependencies()
@@ -322,10 +475,12 @@ void collectSubDependencies()
         dep_amount = deps.size();
         for (size_t n=0; n<dep_amount; n++)
         {
-            std::cout << "."; fflush(stdout);
             std::string original_path = deps[n].getOriginalPath();
             if (isRpath(original_path)) original_path = searchFilenameInRpaths(original_path);
 
+            // unresolved libraries are reported together once the crawl is over
+            if (!Settings::canPrompt() && !tools().fileExists(original_path)) continue;
+
             collectDependencies(original_path);
         }
         
@@ -333,19 +488,118 @@ void collectSubDependencies()
     }
 }
 
+// whether load command 'name' refers to 'dep'
+bool refersTo(const std::string& name, Dependency& dep)
+{
+    if (name == dep.getOriginalPath()) return true;
+    if (name.find('/') == std::string::npos && name == dep.getOriginalFileName()) return true;
+    const int symamount = dep.getSymlinkAmount();
+    for (int n=0; n<symamount; n++)
+    {
+        if (name == dep.getSymlink(n)) return true;
+    }
+    return false;
+}
+
+void analyzeDependencyUsage()
+{
+    std::vector<std::string> files;
+    for (const auto& collected : deps_collected) files.push_back(collected.first);
+
+    std::vector<DependencyUsage> usages(files.size());
+    std::vector<char> readable(files.size()); // not vector<bool>, which can't be written concurrently
+    parallelFor(files.size(), [&](size_t n)
+    {
+        const std::string& file = files[n];
+        const auto resolve = [&](const std::string& name)
+        {
+            // deps_per_file isn't modified while this runs
+            std::map<std::string, std::vector<Dependency> >::iterator found = deps_per_file.find(file);
+            if (found == deps_per_file.end()) return std::string();
+            for (auto& dep : found->second)
+            {
+                if (refersTo(name, dep)) return dep.getOriginalPath();
+            }
+            return Settings::isSystemLibrary(name) ? name : std::string();
+        };
+        readable[n] = findDependencyUsage(file, resolve, usages[n]);
+    });
+
+    Log::info();
+    for (size_t n=0; n<files.size(); n++)
+    {
+        if (!readable[n])
+        {
+            std::cerr << "/!\\ WARNING : Cannot read imports of " << files[n] << ", assuming all its dependencies are used" << std::endl;
+            continue;
+        }
+        for (const auto& name : usages[n].unused)
+            Log::info() << "  * " << files[n] << " doesn't use " << name;
+    }
+
+    if (!Settings::dropUnused()) return;
+
+    // forget edges only made of unused load commands
+    for (size_t n=0; n<files.size(); n++)
+    {
+        if (!readable[n] || usages[n].unused.empty()) continue;
+        unused_per_file[files[n]] = usages[n].unused;
+
+        std::vector<Dependency>& deps_in_file = deps_per_file[files[n]];
+        std::vector<Dependency> kept;
+        for (auto& dep : deps_in_file)
+        {
+            bool used = false;
+            for (const auto& name : usages[n].used)
+            {
+                if (refersTo(name, dep)) used = true;
+            }
+            if (used) kept.push_back(dep);
+        }
+        deps_in_file.swap(kept);
+    }
+
+    // then everything that can't be reached from the files to fix anymore
+    std::set<std::string> reachable;
+    std::vector<std::string> pending;
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    for (int n=0; n<fileToFixAmount; n++) pending.push_back(Settings::fileToFix(n));
+    while (!pending.empty())
+    {
+        const std::string file = pending.back();
+        pending.pop_back();
+        for (auto& dep : deps_per_file[file])
+        {
+            if (reachable.insert(dep.getOriginalPath()).second) pending.push_back(dep.getOriginalPath());
+        }
+    }
+
+    std::vector<Dependency> kept;
+    for (auto& dep : deps)
+    {
+        if (reachable.count(dep.getOriginalPath())) kept.push_back(dep);
+        else Log::info() << "  * Dropping " << dep.getOriginalPath();
+    }
+    deps.swap(kept);
+}
+
 void createDestDir()
 {
     std::string dest_folder = Settings::destFolder();
-    std::cout << "* Checking output directory " << dest_folder.c_str() << std::endl;
+    Log::info() << "* Checking output directory " << dest_folder.c_str();
     
     // ----------- check dest folder stuff ----------
-    bool dest_exists = fileExists(dest_folder);
+    bool dest_exists = tools().fileExists(dest_folder);
     
-    if(dest_exists and Settings::canOverwriteDir())
+    if(dest_exists and Settings::canOverwriteDir() and Journal::resuming())
+    {
+        Log::info() << "* Erasing what the interrupted run didn't finish in " << dest_folder.c_str();
+        Journal::keepOnlyFinished();
+    }
+    else if(dest_exists and Settings::canOverwriteDir())
     {
-        std::cout << "* Erasing old output directory " << dest_folder.c_str() << std::endl;
-        std::string command = std::string("rm -r \"") + dest_folder + "\"";
-        if( systemp( command ) != 0)
+        Log::info() << "* Erasing old output directory " << dest_folder.c_str();
+        if( !tools().removeTree(dest_folder) )
         {
             std::cerr << "\n\nError : An error occured while attempting to overwrite dest folder." << std::endl;
             exit(1);
@@ -358,9 +612,8 @@ void createDestDir()
         
         if(Settings::canCreateDir())
         {
-            std::cout << "* Creating output directory " << dest_folder.c_str() << std::endl;
-            std::string command = std::string("mkdir -p \"") + dest_folder + "\"";
-            if( systemp( command ) != 0)
+            Log::info() << "* Creating output directory " << dest_folder.c_str();
+            if( !tools().createDirectory(dest_folder) )
             {
                 std::cerr << "\n\nError : An error occured while creating dest folder." << std::endl;
                 exit(1);
@@ -375,39 +628,376 @@ void createDestDir()
     
 }
 
+// the edits bundling 'file' makes, 'dep' being the library it is a copy of, if it is one
+FileEdits editsOf(const std::string& file, const Dependency* dep)
+{
+    FileEdits edits = editsFor(deps_per_file[file], rpathsOf(file), unused_per_file[file]);
+    if(dep) edits.id = dep->getInnerPath();
+    return edits;
+}
+
+void writeDependency(const Dependency& dep, const std::string& original, const FileEdits& edits)
+{
+    std::string key;
+    if(fetchFromStore(original, dep.getInstallPath(), edits, key))
+    {
+        if(Archive::enabled() and not Archive::replacesFiles()) Archive::addFromDisk(dep.getInstallPath());
+        return;
+    }
+    
+    if(singleWrite())
+    {
+        Log::info() << "  * Fixing dependencies on " << dep.getInstallPath();
+        materialize(original, dep.getInstallPath(), edits, key);
+        return;
+    }
+    dep.copyYourself();
+    removeDependencies(dep.getInstallPath(), unused_per_file[original]);
+    changeLibPathsOnFile(dep.getInstallPath());
+    fixRpathsOnFile(original, dep.getInstallPath());
+    adhocCodeSign(dep.getInstallPath());
+    if(!key.empty()) Store::put(key, dep.getInstallPath());
+    if(Archive::enabled()) Archive::addFromDisk(dep.getInstallPath());
+}
+
+void bundleDependency(const Dependency& dep)
+{
+    Log::info() << "\n* Processing dependency " << dep.getInstallPath();
+    const std::string original = dep.getOriginalPath();
+    if(deps_collected.find(original) == deps_collected.end()) collectDependencies(original);
+    const FileEdits edits = editsOf(original, &dep);
+    const std::string journal_key = Journal::enabled() ? Journal::key(original, edits, dep.getInstallPath()) : "";
+    if(journal_key.empty())
+    {
+        writeDependency(dep, original, edits);
+        return;
+    }
+    if(Journal::finished(journal_key, dep.getInstallPath()))
+    {
+        Log::info() << "  * Already done by the interrupted run";
+        if(Archive::enabled()) Archive::addFromDisk(dep.getInstallPath());
+        return;
+    }
+    Journal::planned(journal_key, dep.getInstallPath());
+    writeDependency(dep, original, edits);
+    Journal::done(journal_key, dep.getInstallPath());
+}
+
+void fixFile(const std::string& file)
+{
+    Log::info() << "\n* Processing " << file;
+    if(Journal::enabled()) Journal::keepOriginal(file);
+    if(singleWrite())
+    {
+        Log::info() << "  * Fixing dependencies on " << file;
+        materialize(file, file, editsOf(file, nullptr), "");
+        Journal::edited(file);
+        return;
+    }
+    copyFile(file, file); // to set write permission
+    removeDependencies(file, unused_per_file[file]);
+    Journal::edited(file);
+    changeLibPathsOnFile(file);
+    fixRpathsOnFile(file, file);
+    adhocCodeSign(file);
+    if(Archive::enabled()) Archive::addFromDisk(file);
+}
+
+// dies of the signal that asked to stop, once the files being written are done
+void stopIfRequested()
+{
+    if(not Interrupt::requested()) return;
+    Log::progressDone();
+    if(Journal::enabled()) Log::info() << "\n* Stopped, run the same command again to resume";
+    else Log::info() << "\n* Stopped";
+    Log::flush();
+    Interrupt::stop();
+}
+
 void doneWithDeps_go()
 {
-    std::cout << std::endl;
+    Log::info();
     const int dep_amount = deps.size();
     // print info to user
     for(int n=0; n<dep_amount; n++)
     {
         deps[n].print();
     }
-    std::cout << std::endl;
+    Log::info();
     
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    const size_t total = (Settings::bundleLibs() ? dep_amount : 0) + fileToFixAmount;
+    Interrupt::Graceful graceful;
+
     // copy files if requested by user
     if(Settings::bundleLibs())
     {
-        createDestDir();
+        if(not Archive::replacesFiles()) createDestDir();
         
         for(int n=dep_amount-1; n>=0; n--)
         {
-            std::cout << "\n* Processing dependency " << deps[n].getInstallPath() << std::endl;
-            deps[n].copyYourself();
-            changeLibPathsOnFile(deps[n].getInstallPath());
-            fixRpathsOnFile(deps[n].getOriginalPath(), deps[n].getInstallPath());
-            adhocCodeSign(deps[n].getInstallPath());
+            stopIfRequested();
+            Log::progress("Bundling", dep_amount-1-n, total);
+            bundleDependency(deps[n]);
         }
     }
     
-    const int fileToFixAmount = Settings::fileToFixAmount();
     for(int n=fileToFixAmount-1; n>=0; n--)
     {
-        std::cout << "\n* Processing " << Settings::fileToFix(n) << std::endl;
-        copyFile(Settings::fileToFix(n), Settings::fileToFix(n)); // to set write permission
-        changeLibPathsOnFile(Settings::fileToFix(n));
-        fixRpathsOnFile(Settings::fileToFix(n), Settings::fileToFix(n));
-        adhocCodeSign(Settings::fileToFix(n));
+        stopIfRequested();
+        Log::progress("Bundling", total-1-n, total);
+        fixFile(Settings::fileToFix(n));
+    }
+    stopIfRequested();
+    Log::progressDone();
+}
+
+namespace
+{
+
+// a file going through the bundling pipeline, with everything the stages need copied in,
+// so they never look at the maps the crawl is still filling
+struct BundleItem
+{
+    std::unique_ptr<Dependency> library; // copied into the dest folder, or null for files fixed in place
+    std::string file_to_fix;
+    std::vector<Dependency> dependencies;
+    std::vector<std::string> rpaths;
+    bool written = false;  // copied, fixed and signed in one write by the first stage, or fetched
+    bool fetched = false;  // taken from the store as it is
+    bool skipped = false;  // left alone, as a signal asked to stop
+    std::string store_key; // where to add it to the store once done
+    std::string journal_key; // what the journal records writing it as, empty if it's already recorded
+};
+
+}
+
+void collectAndBundle()
+{
+    if(Settings::bundleLibs() and not Archive::replacesFiles()) createDestDir();
+    Interrupt::Graceful graceful;
+
+    std::atomic<size_t> done(0);
+    const auto reportProgress = [&]()
+    {
+        Log::progress("Bundling", done, deps.size() + Settings::fileToFixAmount());
+    };
+
+    const std::vector<Pipeline<BundleItem>::Stage> stages =
+    {
+        // copy
+        [](BundleItem& item)
+        {
+            item.skipped = Interrupt::requested() != 0;
+            if(item.skipped) return;
+            Log::info() << "\n* Processing " << (item.library ? "dependency " : "") << item.file_to_fix;
+            FileEdits edits = editsFor(item.dependencies, item.rpaths, std::set<std::string>());
+            if(not item.library and Journal::enabled()) Journal::keepOriginal(item.file_to_fix);
+            if(item.library)
+            {
+                edits.id = item.library->getInnerPath();
+                if(Journal::enabled()) item.journal_key = Journal::key(item.library->getOriginalPath(), edits, item.file_to_fix);
+                if(not item.journal_key.empty() and Journal::finished(item.journal_key, item.file_to_fix))
+                {
+                    Log::info() << "  * Already done by the interrupted run";
+                    item.journal_key.clear();
+                    item.written = true;
+                    return;
+                }
+                if(not item.journal_key.empty()) Journal::planned(item.journal_key, item.file_to_fix);
+                item.fetched = fetchFromStore(item.library->getOriginalPath(), item.file_to_fix, edits, item.store_key);
+                item.written = item.fetched;
+            }
+            if(item.written) return;
+            
+            if(singleWrite())
+            {
+                Log::info() << "  * Fixing dependencies on " << item.file_to_fix;
+                materialize(item.library ? item.library->getOriginalPath() : item.file_to_fix, item.file_to_fix, edits, item.store_key);
+                if(not item.library) Journal::edited(item.file_to_fix);
+                item.written = true;
+            }
+            else if(item.library) item.library->copyYourself();
+            else copyFile(item.file_to_fix, item.file_to_fix); // to set write permission
+        },
+        // rewrite
+        [](BundleItem& item)
+        {
+            if(item.written or item.skipped) return;
+            fixDependenciesOf(item.file_to_fix, item.dependencies);
+            fixRpaths(item.file_to_fix, item.rpaths);
+        },
+        // sign
+        [&](BundleItem& item)
+        {
+            if(item.skipped) return;
+            if(not item.written)
+            {
+                adhocCodeSign(item.file_to_fix);
+                if(not item.store_key.empty()) Store::put(item.store_key, item.file_to_fix);
+            }
+            if(not item.journal_key.empty()) Journal::done(item.journal_key, item.file_to_fix);
+            if(Archive::enabled() and not Archive::replacesFiles()) Archive::addFromDisk(item.file_to_fix);
+            done++;
+        }
+    };
+
+    // the crawl stays on this thread, as it may prompt the user, and hands each file over
+    // as soon as its own dependencies are known: their install names don't depend on anything else.
+    // Only the items are limited: deps and deps_per_file keep the whole graph, which the crawl needs
+    // to bundle each library once, and --watch to bundle them again
+    Pipeline<BundleItem> pipeline(stages, Settings::jobs(), Settings::maxInFlight());
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    for(int n=0; n<fileToFixAmount and not Interrupt::requested(); n++)
+    {
+        const std::string file = Settings::fileToFix(n);
+        {
+            Jobserver::Token token;
+            collectDependencies(file);
+        }
+        BundleItem item;
+        item.file_to_fix = file;
+        item.dependencies = deps_per_file[file];
+        item.rpaths = rpathsOf(file);
+        pipeline.push(std::move(item));
+        reportProgress();
+    }
+
+    // deps grows while this runs, which makes it a breadth-first walk of the graph
+    for(size_t n=0; n<deps.size() and not Interrupt::requested(); n++)
+    {
+        std::string original_path = deps[n].getOriginalPath();
+        if (isRpath(original_path)) original_path = searchFilenameInRpaths(original_path);
+
+        // unresolved libraries are reported together once the crawl is over
+        if (!Settings::canPrompt() && !tools().fileExists(original_path)) continue;
+
+        {
+            Jobserver::Token token;
+            collectDependencies(original_path);
+        }
+        if(not Settings::bundleLibs()) continue;
+
+        deps[n].print();
+        BundleItem item;
+        item.library.reset(new Dependency(deps[n]));
+        item.file_to_fix = deps[n].getInstallPath();
+        item.dependencies = deps_per_file[original_path];
+        item.rpaths = rpathsOf(original_path);
+        pipeline.push(std::move(item));
+        reportProgress();
+    }
+
+    pipeline.finish();
+    stopIfRequested();
+    reportProgress();
+    Log::progressDone();
+}
+
+std::vector<std::string> watchedFiles()
+{
+    std::vector<std::string> files;
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    for(int n=0; n<fileToFixAmount; n++) files.push_back(Settings::fileToFix(n));
+    if(Settings::bundleLibs())
+    {
+        for(const auto& dep : deps) files.push_back(dep.getOriginalPath());
+    }
+    return files;
+}
+
+// drops what was read from 'file', so the next collectDependencies reads it again
+void forgetDependencies(const std::string& file)
+{
+    deps_collected.erase(file);
+    deps_per_file.erase(file);
+    rpaths_per_file.erase(file);
+}
+
+void rebundleChangedFiles(const std::set<std::string>& changed)
+{
+    // edits of every bundled file, by the path they're read from
+    const auto allEdits = [&]()
+    {
+        std::map<std::string, FileEdits> edits;
+        const int fileToFixAmount = Settings::fileToFixAmount();
+        for(int n=0; n<fileToFixAmount; n++) edits[Settings::fileToFix(n)] = editsOf(Settings::fileToFix(n), nullptr);
+        if(Settings::bundleLibs())
+        {
+            for(const auto& dep : deps) edits[dep.getOriginalPath()] = editsOf(dep.getOriginalPath(), &dep);
+        }
+        return edits;
+    };
+    std::map<std::string, FileEdits> before = allEdits();
+
+    // whatever was resolved before may have moved since
+    Vfs::clear();
+    const int unresolved = unresolvedLibraryAmount();
+    for(const auto& file : changed)
+    {
+        Log::info() << "\n* " << file << " changed";
+        forgetDependencies(file);
+        collectDependencies(file);
     }
+    collectSubDependencies();
+    Log::progressDone();
+    if(unresolvedLibraryAmount() > unresolved)
+    {
+        reportUnresolvedLibraries();
+        Log::info() << "\n* Waiting for the next change";
+        return;
+    }
+    if(Settings::reportUnused())
+    {
+        unused_per_file.clear();
+        analyzeDependencyUsage();
+    }
+    std::map<std::string, FileEdits> after = allEdits();
+
+    // besides the files that changed, only those whose edits changed are processed again,
+    // e.g. new dependencies, or dependents of a library that no longer exports what they use
+    const auto outdated = [&](const std::string& file)
+    {
+        return changed.count(file) > 0 || before.find(file) == before.end() || before[file] != after[file];
+    };
+    if(Settings::bundleLibs())
+    {
+        for(size_t n=0; n<deps.size(); n++)
+        {
+            if(not outdated(deps[n].getOriginalPath())) continue;
+            forgetDependencies(deps[n].getInstallPath());
+            bundleDependency(deps[n]);
+        }
+    }
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    for(int n=0; n<fileToFixAmount; n++)
+    {
+        if(outdated(Settings::fileToFix(n))) fixFile(Settings::fileToFix(n));
+    }
+}
+
+void analyzeLoadPaths()
+{
+    std::vector<std::string> loaders;
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    for(int n=0; n<fileToFixAmount; n++) loaders.push_back(Settings::fileToFix(n));
+    if(Settings::bundleLibs())
+    {
+        for(auto& dep : deps) loaders.push_back(dep.getInstallPath());
+    }
+
+    const size_t before = reportLoadPathProbes(loaders);
+    if(not Settings::optimizeLoadPaths()) return;
+
+    Log::info() << "\n* Optimizing load paths";
+    const std::vector<std::string> modified = optimizeLoadPaths(loaders);
+    for(const auto& file : modified) adhocCodeSign(file);
+    if(modified.empty())
+    {
+        Log::info() << "  Nothing to optimize";
+        return;
+    }
+
+    const size_t after = reportLoadPathProbes(loaders);
+    Log::info() << "  " << before << " probes before, " << after << " after";
 }
@@ -25,12 +25,36 @@ THE SOFTWARE.
 #ifndef _crawler_
 #define _crawler_
 
+#include <set>
 #include <string>
+#include <vector>
 
+class Dependency;
+
+// adds every Mach-O file found inside 'bundle' (except in the dest folder) to the files to fix
+void addFilesToFixFromBundle(const std::string& bundle);
 void collectDependencies(const std::string& filename);
 void collectSubDependencies();
+// reports dependencies nothing is bound to, and with --drop-unused, forgets them and
+// whatever is only reachable through them
+void analyzeDependencyUsage();
 void doneWithDeps_go();
+// copies, fixes and signs one library into the dest folder
+void bundleDependency(const Dependency& dep);
+// fixes and signs one of the files to fix, in place
+void fixFile(const std::string& file);
+// files the bundle is made from: the files to fix and the original libraries
+std::vector<std::string> watchedFiles();
+// reads the given files again, and processes them and whatever is affected by their changes
+void rebundleChangedFiles(const std::set<std::string>& changed);
+// crawls the dependencies and copies, fixes and signs each file as soon as it's been crawled,
+// instead of doing one after the other
+void collectAndBundle();
+// reports (and with --optimize-load-paths, reduces) the work dyld does to find the bundled libraries
+void analyzeLoadPaths();
 bool isRpath(const std::string& path);
+// the file an @rpath or @loader_path name refers to, or an empty string once --no-prompt
+// recorded it as unresolved
 std::string searchFilenameInRpaths(const std::string& rpath_file, const std::string& dependent_file);
 std::string searchFilenameInRpaths(const std::string& rpath_dep);
 
@@ -0,0 +1,113 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Interrupt.h"
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+
+namespace Interrupt
+{
+
+namespace
+{
+
+const int MAX_CLEANUPS = 8;
+void (*cleanups[MAX_CLEANUPS])();
+std::atomic<int> cleanup_amount(0);
+std::atomic<int> graceful(0);
+volatile sig_atomic_t requested_signal = 0;
+bool installed = false;
+
+void die(int signal_number)
+{
+    const int amount = cleanup_amount;
+    for (int n = 0; n < amount; n++) cleanups[n]();
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
+
+void handle(int signal_number)
+{
+    if (graceful > 0 && requested_signal == 0)
+    {
+        requested_signal = signal_number;
+        const char message[] = "\n* Stopping once the files being written are done, interrupt again to stop right away\n";
+        if (write(STDERR_FILENO, message, strlen(message)) < 0) {}
+        return;
+    }
+    die(signal_number);
+}
+
+}
+
+void atStop(void (*cleanup)())
+{
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    // the handler only looks at the ones counted, which are complete
+    const int amount = cleanup_amount;
+    if (amount == MAX_CLEANUPS) return;
+    cleanups[amount] = cleanup;
+    cleanup_amount = amount + 1;
+}
+
+void install()
+{
+    if (installed) return;
+    installed = true;
+    for (int signal_number : { SIGINT, SIGTERM, SIGHUP })
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = handle;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(signal_number, &action, NULL);
+    }
+}
+
+int requested()
+{
+    return requested_signal;
+}
+
+void stop()
+{
+    die(requested_signal != 0 ? int(requested_signal) : SIGINT);
+}
+
+Graceful::Graceful()
+{
+    graceful++;
+}
+
+Graceful::~Graceful()
+{
+    graceful--;
+}
+
+}
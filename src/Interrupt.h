@@ -0,0 +1,58 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _interrupt_h_
+#define _interrupt_h_
+
+// What SIGINT, SIGTERM and SIGHUP do. While files are being written to the bundle, the first
+// one only asks to stop, so that the files being written are finished and the journal lets the
+// next run resume. Otherwise, and on a second signal, dylibbundler dies of it right away, once
+// what others wait for is given back and the tools it started are killed.
+namespace Interrupt
+{
+
+// Registers a function called before dying of a signal. It runs in the signal handler, so it may
+// only do what is async-signal-safe. Up to 8 can be registered.
+void atStop(void (*cleanup)());
+
+// installs the signal handlers, once
+void install();
+
+// the signal that asked to stop, 0 if none did
+int requested();
+
+// dies of the signal that asked to stop, after the cleanups
+void stop();
+
+// while one exists, the first signal only asks to stop
+class Graceful
+{
+public:
+    Graceful();
+    ~Graceful();
+};
+
+}
+
+#endif
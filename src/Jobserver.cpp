@@ -0,0 +1,227 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Jobserver.h"
+#include "Interrupt.h"
+#include "Log.h"
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace Jobserver
+{
+
+namespace
+{
+
+// tokens this process may hold at once, more than any make gives
+const int MAX_TOKENS = 1024;
+
+int read_fd = -1;
+int write_fd = -1;
+
+// never destroyed, as the reader thread may still be waiting on them when the process exits
+std::mutex& mutex = *new std::mutex();
+std::condition_variable& token_available = *new std::condition_variable();
+bool implicit_free = true;
+int waiting = 0;        // tasks waiting for a token
+int reading = 0;        // tokens the reader thread was asked for
+std::string available;  // read, and not taken by a task yet
+
+// every token read from the jobserver and not given back yet, including those in 'available',
+// kept where the signal handler can give them back
+char held[MAX_TOKENS];
+volatile sig_atomic_t held_amount = 0;
+
+thread_local int depth = 0;
+
+// with the mutex held
+void giveBack(char byte)
+{
+    for (int n = held_amount - 1; n >= 0; n--)
+    {
+        if (held[n] != byte) continue;
+        held[n] = held[held_amount - 1];
+        held_amount = held_amount - 1;
+        break;
+    }
+    while (write(write_fd, &byte, 1) < 0 && errno == EINTR) {}
+}
+
+// Reads tokens when tasks wait for them. The jobserver pipe is shared with make and the other
+// jobs, so its blocking mode isn't ours to change: reads wait here, away from the tasks.
+void readTokens()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        token_available.wait(lock, [&]{ return reading > 0; });
+        lock.unlock();
+        char byte;
+        ssize_t amount;
+        while ((amount = read(read_fd, &byte, 1)) < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) break;
+            // make may have made the pipe non-blocking for itself
+            pollfd ready = { read_fd, POLLIN, 0 };
+            poll(&ready, 1, -1);
+        }
+        lock.lock();
+        reading--;
+        if (amount != 1)
+        {
+            // the jobserver is gone: from now on, tasks run one at a time
+            Log::verbose() << "* Lost the connection to the jobserver";
+            return;
+        }
+        if (held_amount < MAX_TOKENS) held[held_amount] = byte;
+        held_amount = held_amount + 1;
+        if (waiting > 0)
+        {
+            available += byte;
+            token_available.notify_all();
+        }
+        else giveBack(byte); // whoever wanted it got the implicit token meanwhile
+    }
+}
+
+// on exit, or when killed, so make doesn't lose the tokens
+void giveBackAll()
+{
+    const int amount = held_amount < MAX_TOKENS ? int(held_amount) : MAX_TOKENS;
+    for (int n = 0; n < amount; n++)
+    {
+        if (write(write_fd, &held[n], 1) < 0) {}
+    }
+    held_amount = 0;
+}
+
+bool validFd(int fd)
+{
+    return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+}
+
+}
+
+void connect()
+{
+    const char* flags = getenv("MAKEFLAGS");
+    if (flags == NULL) return;
+    const std::string makeflags = flags;
+    // the last one wins; older makes call it --jobserver-fds
+    size_t found = std::string::npos;
+    for (const char* name : { "--jobserver-auth=", "--jobserver-fds=" })
+    {
+        const size_t at = makeflags.rfind(name);
+        if (at != std::string::npos && (found == std::string::npos || at > found)) found = at + strlen(name);
+    }
+    if (found == std::string::npos) return;
+    const std::string auth = makeflags.substr(found, makeflags.find(' ', found) - found);
+
+    if (auth.compare(0, 5, "fifo:") == 0)
+    {
+        read_fd = open(auth.substr(5).c_str(), O_RDWR | O_CLOEXEC);
+        write_fd = read_fd;
+    }
+    else
+    {
+        const size_t comma = auth.find(',');
+        if (comma == std::string::npos) return;
+        read_fd = atoi(auth.substr(0, comma).c_str());
+        write_fd = atoi(auth.substr(comma + 1).c_str());
+    }
+    if (!validFd(read_fd) || !validFd(write_fd))
+    {
+        // make didn't pass its descriptors down, e.g. the rule wasn't marked with '+'
+        std::cerr << "\n/!\\ WARNING : The jobserver from MAKEFLAGS can't be used, running with --jobs instead" << std::endl;
+        read_fd = write_fd = -1;
+        return;
+    }
+    fcntl(read_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(write_fd, F_SETFD, FD_CLOEXEC);
+
+    atexit(giveBackAll);
+    Interrupt::atStop(giveBackAll);
+    std::thread(readTokens).detach();
+    Log::verbose() << "* Using the jobserver from MAKEFLAGS";
+}
+
+bool enabled()
+{
+    return read_fd >= 0;
+}
+
+Token::Token() : nested(depth++ > 0), implicit(false), byte(0)
+{
+    if (nested || !enabled()) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    waiting++;
+    while (true)
+    {
+        if (implicit_free)
+        {
+            implicit_free = false;
+            implicit = true;
+            break;
+        }
+        if (!available.empty())
+        {
+            byte = available[available.size() - 1];
+            available.erase(available.size() - 1);
+            break;
+        }
+        // one read per waiting task is enough
+        if (reading < waiting - int(available.size()))
+        {
+            reading++;
+            token_available.notify_all();
+        }
+        token_available.wait(lock);
+    }
+    waiting--;
+}
+
+Token::~Token()
+{
+    depth--;
+    if (nested || !enabled()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (implicit) implicit_free = true;
+    // straight to the next task rather than back to make, which would give it back
+    else if (waiting > 0) available += byte;
+    else giveBack(byte);
+    token_available.notify_all();
+}
+
+}
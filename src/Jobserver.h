@@ -0,0 +1,55 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _jobserver_h_
+#define _jobserver_h_
+
+// Shares the job budget of the make (or Ninja) invocation running us, through the jobserver
+// it announces in MAKEFLAGS. Each task run in parallel takes a token from it, except for one
+// at a time, which runs on the token make implicitly gave us by starting us. Without a
+// jobserver, tasks are only limited by the amount of threads from --jobs.
+namespace Jobserver
+{
+
+// joins the jobserver from MAKEFLAGS, given as pipe descriptors or as a fifo, if there's one
+void connect();
+bool enabled();
+
+// Held while running a task of a parallel step, waiting for a token if needed. A thread
+// already holding one doesn't need another for the tasks it runs meanwhile.
+class Token
+{
+    bool nested;
+    bool implicit;
+    char byte;
+public:
+    Token();
+    ~Token();
+    Token(const Token&) = delete;
+    Token& operator=(const Token&) = delete;
+};
+
+}
+
+#endif
@@ -0,0 +1,399 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Journal.h"
+#include "Archive.h"
+#include "Log.h"
+#include "Materialize.h"
+#include "Settings.h"
+#include "Sha256.h"
+#include "Utils.h"
+#include "Vfs.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Journal
+{
+
+namespace
+{
+
+const char HEADER[] = "dylibbundler journal 2";
+const char JOURNAL_NAME[] = ".dylibbundler-journal";
+const char ORIGINALS_NAME[] = ".dylibbundler-originals";
+
+struct Step
+{
+    std::string key;
+    std::string hash;
+};
+
+std::mutex mutex;
+FILE* file = NULL;
+bool resumed = false;
+bool over = false;
+std::map<std::string, Step> finished_steps;       // what the interrupted run finished, by path written
+std::set<std::string> started;                    // every path it started or finished writing
+std::map<std::string, std::string> originals;     // name of the copy of each file fixed in place
+std::map<std::string, std::set<std::string>> states; // of each file fixed in place, as state() gives them
+
+std::string journalPath()
+{
+    return Settings::destFolder() + JOURNAL_NAME;
+}
+
+std::string originalsPath()
+{
+    return Settings::destFolder() + ORIGINALS_NAME + "/";
+}
+
+// Size, date and inode of 'path', which change whenever it's written, empty if it doesn't exist.
+// Not through Vfs, as the file changes during the run.
+std::string state(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return "";
+#ifdef __APPLE__
+    const long mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    const long mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    return std::to_string(st.st_size) + ":" + std::to_string(st.st_mtime) + "." + std::to_string(mtime_nsec) + ":" + std::to_string(st.st_ino);
+}
+
+// hexadecimal SHA-256 of the contents of 'path', empty if it can't be read
+std::string hashFile(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return "";
+    Sha256 hash;
+    char buffer[1 << 16];
+    ssize_t amount;
+    while ((amount = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        if (amount < 0 && errno == EINTR) continue;
+        if (amount < 0)
+        {
+            close(fd);
+            return "";
+        }
+        hash.update(buffer, amount);
+    }
+    close(fd);
+    return Sha256::hex(hash.finish());
+}
+
+bool syncDirectory(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    const bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// With the mutex held. Appends a line to the journal, started with this record, and with 'sync'
+// makes sure it's on disk before returning.
+void record(const std::string& line, bool sync)
+{
+    bool created = false;
+    if (file == NULL)
+    {
+        file = fopen(journalPath().c_str(), "a");
+        created = file != NULL && fseek(file, 0, SEEK_END) == 0 && ftell(file) == 0;
+        if (created) fprintf(file, "%s\n", HEADER);
+    }
+    if (file == NULL || fprintf(file, "%s\n", line.c_str()) < 0 || fflush(file) != 0 ||
+        (sync && (fsync(fileno(file)) != 0 || (created && !syncDirectory(Settings::destFolder())))))
+    {
+        std::cerr << "\n\nError : Cannot write to the journal " << journalPath() << std::endl;
+        exit(1);
+    }
+}
+
+int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+void removeTree(const std::string& path)
+{
+    nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Copies 'path' to 'copy', which is on disk when this returns
+bool copyOriginal(const std::string& path, const std::string& copy)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    const std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    struct stat st;
+    bool ok = (in.good() || in.eof()) && stat(path.c_str(), &st) == 0;
+    const int fd = ok ? open(copy.c_str(), O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777) : -1;
+    for (size_t written = 0; fd >= 0 && ok && written < contents.size(); )
+    {
+        const ssize_t amount = write(fd, contents.data() + written, contents.size() - written);
+        if (amount < 0 && errno == EINTR) continue;
+        ok = amount > 0;
+        if (ok) written += amount;
+    }
+    ok = fd >= 0 && ok && fsync(fd) == 0;
+    if (fd >= 0) ok = close(fd) == 0 && ok;
+    return ok;
+}
+
+}
+
+bool enabled()
+{
+    return Settings::journal() && Settings::bundleLibs() && !Archive::replacesFiles() &&
+           Settings::recordTrace().empty() && Settings::replayTrace().empty() && !over;
+}
+
+void resume()
+{
+    std::ifstream in(journalPath().c_str());
+    std::string line;
+    if (!in || !std::getline(in, line)) return;
+    if (line != HEADER)
+    {
+        std::cerr << "\n/!\\ WARNING : " << journalPath() << " isn't a journal of this version of dylibbundler, ignoring it" << std::endl;
+        return;
+    }
+
+    // the last line may have been cut short
+    while (std::getline(in, line) && !in.eof())
+    {
+        const size_t first = line.find(' ');
+        const size_t second = line.find(' ', first + 1);
+        if (first == std::string::npos || second == std::string::npos) continue;
+        const std::string kind = line.substr(0, first);
+        const std::string key = line.substr(first + 1, second - first - 1);
+        if (kind == "original") originals[line.substr(second + 1)] = key;
+        else if (kind == "state") states[line.substr(second + 1)].insert(key);
+        else if (kind == "drop")
+        {
+            originals.erase(line.substr(second + 1));
+            states.erase(line.substr(second + 1));
+        }
+        else if (kind == "plan")
+        {
+            const std::string path = line.substr(second + 1);
+            finished_steps.erase(path);
+            started.insert(path);
+        }
+        else if (kind == "done")
+        {
+            const size_t third = line.find(' ', second + 1);
+            if (third == std::string::npos) continue;
+            const std::string path = line.substr(third + 1);
+            finished_steps[path] = Step{key, line.substr(second + 1, third - second - 1)};
+            started.insert(path);
+        }
+    }
+    resumed = true;
+    Log::info() << "* Resuming the interrupted run that left " << journalPath() << ", " << finished_steps.size() << " libraries were done";
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto original = originals.begin(); original != originals.end(); )
+    {
+        const std::string copy = originalsPath() + original->second;
+        // rebuilt since, say: it's the file to fix now
+        const std::string now = state(original->first);
+        if (!now.empty() && !states[original->first].count(now))
+        {
+            std::cerr << "\n/!\\ WARNING : " << original->first << " changed since the interrupted run, keeping it rather than its original" << std::endl;
+            record("drop " + original->second + " " + original->first, false);
+            unlink(copy.c_str());
+            states.erase(original->first);
+            original = originals.erase(original);
+            continue;
+        }
+
+        std::ifstream copy_in(copy.c_str(), std::ios::binary);
+        const std::string contents((std::istreambuf_iterator<char>(copy_in)), std::istreambuf_iterator<char>());
+        struct stat st;
+        if (!copy_in.good() && !copy_in.eof())
+        {
+            std::cerr << "\n\nError : Cannot read " << copy << ", the original of " << original->first << std::endl;
+            exit(1);
+        }
+        if (stat(copy.c_str(), &st) != 0 || !writeFileAtomically(original->first, contents, st.st_mode & 07777))
+        {
+            std::cerr << "\n\nError : Cannot put back the original of " << original->first << " from " << copy << std::endl;
+            exit(1);
+        }
+        Log::info() << "  * Putting back the original of " << original->first;
+        const std::string restored = state(original->first);
+        record("state " + restored + " " + original->first, false);
+        states[original->first].insert(restored);
+        ++original;
+    }
+}
+
+bool resuming()
+{
+    return resumed;
+}
+
+void keepOnlyFinished()
+{
+    const std::string dest = Settings::destFolder();
+    DIR* dir = opendir(dest.c_str());
+    if (dir == NULL) return;
+    std::vector<std::string> unfinished;
+    while (struct dirent* entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        if (name == "." || name == ".." || name == JOURNAL_NAME || name == ORIGINALS_NAME) continue;
+        if (finished_steps.find(dest + name) == finished_steps.end()) unfinished.push_back(dest + name);
+    }
+    closedir(dir);
+    for (const auto& path : unfinished) removeTree(path);
+    Vfs::clear();
+}
+
+std::string key(const std::string& from, const FileEdits& edits, const std::string& to)
+{
+    const std::string original = state(from);
+    if (original.empty()) return "";
+
+    Sha256 hash;
+    const auto field = [&](const std::string& value)
+    {
+        hash.update(std::to_string(value.size()) + ":");
+        hash.update(value);
+    };
+    field(HEADER);
+    field(from);
+    field(original);
+    hashEdits(hash, edits, to);
+    return Sha256::hex(hash.finish());
+}
+
+bool finished(const std::string& key, const std::string& to)
+{
+    std::string expected;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto found = finished_steps.find(to);
+        if (key.empty() || found == finished_steps.end() || found->second.key != key) return false;
+        expected = found->second.hash;
+    }
+    if (hashFile(to) != expected) return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    record("done " + key + " " + expected + " " + to, false);
+    return true;
+}
+
+void planned(const std::string& key, const std::string& to)
+{
+    bool left_behind;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        record("plan " + key + " " + to, false);
+        left_behind = started.count(to) > 0;
+    }
+    if (left_behind && unlink(to.c_str()) == 0) Vfs::clear();
+}
+
+void done(const std::string& key, const std::string& to)
+{
+    const std::string hash = hashFile(to);
+    if (hash.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    record("done " + key + " " + hash + " " + to, false);
+}
+
+void keepOriginal(const std::string& file)
+{
+    std::string path = Vfs::realPath(file);
+    if (path.empty()) path = file;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (originals.count(path)) return;
+
+    const std::string name = Sha256::hex(Sha256::digest(path));
+    const std::string copy = originalsPath() + name;
+    const std::string original = state(path);
+    bool ok = !original.empty();
+    if (ok && mkdir(originalsPath().c_str(), 0755) != 0 && errno != EEXIST) ok = false;
+    // A single write replaces the file rather than changing it, so a link keeps the original
+    // as it is, without reading it. The tools change it in place: it has to be copied.
+    if (ok && singleWrite())
+    {
+        unlink(copy.c_str());
+        ok = link(path.c_str(), copy.c_str()) == 0 || copyOriginal(path, copy);
+    }
+    else if (ok) ok = copyOriginal(path, copy);
+    if (!ok || !syncDirectory(originalsPath()))
+    {
+        std::cerr << "\n\nError : Cannot keep the original of " << path << " in " << originalsPath() << std::endl;
+        exit(1);
+    }
+    record("state " + original + " " + path, false);
+    record("original " + name + " " + path, true);
+    originals[path] = name;
+    states[path].insert(original);
+}
+
+void edited(const std::string& file)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (originals.empty()) return;
+    }
+    std::string path = Vfs::realPath(file);
+    if (path.empty()) path = file;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!originals.count(path)) return;
+    const std::string now = state(path);
+    if (!now.empty() && states[path].insert(now).second) record("state " + now + " " + path, true);
+}
+
+void finish()
+{
+    if (!enabled()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) fclose(file);
+    file = NULL;
+    unlink(journalPath().c_str());
+    removeTree(originalsPath());
+    Vfs::clear();
+    over = true;
+}
+
+}
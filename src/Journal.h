@@ -0,0 +1,83 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _journal_h_
+#define _journal_h_
+
+#include <string>
+
+struct FileEdits;
+
+// A record, kept in the dest folder while it's being written, of the libraries each run
+// started and finished writing there, with a hash of what was written, and of the original of
+// every file fixed in place. A run that was interrupted leaves it behind: the next one puts the
+// fixed files back as they were, keeps the libraries that were finished and are still intact,
+// and writes again, from the original, those that weren't. It's removed once the bundle is done.
+//
+// Records are only flushed to the operating system as they're written: a finished library
+// whose record or contents didn't make it to disk fails its hash check, and is written again.
+namespace Journal
+{
+
+// Whether libraries are bundled to the dest folder, and --no-journal wasn't given. Never when
+// a trace is recorded or replayed, as the journal's own files don't go through the tools.
+bool enabled();
+
+// Reads the journal an interrupted run left in the dest folder, if any, and puts the files it
+// was fixing in place back as they were, so that they're read as if nothing happened. A file
+// that isn't as that run left it, e.g. rebuilt since, is kept instead, and its original dropped.
+void resume();
+// whether resume() found a journal
+bool resuming();
+
+// Instead of erasing the dest folder for -od, removes what the interrupted run didn't finish.
+void keepOnlyFinished();
+
+// Key of writing 'from' to 'to' with 'edits'. The original is known by its size, date and
+// inode, so the key is made without reading it.
+std::string key(const std::string& from, const FileEdits& edits, const std::string& to);
+
+// Whether the interrupted run finished writing 'to' as 'key' says, and it hasn't changed since.
+// If so, it's recorded as finished again.
+bool finished(const std::string& key, const std::string& to);
+
+// Records that 'to' is about to be written. Whatever the interrupted run left there is removed.
+void planned(const std::string& key, const std::string& to);
+// records that 'to' is written, with the hash of its contents
+void done(const std::string& key, const std::string& to);
+
+// Keeps the original of 'file' in the dest folder before it's fixed in place, a copy or, when
+// the file is only replaced as a whole by a single write, a hard link. It's on disk, and
+// recorded with its size, date and inode, before this returns.
+void keepOriginal(const std::string& file);
+// Records the size, date and inode of 'file' after each change, if its original was kept,
+// as one of the states the run may leave it in.
+void edited(const std::string& file);
+
+// once the whole bundle is written: removes the journal and the originals
+void finish();
+
+}
+
+#endif
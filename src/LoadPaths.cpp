@@ -0,0 +1,287 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "LoadPaths.h"
+#include "Log.h"
+#include "MachO.h"
+#include "Settings.h"
+#include "Utils.h"
+#include "Vfs.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+
+namespace
+{
+
+struct Rpath
+{
+    std::string path;
+    std::string declared_by; // image @loader_path refers to in this rpath
+};
+
+struct Resolution
+{
+    std::string name;
+    std::string path; // empty if not found
+    size_t probes = 0;
+};
+
+struct Image
+{
+    std::string path;
+    std::vector<Resolution> resolutions;
+};
+
+std::string directoryOf(const std::string& path)
+{
+    return path.substr(0, path.rfind('/'));
+}
+
+std::string canonical(const std::string& path)
+{
+    return Vfs::realPath(path);
+}
+
+std::string expand(const std::string& path, const std::string& loader, const std::string& executable)
+{
+    if (path.compare(0, 17, "@executable_path/") == 0) return directoryOf(executable) + path.substr(16);
+    if (path.compare(0, 13, "@loader_path/") == 0) return directoryOf(loader) + path.substr(12);
+    return path;
+}
+
+// how dyld finds 'name' for 'loader', counting the files it checks on the way
+Resolution resolve(const std::string& name, const std::string& loader, const std::vector<Rpath>& rpaths,
+                   const std::string& executable)
+{
+    Resolution resolution;
+    resolution.name = name;
+
+    if (name.compare(0, 7, "@rpath/") == 0)
+    {
+        const std::string rest = name.substr(6);
+        for (const auto& rpath : rpaths)
+        {
+            std::string candidate = expand(rpath.path, rpath.declared_by, executable);
+            while (!candidate.empty() && candidate[candidate.size()-1] == '/') candidate.erase(candidate.size()-1);
+            candidate += rest;
+            resolution.probes++;
+            if (fileExists(candidate))
+            {
+                resolution.path = canonical(candidate);
+                break;
+            }
+        }
+        return resolution;
+    }
+
+    // system libraries come from the shared cache, without touching the file system
+    if (Settings::isSystemLibrary(name)) return resolution;
+
+    const std::string candidate = expand(name, loader, executable);
+    resolution.probes = 1;
+    if (fileExists(candidate)) resolution.path = canonical(candidate);
+    return resolution;
+}
+
+// loads every image reachable from the fixed files, like dyld would, each once
+void simulate(const std::vector<std::string>& loaders, std::vector<Image>& images)
+{
+    // plug-ins run in the process of the main executable
+    std::string main_executable;
+    std::vector<std::string> roots;
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    for (int n=0; n<fileToFixAmount; n++)
+    {
+        const std::string path = canonical(Settings::fileToFix(n));
+        if (path.empty()) continue;
+        roots.push_back(path);
+        std::vector<MachO::Slice> slices;
+        if (main_executable.empty() && MachO::readHeaders(path, slices) && slices[0].filetype == MachO::MH_EXECUTE)
+            main_executable = path;
+    }
+    if (roots.empty())
+    {
+        // nothing was fixed, consider the bundled libraries on their own
+        for (const auto& loader : loaders) roots.push_back(canonical(loader));
+    }
+
+    std::set<std::string> loaded;
+    for (const auto& root : roots)
+    {
+        const std::string executable = main_executable.empty() ? root : main_executable;
+        // images to load, with the rpaths of the chain that led to them
+        std::vector<std::pair<std::string, std::vector<Rpath> > > pending;
+        pending.push_back(std::make_pair(root, std::vector<Rpath>()));
+        while (!pending.empty())
+        {
+            const std::string path = pending.front().first;
+            std::vector<Rpath> inherited = pending.front().second;
+            pending.erase(pending.begin());
+            if (path.empty() || !loaded.insert(path).second) continue;
+
+            std::vector<MachO::Slice> slices;
+            if (!MachO::readHeaders(path, slices)) continue;
+            const MachO::Slice& slice = slices[0];
+
+            // an image's own rpaths are searched before those of the images that loaded it
+            std::vector<Rpath> rpaths;
+            for (const auto& rpath : slice.rpaths)
+            {
+                Rpath entry;
+                entry.path = rpath;
+                entry.declared_by = path;
+                rpaths.push_back(entry);
+            }
+            rpaths.insert(rpaths.end(), inherited.begin(), inherited.end());
+
+            Image image;
+            image.path = path;
+            for (const auto& dylib : slice.dylibs)
+            {
+                Resolution resolution = resolve(dylib.name, path, rpaths, executable);
+                image.resolutions.push_back(resolution);
+                pending.push_back(std::make_pair(resolution.path, rpaths));
+            }
+            images.push_back(image);
+        }
+    }
+}
+
+std::string relativePath(const std::string& from_dir, const std::string& to)
+{
+    // drop the common leading directories, then go up from what's left of 'from_dir'
+    size_t common = 0;
+    for (size_t n=0; n<from_dir.size() && n<to.size() && from_dir[n] == to[n]; n++)
+    {
+        if (from_dir[n] == '/') common = n + 1;
+    }
+    if (from_dir.size() < to.size() && to.compare(0, from_dir.size(), from_dir) == 0 && to[from_dir.size()] == '/')
+        common = from_dir.size() + 1;
+
+    std::string relative;
+    if (common <= from_dir.size())
+    {
+        const std::string rest = from_dir.substr(common);
+        if (!rest.empty())
+        {
+            relative += "../";
+            for (char c : rest) if (c == '/') relative += "../";
+        }
+    }
+    return relative + to.substr(common);
+}
+
+}
+
+size_t reportLoadPathProbes(const std::vector<std::string>& loaders)
+{
+    std::vector<Image> images;
+    simulate(loaders, images);
+
+    Log::info() << "\n* Simulating dyld's search for dependencies";
+    size_t total = 0;
+    for (const auto& image : images)
+    {
+        size_t probes = 0;
+        for (const auto& resolution : image.resolutions) probes += resolution.probes;
+        total += probes;
+        Log::info() << "  * " << image.path << ": " << probes << " probes for " << image.resolutions.size() << " dependencies";
+        for (const auto& resolution : image.resolutions)
+        {
+            if (resolution.path.empty() && !Settings::isSystemLibrary(resolution.name))
+                Log::info() << "      " << resolution.name << ": NOT FOUND after " << resolution.probes << " probes";
+            else if (resolution.probes > 1)
+                Log::info() << "      " << resolution.name << ": " << resolution.probes << " probes";
+        }
+    }
+    Log::info() << "  Total: " << total << " probes";
+    return total;
+}
+
+std::vector<std::string> optimizeLoadPaths(const std::vector<std::string>& loaders)
+{
+    std::set<std::string> modified;
+
+    // duplicate rpaths are probed again for nothing, and newer versions of dyld refuse them
+    for (const auto& loader : loaders)
+    {
+        MachO::File file;
+        if (!file.load(loader)) continue;
+        bool changed = false;
+        for (size_t n=0; n<file.sliceAmount(); n++)
+        {
+            MachO::Slice& slice = file.slice(n);
+            std::set<std::string> seen;
+            for (size_t c=0; c<slice.commands.size(); )
+            {
+                const MachO::LoadCommand& lc = slice.commands[c];
+                if (lc.cmd == MachO::LC_RPATH)
+                {
+                    const uint32_t str_offset = MachO::read32(slice.data, lc.offset + 8);
+                    const std::string rpath = slice.data.substr(lc.offset + str_offset, lc.size - str_offset).c_str();
+                    if (!seen.insert(rpath).second)
+                    {
+                        MachO::removeCommand(slice, c);
+                        changed = true;
+                        continue;
+                    }
+                }
+                c++;
+            }
+        }
+        if (changed)
+        {
+            Log::info() << "  * Removing duplicate rpaths from " << loader;
+            if (!file.save(loader))
+            {
+                std::cerr << "\n\nError : An error occured while trying to remove duplicate rpaths from " << loader << std::endl;
+                exit(1);
+            }
+            modified.insert(loader);
+        }
+    }
+
+    std::map<std::string, std::string> loader_by_path;
+    for (const auto& loader : loaders) loader_by_path[canonical(loader)] = loader;
+
+    std::vector<Image> images;
+    simulate(loaders, images);
+    for (const auto& image : images)
+    {
+        std::map<std::string, std::string>::const_iterator loader = loader_by_path.find(image.path);
+        if (loader == loader_by_path.end()) continue; // not ours to modify
+
+        for (const auto& resolution : image.resolutions)
+        {
+            if (resolution.probes <= 1 || resolution.path.empty() || resolution.name.compare(0, 7, "@rpath/") != 0) continue;
+            const std::string direct = "@loader_path/" + relativePath(directoryOf(image.path), resolution.path);
+            changeInstallName(loader->second, resolution.name, direct);
+            modified.insert(loader->second);
+        }
+    }
+
+    return std::vector<std::string>(modified.begin(), modified.end());
+}
@@ -0,0 +1,40 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _load_paths_h_
+#define _load_paths_h_
+
+#include <string>
+#include <vector>
+
+// Simulates how dyld looks for the dependencies of 'loaders' (the fixed files and bundled
+// libraries), starting from the fixed files, and prints how many stat() probes each load
+// command costs. Returns the total amount of probes.
+size_t reportLoadPathProbes(const std::vector<std::string>& loaders);
+
+// Removes duplicate LC_RPATHs from 'loaders', and rewrites @rpath install names that need
+// more than one probe to resolve into direct @loader_path ones. Returns the modified files.
+std::vector<std::string> optimizeLoadPaths(const std::vector<std::string>& loaders);
+
+#endif
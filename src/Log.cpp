@@ -0,0 +1,333 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Log.h"
+#include "Utils.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace Log
+{
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct Record
+{
+    FILE* stream;
+    const char* kind;
+    std::string text;
+    double time; // seconds since the start
+};
+
+Level current_level = NORMAL;
+bool json_output = false;
+const Clock::time_point started = Clock::now();
+
+std::mutex mutex;
+std::condition_variable wake;
+std::condition_variable drained;
+std::vector<Record> queue;
+size_t queued = 0;
+size_t written = 0;
+bool flush_requested = false;
+bool running = false;
+bool stopping = false;
+std::thread writer;
+
+// progress, redrawn by the writer
+std::string progress_task;
+size_t progress_done = 0;
+size_t progress_total = 0;
+Clock::time_point progress_started;
+bool progress_changed = false;
+bool progress_shown = false;
+Clock::time_point progress_json_time;
+
+double secondsSince(const Clock::time_point& time)
+{
+    return std::chrono::duration<double>(Clock::now() - time).count();
+}
+
+std::string jsonPrefix(const char* kind, double seconds)
+{
+    char time[32];
+    snprintf(time, sizeof(time), "%.3f", seconds);
+    return std::string("{\"time\":") + time + ",\"level\":\"" + kind + "\"";
+}
+
+// the text a record is written as, empty to write nothing
+std::string format(const Record& record)
+{
+    if (!json_output) return record.text + "\n";
+
+    // blank lines only space out the text output
+    size_t begin = record.text.find_first_not_of('\n');
+    if (begin == std::string::npos) return "";
+    size_t end = record.text.find_last_not_of('\n');
+    return jsonPrefix(record.kind, record.time) + ",\"message\":" + jsonString(record.text.substr(begin, end - begin + 1)) + "}\n";
+}
+
+std::string progressLine()
+{
+    const double elapsed = secondsSince(progress_started);
+    const double rate = elapsed > 0 ? progress_done / elapsed : 0;
+    const double eta = (rate > 0 && progress_total > progress_done) ? (progress_total - progress_done) / rate : 0;
+
+    char numbers[128];
+    if (json_output)
+    {
+        snprintf(numbers, sizeof(numbers), ",\"done\":%zu,\"total\":%zu,\"rate\":%.1f,\"eta\":%.1f}\n",
+                 progress_done, progress_total, rate, eta);
+        return jsonPrefix("progress", secondsSince(started)) + ",\"task\":" + jsonString(progress_task) + numbers;
+    }
+    snprintf(numbers, sizeof(numbers), ": %zu/%zu (%.0f/s, ETA %.0fs)", progress_done, progress_total, rate, eta);
+    return "\r\033[K" + progress_task + numbers;
+}
+
+bool progressVisible()
+{
+    return json_output || (current_level >= NORMAL && isatty(fileno(stdout)));
+}
+
+// called by the writer without the lock; 'progress' is empty if it didn't change
+void writeBatch(const std::vector<Record>& batch, const std::string& progress)
+{
+    if (!batch.empty() && progress_shown && !json_output)
+    {
+        fputs("\r\033[K", stdout);
+        progress_shown = false;
+    }
+
+    FILE* last = nullptr;
+    for (const auto& record : batch)
+    {
+        // the other stream must be up to date before switching, for them to stay in order
+        if (last && last != record.stream) fflush(last);
+        last = record.stream;
+        const std::string text = format(record);
+        fwrite(text.data(), 1, text.size(), record.stream);
+    }
+    if (last) fflush(last);
+
+    if (!progress.empty())
+    {
+        fputs(progress.c_str(), stdout);
+        fflush(stdout);
+        progress_shown = !json_output && progress != "\r\033[K";
+    }
+}
+
+void run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        // gather what comes in during a short while, unless asked for it right away
+        wake.wait_for(lock, std::chrono::milliseconds(100), []{ return stopping || flush_requested || queue.size() >= 1024; });
+
+        std::vector<Record> batch;
+        batch.swap(queue);
+        const size_t target = queued;
+        flush_requested = false;
+
+        std::string progress;
+        if (progress_changed && progressVisible())
+        {
+            if (!json_output || secondsSince(progress_json_time) >= 1 || progress_task.empty())
+            {
+                if (!progress_task.empty()) progress = progressLine();
+                else if (progress_shown) progress = "\r\033[K";
+                progress_json_time = Clock::now();
+                progress_changed = false;
+            }
+        }
+
+        lock.unlock();
+        writeBatch(batch, progress);
+        lock.lock();
+
+        written = target;
+        drained.notify_all();
+        if (stopping && queue.empty()) break;
+    }
+}
+
+void enqueue(FILE* stream, const char* kind, const std::string& text)
+{
+    Record record = { stream, kind, text, secondsSince(started) };
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running)
+    {
+        const std::string formatted = format(record);
+        fwrite(formatted.data(), 1, formatted.size(), stream);
+        if (stream != stdout) fflush(stream);
+        return;
+    }
+    queue.push_back(record);
+    queued++;
+    if (queue.size() >= 1024) wake.notify_one();
+}
+
+// std::cerr's buffer while the writer runs: queues every complete line
+class ErrorBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        if (c != EOF) append(static_cast<char>(c));
+        return c;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override
+    {
+        for (std::streamsize i=0; i<n; i++) append(s[i]);
+        return n;
+    }
+
+private:
+    void append(char c)
+    {
+        std::lock_guard<std::mutex> lock(line_mutex);
+        if (c != '\n')
+        {
+            line += c;
+            return;
+        }
+        // lines that only space out the output stay attached to the next one
+        if (line.find_first_not_of('\n') == std::string::npos)
+        {
+            line += c;
+            return;
+        }
+        enqueue(stderr, line.find("WARNING") != std::string::npos ? "warning" : "error", line);
+        line.clear();
+    }
+
+    std::mutex line_mutex;
+    std::string line;
+};
+
+ErrorBuffer error_buffer;
+std::streambuf* original_error_buffer = nullptr;
+
+void stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        stopping = true;
+        if (!progress_task.empty())
+        {
+            progress_task.clear();
+            progress_changed = true;
+        }
+    }
+    wake.notify_one();
+    writer.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+    std::cerr.rdbuf(original_error_buffer);
+}
+
+}
+
+Level level(){ return current_level; }
+void level(Level level){ current_level = level; }
+bool json(){ return json_output; }
+void json(bool on){ json_output = on; }
+
+void start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+    std::cout.flush();
+    fflush(stdout);
+    running = true;
+    stopping = false;
+    original_error_buffer = std::cerr.rdbuf(&error_buffer);
+    writer = std::thread(run);
+    // exit() is how errors end a job, make sure everything gets out before
+    static bool registered = false;
+    if (!registered) atexit(stop);
+    registered = true;
+}
+
+void flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running) return;
+    const size_t target = queued;
+    flush_requested = true;
+    wake.notify_one();
+    drained.wait(lock, [target]{ return written >= target; });
+}
+
+Line::Line(Level level, const char* kind) : enabled(level <= current_level), kind(kind)
+{
+}
+
+Line::Line(Line&& other) : enabled(other.enabled), kind(other.kind), stream(std::move(other.stream))
+{
+    other.enabled = false;
+}
+
+Line::~Line()
+{
+    if (enabled) enqueue(stdout, kind, stream.str());
+}
+
+void progress(const std::string& task, size_t done, size_t total)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) return;
+    if (task != progress_task)
+    {
+        progress_task = task;
+        progress_started = Clock::now();
+    }
+    progress_done = done;
+    progress_total = total;
+    progress_changed = true;
+}
+
+void progressDone()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (progress_task.empty()) return;
+    progress_task.clear();
+    progress_changed = true;
+}
+
+}
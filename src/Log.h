@@ -0,0 +1,89 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _log_h_
+#define _log_h_
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+// Output of a job. Messages are queued and written in batches by a background thread once
+// 'start' was called, so printing never waits on the terminal. Everything written to std::cerr
+// goes through the same queue, keeping warnings and errors in order with the rest.
+namespace Log
+{
+
+enum Level
+{
+    QUIET,   // warnings and errors only
+    NORMAL,
+    VERBOSE  // also every command run
+};
+
+Level level();
+void level(Level level);
+
+// one JSON object per line instead of text
+bool json();
+void json(bool on);
+
+// starts the writer thread; until then messages are written right away
+void start();
+// returns once everything queued so far is written
+void flush();
+
+// collects one message, queued when it goes out of scope
+class Line
+{
+public:
+    Line(Level level, const char* kind);
+    Line(Line&& other);
+    ~Line();
+
+    template<typename T>
+    Line& operator<<(const T& value)
+    {
+        if (enabled) stream << value;
+        return *this;
+    }
+
+private:
+    bool enabled;
+    const char* kind;
+    std::ostringstream stream;
+};
+
+inline Line info(){ return Line(NORMAL, "info"); }
+inline Line verbose(){ return Line(VERBOSE, "verbose"); }
+
+// Progress of a long task, shown on a single line redrawn in place on terminals (and at
+// most once per second as JSON). Cheap enough to be called for every item.
+void progress(const std::string& task, size_t done, size_t total);
+// removes the progress line
+void progressDone();
+
+}
+
+#endif
@@ -0,0 +1,615 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "MachO.h"
+#include "Utils.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace MachO
+{
+
+namespace
+{
+
+uint32_t readBig32(const unsigned char* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint64_t readBig64(const unsigned char* p)
+{
+    return (uint64_t(readBig32(p)) << 32) | readBig32(p+4);
+}
+
+bool readAt(int fd, uint64_t offset, size_t size, std::string& out)
+{
+    out.resize(size);
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t amount = pread(fd, &out[done], size - done, offset + done);
+        if (amount <= 0) return false;
+        done += amount;
+    }
+    return true;
+}
+
+// string referenced by an lc_str at 'str_offset' within the load command at 'cmd_offset'
+std::string commandString(const std::string& header, const LoadCommand& lc, uint32_t str_offset)
+{
+    if (str_offset >= lc.size) return "";
+    const char* start = header.data() + lc.offset + str_offset;
+    return std::string(start, strnlen(start, lc.size - str_offset));
+}
+
+void writeBig32(std::string& out, uint32_t value)
+{
+    for (int shift=24; shift>=0; shift-=8) out += char((value >> shift) & 0xff);
+}
+
+void writeBig64(std::string& out, uint64_t value)
+{
+    writeBig32(out, value >> 32);
+    writeBig32(out, value & 0xffffffff);
+}
+
+bool parseHeader(Slice& slice)
+{
+    const std::string& header = slice.header;
+    slice.commands.clear();
+    slice.dylibs.clear();
+    slice.rpaths.clear();
+    slice.has_id = false;
+    slice.id = Dylib();
+    const uint32_t magic = read32(header, 0);
+    slice.is64 = magic == MH_MAGIC_64;
+    slice.cputype = read32(header, 4);
+    slice.cpusubtype = read32(header, 8);
+    slice.filetype = read32(header, 12);
+    const uint32_t ncmds = read32(header, 16);
+    slice.flags = read32(header, 24);
+
+    uint32_t offset = slice.is64 ? 32 : 28;
+    for (uint32_t n=0; n<ncmds; n++)
+    {
+        if (offset + 8 > header.size()) return false;
+        LoadCommand lc;
+        lc.cmd = read32(header, offset);
+        lc.size = read32(header, offset+4);
+        lc.offset = offset;
+        if (lc.size < 8 || offset + lc.size > header.size()) return false;
+        slice.commands.push_back(lc);
+
+        if ((isDylibCommand(lc.cmd) || lc.cmd == LC_ID_DYLIB) && lc.size >= 24)
+        {
+            Dylib dylib;
+            dylib.cmd = lc.cmd;
+            dylib.name = commandString(header, lc, read32(header, offset+8));
+            dylib.current_version = read32(header, offset+16);
+            dylib.compatibility_version = read32(header, offset+20);
+            if (lc.cmd == LC_ID_DYLIB)
+            {
+                slice.has_id = true;
+                slice.id = dylib;
+            }
+            else slice.dylibs.push_back(dylib);
+        }
+        else if (lc.cmd == LC_RPATH && lc.size >= 12)
+        {
+            slice.rpaths.push_back(commandString(header, lc, read32(header, offset+8)));
+        }
+        offset += lc.size;
+    }
+    return true;
+}
+
+// where the contents of the file start, i.e. how far load commands may grow
+uint32_t contentsOffset(const Slice& slice)
+{
+    uint32_t limit = slice.data.size();
+    for (const auto& lc : slice.commands)
+    {
+        if (lc.cmd != LC_SEGMENT && lc.cmd != LC_SEGMENT_64) continue;
+        const bool is64 = lc.cmd == LC_SEGMENT_64;
+        const uint32_t nsects = read32(slice.data, lc.offset + (is64 ? 64 : 48));
+        const uint64_t fileoff = is64 ? read64(slice.data, lc.offset + 40) : read32(slice.data, lc.offset + 32);
+        const uint64_t filesize = is64 ? read64(slice.data, lc.offset + 48) : read32(slice.data, lc.offset + 36);
+        if (fileoff > 0 && filesize > 0 && fileoff < limit) limit = fileoff;
+        for (uint32_t n=0; n<nsects; n++)
+        {
+            // offset field of section / section_64
+            const uint32_t section = lc.offset + (is64 ? 72 + n*80 + 48 : 56 + n*68 + 40);
+            const uint32_t offset = read32(slice.data, section);
+            if (offset > 0 && offset < limit) limit = offset;
+        }
+    }
+    return limit;
+}
+
+bool readSlice(int fd, Slice& slice)
+{
+    std::string start;
+    if (!readAt(fd, slice.offset, 32, start)) return false;
+    const uint32_t magic = read32(start, 0);
+    if (magic != MH_MAGIC && magic != MH_MAGIC_64) return false;
+
+    const uint32_t sizeofcmds = read32(start, 20);
+    const size_t header_size = (magic == MH_MAGIC_64 ? 32 : 28);
+    if (!readAt(fd, slice.offset, header_size + sizeofcmds, slice.header)) return false;
+    return parseHeader(slice);
+}
+
+}
+
+uint32_t read32(const std::string& data, size_t offset)
+{
+    uint32_t value;
+    memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+uint64_t read64(const std::string& data, size_t offset)
+{
+    uint64_t value;
+    memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+void write32(std::string& data, size_t offset, uint32_t value)
+{
+    memcpy(&data[offset], &value, sizeof(value));
+}
+
+void write64(std::string& data, size_t offset, uint64_t value)
+{
+    memcpy(&data[offset], &value, sizeof(value));
+}
+
+bool File::load(const std::string& path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    // in one read, as libraries can be hundreds of MB
+    const std::streamoff size = in.tellg();
+    if (size < 0) return false;
+    std::string data(size, '\0');
+    in.seekg(0);
+    if (!in.read(&data[0], size)) return false;
+    return parse(std::move(data));
+}
+
+bool File::parse(std::string data)
+{
+    slices.clear();
+    fat = false;
+    if (data.size() < 8) return false;
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    const uint32_t fat_magic = readBig32(bytes);
+    if (fat_magic == FAT_MAGIC || fat_magic == FAT_MAGIC_64)
+    {
+        fat = true;
+        const bool is64 = fat_magic == FAT_MAGIC_64;
+        const uint32_t nfat_arch = readBig32(bytes+4);
+        const size_t entry_size = is64 ? 32 : 20;
+        if (nfat_arch > 64 || 8 + nfat_arch*entry_size > data.size()) return false;
+        for (uint32_t n=0; n<nfat_arch; n++)
+        {
+            const unsigned char* entry = bytes + 8 + n*entry_size;
+            Slice slice;
+            slice.cputype = readBig32(entry);
+            slice.cpusubtype = readBig32(entry+4);
+            slice.offset = is64 ? readBig64(entry+8) : readBig32(entry+8);
+            slice.size = is64 ? readBig64(entry+16) : readBig32(entry+12);
+            slice.align = is64 ? readBig32(entry+24) : readBig32(entry+16);
+            if (slice.offset + slice.size > data.size()) return false;
+            slice.data = data.substr(slice.offset, slice.size);
+            slices.push_back(slice);
+        }
+    }
+    else
+    {
+        Slice slice;
+        slice.size = data.size();
+        slice.data.swap(data);
+        slices.push_back(slice);
+    }
+
+    for (size_t n=0; n<slices.size(); n++)
+    {
+        if (!reparse(n)) return false;
+    }
+    return true;
+}
+
+bool File::reparse(const size_t n)
+{
+    Slice& slice = slices[n];
+    slice.size = slice.data.size();
+    if (slice.data.size() < 28) return false;
+    const uint32_t magic = read32(slice.data, 0);
+    if (magic != MH_MAGIC && magic != MH_MAGIC_64) return false;
+
+    const size_t header_size = (magic == MH_MAGIC_64 ? 32 : 28);
+    const uint32_t sizeofcmds = read32(slice.data, 20);
+    if (header_size + sizeofcmds > slice.data.size()) return false;
+    slice.header = slice.data.substr(0, header_size + sizeofcmds);
+    return parseHeader(slice);
+}
+
+std::string File::serialize() const
+{
+    if (!fat) return slices.empty() ? std::string() : slices[0].data;
+
+    // lay out slices one after the other, each aligned as it requires
+    std::vector<uint64_t> offsets;
+    uint64_t offset = 8 + slices.size() * 20;
+    for (const auto& slice : slices)
+    {
+        const uint64_t alignment = uint64_t(1) << slice.align;
+        offset = (offset + alignment - 1) / alignment * alignment;
+        offsets.push_back(offset);
+        offset += slice.data.size();
+    }
+    const bool is64 = offset > 0xffffffffULL;
+    if (is64)
+    {
+        // the bigger header may push slices further, start over
+        offsets.clear();
+        offset = 8 + slices.size() * 32;
+        for (const auto& slice : slices)
+        {
+            const uint64_t alignment = uint64_t(1) << slice.align;
+            offset = (offset + alignment - 1) / alignment * alignment;
+            offsets.push_back(offset);
+            offset += slice.data.size();
+        }
+    }
+
+    std::string out;
+    writeBig32(out, is64 ? FAT_MAGIC_64 : FAT_MAGIC);
+    writeBig32(out, slices.size());
+    for (size_t n=0; n<slices.size(); n++)
+    {
+        writeBig32(out, slices[n].cputype);
+        writeBig32(out, slices[n].cpusubtype);
+        if (is64)
+        {
+            writeBig64(out, offsets[n]);
+            writeBig64(out, slices[n].data.size());
+            writeBig32(out, slices[n].align);
+            writeBig32(out, 0);
+        }
+        else
+        {
+            writeBig32(out, offsets[n]);
+            writeBig32(out, slices[n].data.size());
+            writeBig32(out, slices[n].align);
+        }
+    }
+    for (size_t n=0; n<slices.size(); n++)
+    {
+        out.resize(offsets[n], '\0');
+        out += slices[n].data;
+    }
+    return out;
+}
+
+bool File::save(const std::string& path) const
+{
+    struct stat st;
+    const mode_t mode = stat(path.c_str(), &st) == 0 ? (st.st_mode & 07777) : 0644;
+    return writeFileAtomically(path, serialize(), mode);
+}
+
+bool File::thin(uint32_t cputype)
+{
+    for (size_t n=0; n<slices.size(); n++)
+    {
+        if (slices[n].cputype != cputype) continue;
+        Slice kept = slices[n];
+        kept.offset = 0;
+        slices.assign(1, kept);
+        fat = false;
+        return true;
+    }
+    return false;
+}
+
+int findCommand(const Slice& slice, uint32_t cmd)
+{
+    for (size_t n=0; n<slice.commands.size(); n++)
+    {
+        if (slice.commands[n].cmd == cmd) return n;
+    }
+    return -1;
+}
+
+uint32_t headerSize(const Slice& slice)
+{
+    return slice.is64 ? 32 : 28;
+}
+
+void removeCommand(Slice& slice, size_t index)
+{
+    const LoadCommand lc = slice.commands[index];
+    const uint32_t end = headerSize(slice) + read32(slice.data, 20);
+
+    slice.data.erase(lc.offset, lc.size);
+    slice.data.insert(end - lc.size, lc.size, '\0');
+    write32(slice.data, 16, read32(slice.data, 16) - 1);
+    write32(slice.data, 20, read32(slice.data, 20) - lc.size);
+
+    slice.header = slice.data.substr(0, end - lc.size);
+    parseHeader(slice);
+}
+
+bool replaceCommandString(Slice& slice, size_t index, const std::string& value)
+{
+    const LoadCommand lc = slice.commands[index];
+    const uint32_t str_offset = read32(slice.data, lc.offset + 8);
+    const uint32_t alignment = slice.is64 ? 8 : 4;
+    const uint32_t new_size = (str_offset + value.size() + 1 + alignment - 1) / alignment * alignment;
+    const int64_t delta = int64_t(new_size) - int64_t(lc.size);
+    const uint32_t end = headerSize(slice) + read32(slice.data, 20);
+    if (int64_t(end) + delta > int64_t(contentsOffset(slice))) return false;
+
+    std::string command = slice.data.substr(lc.offset, str_offset) + value;
+    command.resize(new_size, '\0');
+    write32(command, 4, new_size);
+
+    // the commands after it move, taking from or giving back to the padding that follows them
+    slice.data.replace(lc.offset, lc.size, command);
+    if (delta > 0) slice.data.erase(end + delta, delta);
+    else if (delta < 0) slice.data.insert(end + delta, -delta, '\0');
+    write32(slice.data, 20, read32(slice.data, 20) + delta);
+
+    slice.header = slice.data.substr(0, end + delta);
+    return parseHeader(slice);
+}
+
+bool addCommand(Slice& slice, const std::string& command)
+{
+    const uint32_t end = headerSize(slice) + read32(slice.data, 20);
+    if (end + command.size() > contentsOffset(slice)) return false;
+
+    slice.data.replace(end, command.size(), command);
+    write32(slice.data, 16, read32(slice.data, 16) + 1);
+    write32(slice.data, 20, read32(slice.data, 20) + command.size());
+
+    slice.header = slice.data.substr(0, end + command.size());
+    return parseHeader(slice);
+}
+
+bool editCommandStrings(File& file, const StringEdit& edit, bool& matched, bool& changed, std::string& error)
+{
+    matched = false;
+    changed = false;
+    for (size_t n=0; n<file.sliceAmount(); n++)
+    {
+        Slice& slice = file.slice(n);
+        for (size_t c=0; c<slice.commands.size(); c++)
+        {
+            const LoadCommand lc = slice.commands[c];
+            if (!isDylibCommand(lc.cmd) && lc.cmd != LC_ID_DYLIB && lc.cmd != LC_RPATH) continue;
+            const std::string value = commandString(slice.data, lc, read32(slice.data, lc.offset + 8));
+            std::string new_value;
+            if (!edit(n, lc.cmd, value, new_value)) continue;
+            matched = true;
+            if (new_value == value) continue;
+            if (!replaceCommandString(slice, c, new_value))
+            {
+                error = "Not enough space in the header to change " + value + " to " + new_value;
+                return false;
+            }
+            changed = true;
+        }
+    }
+    return true;
+}
+
+StringEdit rpathEdit(const std::string& old_path, const std::string& new_path)
+{
+    // slices where the rpath was found already, shared by the copies of the edit
+    std::shared_ptr<std::set<size_t> > found(new std::set<size_t>());
+    return [=](size_t slice, uint32_t cmd, const std::string& value, std::string& new_value)
+    {
+        new_value = new_path;
+        return cmd == LC_RPATH && value == old_path && found->insert(slice).second;
+    };
+}
+
+void replaceLinkeditRange(Slice& slice, uint32_t offset, uint32_t size, const std::string& bytes)
+{
+    const int64_t delta = int64_t(bytes.size()) - int64_t(size);
+    const uint32_t old_end = offset + size;
+    const auto move = [&](size_t field)
+    {
+        const uint32_t value = read32(slice.data, field);
+        if (value >= old_end && value != 0) write32(slice.data, field, value + delta);
+    };
+
+    for (const auto& lc : slice.commands)
+    {
+        const uint32_t at = lc.offset;
+        switch (lc.cmd)
+        {
+            case LC_SYMTAB:
+                move(at+8);  // symoff
+                move(at+16); // stroff
+                break;
+            case LC_DYSYMTAB:
+                // tocoff, modtaboff, extrefsymoff, indirectsymoff, extreloff, locreloff
+                for (uint32_t field : { 32u, 40u, 48u, 56u, 64u, 72u }) move(at+field);
+                break;
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY:
+                // rebase, bind, weak bind, lazy bind and export offsets
+                for (uint32_t field : { 8u, 16u, 24u, 32u, 40u }) move(at+field);
+                break;
+            case LC_CODE_SIGNATURE:
+            case LC_SEGMENT_SPLIT_INFO:
+            case LC_FUNCTION_STARTS:
+            case LC_DATA_IN_CODE:
+            case LC_DYLIB_CODE_SIGN_DRS:
+            case LC_LINKER_OPTIMIZATION_HINT:
+            case LC_DYLD_EXPORTS_TRIE:
+            case LC_DYLD_CHAINED_FIXUPS:
+            case LC_ATOM_INFO:
+                move(at+8);  // dataoff
+                break;
+            case LC_SEGMENT_64:
+                if (strncmp(slice.data.data() + at+8, "__LINKEDIT", 16) == 0)
+                    write64(slice.data, at+48, read64(slice.data, at+48) + delta); // filesize
+                break;
+            case LC_SEGMENT:
+                if (strncmp(slice.data.data() + at+8, "__LINKEDIT", 16) == 0)
+                    write32(slice.data, at+36, read32(slice.data, at+36) + delta); // filesize
+                break;
+        }
+    }
+
+    slice.data.replace(offset, size, bytes);
+    slice.size = slice.data.size();
+    slice.header = slice.data.substr(0, slice.header.size());
+    parseHeader(slice);
+}
+
+bool isMagic(uint32_t magic)
+{
+    // thin files are little-endian on disk, fat headers are big-endian
+    return magic == MH_MAGIC || magic == MH_MAGIC_64 ||
+           readBig32(reinterpret_cast<const unsigned char*>(&magic)) == FAT_MAGIC ||
+           readBig32(reinterpret_cast<const unsigned char*>(&magic)) == FAT_MAGIC_64;
+}
+
+bool isMachO(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    uint32_t magic = 0;
+    bool is_macho = pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) && isMagic(magic);
+    close(fd);
+    return is_macho;
+}
+
+bool readHeaders(const std::string& path, std::vector<Slice>& slices)
+{
+    slices.clear();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    std::string start;
+    if (fstat(fd, &st) != 0 || !readAt(fd, 0, 8, start))
+    {
+        close(fd);
+        return false;
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(start.data());
+    const uint32_t fat_magic = readBig32(bytes);
+    if (fat_magic == FAT_MAGIC || fat_magic == FAT_MAGIC_64)
+    {
+        const bool is64 = fat_magic == FAT_MAGIC_64;
+        const uint32_t nfat_arch = readBig32(bytes+4);
+        const size_t entry_size = is64 ? 32 : 20;
+        std::string table;
+        if (nfat_arch > 64 || !readAt(fd, 8, nfat_arch * entry_size, table))
+        {
+            close(fd);
+            return false;
+        }
+        for (uint32_t n=0; n<nfat_arch; n++)
+        {
+            const unsigned char* entry = reinterpret_cast<const unsigned char*>(table.data()) + n*entry_size;
+            Slice slice;
+            slice.cputype = readBig32(entry);
+            slice.cpusubtype = readBig32(entry+4);
+            slice.offset = is64 ? readBig64(entry+8) : readBig32(entry+8);
+            slice.size = is64 ? readBig64(entry+16) : readBig32(entry+12);
+            slice.align = is64 ? readBig32(entry+24) : readBig32(entry+16);
+            // keep slices we can't parse (e.g. big-endian ones) so the architecture list stays complete
+            readSlice(fd, slice);
+            slices.push_back(slice);
+        }
+    }
+    else
+    {
+        Slice slice;
+        slice.size = st.st_size;
+        if (readSlice(fd, slice)) slices.push_back(slice);
+    }
+
+    close(fd);
+    return !slices.empty();
+}
+
+bool isDylibCommand(uint32_t cmd)
+{
+    return cmd == LC_LOAD_DYLIB || cmd == LC_LOAD_WEAK_DYLIB || cmd == LC_REEXPORT_DYLIB ||
+           cmd == LC_LAZY_LOAD_DYLIB || cmd == LC_LOAD_UPWARD_DYLIB;
+}
+
+std::string cpuTypeName(uint32_t cputype)
+{
+    switch (cputype)
+    {
+        case CPU_TYPE_X86: return "i386";
+        case CPU_TYPE_X86_64: return "x86_64";
+        case CPU_TYPE_ARM: return "arm";
+        case CPU_TYPE_ARM64: return "arm64";
+        case CPU_TYPE_POWERPC: return "ppc";
+        case CPU_TYPE_POWERPC64: return "ppc64";
+    }
+    return "cputype " + std::to_string(cputype);
+}
+
+uint32_t cpuTypeFromName(const std::string& name)
+{
+    if (name == "i386") return CPU_TYPE_X86;
+    if (name == "x86_64" || name == "x86_64h") return CPU_TYPE_X86_64;
+    if (name == "arm" || name.compare(0, 5, "armv7") == 0) return CPU_TYPE_ARM;
+    if (name == "arm64" || name == "arm64e") return CPU_TYPE_ARM64;
+    if (name == "ppc") return CPU_TYPE_POWERPC;
+    if (name == "ppc64") return CPU_TYPE_POWERPC64;
+    return 0;
+}
+
+std::string versionString(uint32_t version)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u", version >> 16, (version >> 8) & 0xff, version & 0xff);
+    return buffer;
+}
+
+}
@@ -0,0 +1,200 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _macho_h_
+#define _macho_h_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal native reader and editor for Mach-O and universal ("fat") files.
+// Definitions are our own so this builds on hosts without <mach-o/loader.h>.
+namespace MachO
+{
+
+const uint32_t MH_MAGIC = 0xfeedface;
+const uint32_t MH_MAGIC_64 = 0xfeedfacf;
+const uint32_t FAT_MAGIC = 0xcafebabe;
+const uint32_t FAT_MAGIC_64 = 0xcafebabf;
+
+const uint32_t MH_EXECUTE = 0x2;
+const uint32_t MH_DYLIB = 0x6;
+const uint32_t MH_BUNDLE = 0x8;
+const uint32_t MH_TWOLEVEL = 0x80;
+
+const uint32_t LC_REQ_DYLD = 0x80000000;
+const uint32_t LC_SEGMENT = 0x1;
+const uint32_t LC_SYMTAB = 0x2;
+const uint32_t LC_DYSYMTAB = 0xb;
+const uint32_t LC_LOAD_DYLIB = 0xc;
+const uint32_t LC_ID_DYLIB = 0xd;
+const uint32_t LC_LOAD_WEAK_DYLIB = 0x18 | LC_REQ_DYLD;
+const uint32_t LC_SEGMENT_64 = 0x19;
+const uint32_t LC_RPATH = 0x1c | LC_REQ_DYLD;
+const uint32_t LC_CODE_SIGNATURE = 0x1d;
+const uint32_t LC_REEXPORT_DYLIB = 0x1f | LC_REQ_DYLD;
+const uint32_t LC_LAZY_LOAD_DYLIB = 0x20;
+const uint32_t LC_SEGMENT_SPLIT_INFO = 0x1e;
+const uint32_t LC_DYLD_INFO = 0x22;
+const uint32_t LC_DYLD_INFO_ONLY = 0x22 | LC_REQ_DYLD;
+const uint32_t LC_LOAD_UPWARD_DYLIB = 0x23 | LC_REQ_DYLD;
+const uint32_t LC_FUNCTION_STARTS = 0x26;
+const uint32_t LC_DATA_IN_CODE = 0x29;
+const uint32_t LC_DYLIB_CODE_SIGN_DRS = 0x2b;
+const uint32_t LC_LINKER_OPTIMIZATION_HINT = 0x2e;
+const uint32_t LC_DYLD_EXPORTS_TRIE = 0x33 | LC_REQ_DYLD;
+const uint32_t LC_DYLD_CHAINED_FIXUPS = 0x34 | LC_REQ_DYLD;
+const uint32_t LC_ATOM_INFO = 0x36;
+
+const uint32_t CPU_ARCH_ABI64 = 0x01000000;
+const uint32_t CPU_TYPE_X86 = 7;
+const uint32_t CPU_TYPE_X86_64 = CPU_TYPE_X86 | CPU_ARCH_ABI64;
+const uint32_t CPU_TYPE_ARM = 12;
+const uint32_t CPU_TYPE_ARM64 = CPU_TYPE_ARM | CPU_ARCH_ABI64;
+const uint32_t CPU_TYPE_POWERPC = 18;
+const uint32_t CPU_TYPE_POWERPC64 = CPU_TYPE_POWERPC | CPU_ARCH_ABI64;
+
+struct LoadCommand
+{
+    uint32_t cmd;
+    uint32_t offset; // from the start of the slice
+    uint32_t size;
+};
+
+struct Dylib
+{
+    uint32_t cmd = 0;
+    std::string name;
+    uint32_t current_version = 0;
+    uint32_t compatibility_version = 0;
+};
+
+// one architecture of a file; a thin file has exactly one slice
+struct Slice
+{
+    uint32_t cputype = 0;
+    uint32_t cpusubtype = 0;
+    uint32_t filetype = 0;
+    uint32_t flags = 0;
+    bool is64 = false;
+    uint64_t offset = 0; // from the start of the file
+    uint64_t size = 0;
+    uint32_t align = 0;  // as a power of 2, only meaningful in fat files
+
+    std::string header;  // mach header followed by all load commands
+    std::string data;    // the whole slice, only filled by File
+    std::vector<LoadCommand> commands;
+    std::vector<Dylib> dylibs; // dependencies, in ordinal order
+    std::vector<std::string> rpaths;
+    bool has_id = false;
+    Dylib id;
+};
+
+// A whole file in memory, for analyses and edits that need more than the load commands.
+// Edits are made to the 'data' of a slice, followed by a call to 'reparse'.
+class File
+{
+public:
+    bool load(const std::string& path);
+    // the same, from the contents of a file
+    bool parse(std::string data);
+    // Writes all slices back, laying out the fat header again if there is one. The file is
+    // replaced, not modified in place, so other links to it are left alone.
+    bool save(const std::string& path) const;
+    std::string serialize() const;
+
+    bool isFat() const{ return fat; }
+    size_t sliceAmount() const{ return slices.size(); }
+    Slice& slice(const size_t n){ return slices[n]; }
+    const Slice& slice(const size_t n) const{ return slices[n]; }
+    void removeSlice(const size_t n){ slices.erase(slices.begin() + n); }
+    // keeps only the slice of the given architecture, as a thin file. false if there's none
+    bool thin(uint32_t cputype);
+    bool reparse(const size_t n);
+
+private:
+    bool fat = false;
+    std::vector<Slice> slices;
+};
+
+// true if 'magic' starts a Mach-O or fat file (read from its first 4 bytes)
+bool isMagic(uint32_t magic);
+// reads only the first bytes of 'path'
+bool isMachO(const std::string& path);
+
+// Reads the headers and load commands of every slice of 'path', without reading the
+// rest of the file. Returns false if the file can't be read or isn't Mach-O.
+bool readHeaders(const std::string& path, std::vector<Slice>& slices);
+
+bool isDylibCommand(uint32_t cmd);
+
+// index in slice.commands of the first command of type 'cmd', -1 if none
+int findCommand(const Slice& slice, uint32_t cmd);
+// size of the mach header, before the first load command
+uint32_t headerSize(const Slice& slice);
+// Removes the load command at 'index' from slice.data and reparses it.
+// The following commands move up, and the freed bytes become padding.
+void removeCommand(Slice& slice, size_t index);
+
+// Replaces the string of the dylib or rpath command at 'index' (its name or path), resizing the
+// command. Returns false if the load commands would no longer fit before the first section.
+bool replaceCommandString(Slice& slice, size_t index, const std::string& value);
+
+// Appends 'command' after the last load command, in the padding that follows them.
+// Returns false if it wouldn't fit before the first section.
+bool addCommand(Slice& slice, const std::string& command);
+
+// Calls 'edit' with the index of the slice, and the type and string of every dylib, id and rpath
+// command of every slice. When it returns true the command matched, and its string becomes what
+// 'edit' put in its last argument. 'matched' and 'changed' tell whether anything matched, and was
+// actually modified. Returns false, with 'error' telling what didn't fit, if a header has no room
+// for a new string.
+typedef std::function<bool(size_t slice, uint32_t cmd, const std::string& value, std::string& new_value)> StringEdit;
+bool editCommandStrings(File& file, const StringEdit& edit, bool& matched, bool& changed, std::string& error);
+
+// The edit changing rpath 'old_path' to 'new_path' like install_name_tool does: in every slice,
+// but only the first one of a slice that has it several times.
+StringEdit rpathEdit(const std::string& old_path, const std::string& new_path);
+
+// Replaces 'size' bytes at 'offset' in the __LINKEDIT of the slice with 'bytes', moving what
+// follows and updating every load command offset that points past it, and the segment size.
+// The size difference must keep later data aligned, i.e. be a multiple of 16.
+void replaceLinkeditRange(Slice& slice, uint32_t offset, uint32_t size, const std::string& bytes);
+
+// little-endian accessors for slice data
+uint32_t read32(const std::string& data, size_t offset);
+uint64_t read64(const std::string& data, size_t offset);
+void write32(std::string& data, size_t offset, uint32_t value);
+void write64(std::string& data, size_t offset, uint64_t value);
+
+std::string cpuTypeName(uint32_t cputype);
+// 0 if unknown
+uint32_t cpuTypeFromName(const std::string& name);
+std::string versionString(uint32_t version);
+
+}
+
+#endif
@@ -0,0 +1,161 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Materialize.h"
+#include "Archive.h"
+#include "CodeSign.h"
+#include "MachO.h"
+#include "Settings.h"
+#include "Sha256.h"
+#include "Store.h"
+#include "ToolBackend.h"
+#include "UnusedDependencies.h"
+#include "Utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sys/stat.h>
+
+namespace
+{
+
+void editStrings(MachO::File& file, const std::string& path, const MachO::StringEdit& edit, bool& matched)
+{
+    bool changed = false;
+    std::string error;
+    if (!MachO::editCommandStrings(file, edit, matched, changed, error))
+    {
+        std::cerr << "\n\nError : " << error << " in " << path << std::endl;
+        exit(1);
+    }
+}
+
+}
+
+void hashEdits(Sha256& hash, const FileEdits& edits, const std::string& to)
+{
+    const auto field = [&](const std::string& value)
+    {
+        hash.update(std::to_string(value.size()) + ":");
+        hash.update(value);
+    };
+    field(edits.id);
+    field(std::to_string(edits.unused.size()));
+    for (const auto& name : edits.unused) field(name);
+    field(std::to_string(edits.install_names.size()));
+    for (const auto& name : edits.install_names)
+    {
+        field(name.first);
+        field(name.second);
+    }
+    field(std::to_string(edits.rpaths.size()));
+    for (const auto& rpath : edits.rpaths) field(rpath);
+    field(Settings::inside_lib_path());
+    field(Settings::thinArch());
+    field(Settings::stripDebug() ? "strip" : "");
+    field(edits.sign ? "sign" : "");
+    field(CodeSign::identifierFor(to));
+    // the tools don't write the same bytes, e.g. codesign and our own signatures differ
+    field(Settings::toolBackend());
+}
+
+bool singleWrite()
+{
+    return Settings::toolBackend() == "native" && Settings::recordTrace().empty() && Settings::replayTrace().empty();
+}
+
+void materialize(const std::string& from, const std::string& to, const FileEdits& edits, const std::string& store_key)
+{
+    if( !Settings::canOverwriteFiles() && from != to && !Archive::replacesFiles() && tools().fileExists(to) )
+    {
+        std::cerr << "\n\nError : File " << to << " already exists. Remove it or enable overwriting." << std::endl;
+        exit(1);
+    }
+
+    MachO::File file;
+    if (!file.load(from))
+    {
+        std::cerr << "\n\nError : Cannot read " << from << " as a Mach-O file" << std::endl;
+        exit(1);
+    }
+    // taken before anything changes, so that signing only hashes again the pages that did
+    const CodeSign::Snapshot before = edits.sign ? CodeSign::snapshot(file) : CodeSign::Snapshot();
+    trimFile(from, file);
+
+    bool matched = false;
+    if (!edits.id.empty())
+    {
+        editStrings(file, to, [&](size_t, uint32_t cmd, const std::string&, std::string& new_value)
+        {
+            new_value = edits.id;
+            return cmd == MachO::LC_ID_DYLIB;
+        }, matched);
+        if (!matched)
+        {
+            std::cerr << "\n\nError : An error occured while trying to change identity of library " << to << std::endl;
+            exit(1);
+        }
+    }
+
+    removeDependencies(file, edits.unused);
+
+    for (const auto& name : edits.install_names)
+    {
+        editStrings(file, to, [&](size_t, uint32_t cmd, const std::string& value, std::string& new_value)
+        {
+            new_value = name.second;
+            return MachO::isDylibCommand(cmd) && value == name.first;
+        }, matched);
+    }
+
+    for (const auto& rpath : edits.rpaths)
+    {
+        editStrings(file, to, MachO::rpathEdit(rpath, Settings::inside_lib_path()), matched);
+        if (!matched)
+        {
+            std::cerr << "\n\nError : An error occured while trying to fix dependencies of " << to << std::endl;
+        }
+    }
+
+    if (edits.sign && !CodeSign::adhocSign(file, CodeSign::identifierFor(to), before))
+    {
+        std::cerr << "  * Error : An error occurred while applying ad-hoc signature to " << to << std::endl;
+        if (tools().machine().find("arm") != std::string::npos) exit(1);
+    }
+
+    struct stat st;
+    const mode_t mode = (stat(from.c_str(), &st) == 0 ? (st.st_mode & 07777) : 0644) | S_IWUSR;
+    const std::string contents = file.serialize();
+    if (!store_key.empty()) Store::put(store_key, contents, mode);
+    if (Archive::replacesFiles())
+    {
+        Archive::addFile(to, contents, mode);
+        return;
+    }
+    if (!writeFileAtomically(to, contents, mode))
+    {
+        std::cerr << "\n\nError : An error occured while trying to copy file " << from << " to " << to << std::endl;
+        exit(1);
+    }
+}
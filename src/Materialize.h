@@ -0,0 +1,67 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _materialize_h_
+#define _materialize_h_
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// What to change in a file as it's written to the bundle, applied in this order
+struct FileEdits
+{
+    std::string id;                  // new install name of a library, empty to keep it
+    std::set<std::string> unused;    // dependencies to remove
+    std::vector<std::pair<std::string, std::string> > install_names; // dependency names to change, old then new
+    std::vector<std::string> rpaths; // rpaths to point to the install path
+    bool sign = false;
+};
+
+inline bool operator==(const FileEdits& a, const FileEdits& b)
+{
+    return a.id == b.id && a.unused == b.unused && a.install_names == b.install_names &&
+           a.rpaths == b.rpaths && a.sign == b.sign;
+}
+inline bool operator!=(const FileEdits& a, const FileEdits& b){ return !(a == b); }
+
+class Sha256;
+
+// Adds to 'hash' what decides, along with the original file, what writing it to 'to' with 'edits'
+// gives: the edits and the settings that change the result. Every field is prefixed with its
+// length, so no two different inputs hash the same text.
+void hashEdits(Sha256& hash, const FileEdits& edits, const std::string& to);
+
+// Whether files are written to the bundle in a single write instead of being copied, then
+// edited and signed in place. It takes the native tools, as nothing is run.
+bool singleWrite();
+
+// Reads 'from' once, trims it as requested, makes 'edits' and an ad-hoc signature in memory,
+// and writes the result once, to a temporary file renamed to 'to' when complete. 'to' may be
+// 'from'. With --archive, the result goes to the archive instead. It's added to the store
+// under 'store_key' unless that's empty. Exits on error, like copyFile.
+void materialize(const std::string& from, const std::string& to, const FileEdits& edits, const std::string& store_key);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Parallel.h"
+#include "Jobserver.h"
+#include "Settings.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+
+size_t threadAmount(size_t work_amount)
+{
+    size_t threads = Settings::jobs();
+    if (threads > work_amount) threads = work_amount;
+    if (threads < 1) threads = 1;
+    return threads;
+}
+
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)>& task)
+{
+    std::atomic<size_t> next(0);
+    const auto worker = [&]()
+    {
+        for (size_t n = next++; n < count; n = next++)
+        {
+            Jobserver::Token token;
+            task(n);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const size_t thread_amount = threadAmount(count);
+    for (size_t n=1; n<thread_amount; n++) threads.push_back(std::thread(worker));
+    worker();
+    for (auto& thread : threads) thread.join();
+}
+
+void parallelWalk(const std::vector<std::string>& roots,
+                  const std::function<void(const std::string&, std::vector<std::string>&)>& visit)
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::string> pending(roots.begin(), roots.end());
+    size_t busy = 0;
+
+    const auto worker = [&]()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            // done once nothing is queued and nobody can queue more
+            changed.wait(lock, [&]{ return !pending.empty() || busy == 0; });
+            if (pending.empty()) break;
+
+            std::string item = pending.front();
+            pending.pop_front();
+            busy++;
+            lock.unlock();
+
+            std::vector<std::string> children;
+            {
+                Jobserver::Token token;
+                visit(item, children);
+            }
+
+            lock.lock();
+            busy--;
+            pending.insert(pending.end(), children.begin(), children.end());
+            changed.notify_all();
+        }
+        changed.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    const size_t thread_amount = threadAmount(Settings::jobs());
+    for (size_t n=1; n<thread_amount; n++) threads.push_back(std::thread(worker));
+    worker();
+    for (auto& thread : threads) thread.join();
+}
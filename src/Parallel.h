@@ -0,0 +1,42 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _parallel_h_
+#define _parallel_h_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// runs task(0) ... task(count-1) on up to Settings::jobs() threads, returns when all are done.
+// Like every task run in parallel, each one takes a token from the jobserver.
+void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+// Walks a tree in parallel, starting from 'roots'. 'visit' is called once per item,
+// from any thread, and appends the item's children to its second argument.
+void parallelWalk(const std::vector<std::string>& roots,
+                  const std::function<void(const std::string&, std::vector<std::string>&)>& visit);
+
+#endif
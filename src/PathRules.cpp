@@ -0,0 +1,195 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "PathRules.h"
+
+namespace PathRules
+{
+
+namespace
+{
+
+bool isGlobCharacter(char c)
+{
+    return c == '*' || c == '?' || c == '[';
+}
+
+// matches the character class starting at pattern[p] (just after '['), moving p past it
+bool matchClass(const std::string& pattern, size_t& p, char c)
+{
+    bool negate = p < pattern.size() && (pattern[p] == '!' || pattern[p] == '^');
+    if (negate) p++;
+    bool matched = false;
+    bool first = true;
+    while (p < pattern.size() && (first || pattern[p] != ']'))
+    {
+        first = false;
+        const char low = pattern[p];
+        if (p + 2 < pattern.size() && pattern[p+1] == '-' && pattern[p+2] != ']')
+        {
+            matched |= low <= c && c <= pattern[p+2];
+            p += 3;
+        }
+        else
+        {
+            matched |= low == c;
+            p++;
+        }
+    }
+    if (p < pattern.size()) p++; // ']'
+    return matched != negate;
+}
+
+bool globMatch(const std::string& pattern, size_t p, const std::string& text, size_t t)
+{
+    while (p < pattern.size())
+    {
+        const char c = pattern[p];
+        if (c == '*')
+        {
+            const bool any_depth = p + 1 < pattern.size() && pattern[p+1] == '*';
+            p += any_depth ? 2 : 1;
+            for (size_t end = t; ; end++)
+            {
+                if (globMatch(pattern, p, text, end)) return true;
+                if (end >= text.size() || (!any_depth && text[end] == '/')) return false;
+            }
+        }
+        if (t >= text.size()) return false;
+        if (c == '?')
+        {
+            if (text[t] == '/') return false;
+            p++;
+        }
+        else if (c == '[')
+        {
+            p++;
+            if (text[t] == '/' || !matchClass(pattern, p, text[t])) return false;
+        }
+        else
+        {
+            if (c != text[t]) return false;
+            p++;
+        }
+        t++;
+    }
+    return t == text.size();
+}
+
+}
+
+RuleSet::RuleSet() : nodes(1), rule_amount(0)
+{
+}
+
+void RuleSet::add(Action action, const std::string& pattern)
+{
+    size_t literal_end = 0;
+    while (literal_end < pattern.size() && !isGlobCharacter(pattern[literal_end])) literal_end++;
+
+    const std::string glob = pattern.substr(literal_end);
+    Tail tail = GLOB;
+    if (glob.empty()) tail = EXACT;
+    else if (glob == "**" && literal_end > 0 && pattern[literal_end-1] == '/') tail = RECURSIVE;
+    insert(pattern.substr(0, literal_end), action, tail, glob);
+}
+
+void RuleSet::addLiteral(Action action, const std::string& path)
+{
+    insert(path, action, EXACT, "");
+}
+
+void RuleSet::insert(const std::string& literal, Action action, Tail tail, const std::string& glob)
+{
+    Rule rule;
+    rule.action = action;
+    rule.tail = tail;
+    rule.glob = glob;
+    rule.order = rule_amount++;
+
+    size_t node = 0;
+    for (size_t n=0; n<literal.size(); n++)
+    {
+        std::map<char, size_t>::const_iterator child = nodes[node].children.find(literal[n]);
+        if (child != nodes[node].children.end())
+        {
+            node = child->second;
+            continue;
+        }
+        nodes[node].children[literal[n]] = nodes.size();
+        node = nodes.size();
+        nodes.push_back(Node());
+    }
+    nodes[node].rules.push_back(rule);
+}
+
+Action RuleSet::classify(const std::string& path) const
+{
+    Action action = BUNDLE;
+    bool matched = false;
+    size_t best = 0;
+
+    size_t node = 0;
+    for (size_t depth = 0; ; depth++)
+    {
+        for (const auto& rule : nodes[node].rules)
+        {
+            if (matched && rule.order < best) continue;
+            bool matches = false;
+            switch (rule.tail)
+            {
+                // a directory also matches the files right in it
+                case EXACT: matches = depth == path.size() ||
+                    (depth > 0 && path[depth-1] == '/' && path.find('/', depth) == std::string::npos); break;
+                case RECURSIVE: matches = true; break;
+                case GLOB: matches = globMatch(rule.glob, 0, path, depth); break;
+            }
+            if (!matches) continue;
+            matched = true;
+            best = rule.order;
+            action = rule.action;
+        }
+
+        if (depth == path.size()) break;
+        std::map<char, size_t>::const_iterator child = nodes[node].children.find(path[depth]);
+        if (child == nodes[node].children.end()) break;
+        node = child->second;
+    }
+    return action;
+}
+
+bool parse(const std::string& text, Action& action, std::string& pattern)
+{
+    const size_t colon = text.find(':');
+    if (colon == std::string::npos || colon + 1 == text.size()) return false;
+    const std::string name = text.substr(0, colon);
+    if (name == "include") action = BUNDLE;
+    else if (name == "exclude") action = IGNORE;
+    else if (name == "system") action = SYSTEM;
+    else return false;
+    pattern = text.substr(colon + 1);
+    return true;
+}
+
+}
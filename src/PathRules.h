@@ -0,0 +1,90 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _path_rules_h_
+#define _path_rules_h_
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Decides what to do with libraries from their path. Rules are compiled into a trie as they
+// are added, so classifying a path walks it once, whatever the amount of rules.
+namespace PathRules
+{
+
+enum Action
+{
+    BUNDLE, // "include"
+    IGNORE, // "exclude"
+    SYSTEM  // "system": left alone, and assumed present on every system
+};
+
+// Patterns are matched against whole paths: '*' matches within a path component, '**'
+// across components and '?' a single character, and [...] a character class. A pattern
+// ending in "/**" matches everything below that directory.
+class RuleSet
+{
+public:
+    RuleSet();
+    void add(Action action, const std::string& pattern);
+    // the same for a pattern without glob characters, even if 'path' contains some
+    void addLiteral(Action action, const std::string& path);
+    // action of the last rule matching 'path', BUNDLE if none does
+    Action classify(const std::string& path) const;
+
+private:
+    enum Tail
+    {
+        EXACT,     // the path must end with the literal part, or be a file in it if it's a directory
+        RECURSIVE, // anything may follow the literal part
+        GLOB       // what follows must match 'glob'
+    };
+
+    struct Rule
+    {
+        Action action;
+        Tail tail;
+        std::string glob;
+        size_t order;
+    };
+
+    struct Node
+    {
+        std::map<char, size_t> children;
+        std::vector<Rule> rules; // rules whose literal part ends here
+    };
+
+    void insert(const std::string& literal, Action action, Tail tail, const std::string& glob);
+
+    std::vector<Node> nodes;
+    size_t rule_amount;
+};
+
+// Parses "include:pattern", "exclude:pattern" or "system:pattern". Returns false if invalid.
+bool parse(const std::string& text, Action& action, std::string& pattern);
+
+}
+
+#endif
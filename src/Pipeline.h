@@ -0,0 +1,158 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _pipeline_h_
+#define _pipeline_h_
+
+#include "Jobserver.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A FIFO handing items from one stage to the next. push() blocks while it is full,
+// pop() blocks while it is empty and returns false once it is closed and drained.
+template<typename T>
+class BoundedQueue
+{
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<T> items;
+    const size_t capacity;
+    bool closed;
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+    void push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&]{ return items.size() < capacity; });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&]{ return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
+
+// Runs every pushed item through 'stages' in order. Each stage has its own threads, so
+// an item can be in one stage while the next item is in another. At most 'max_in_flight'
+// items are between push() and the end of the last stage; push() waits for room.
+template<typename T>
+class Pipeline
+{
+public:
+    typedef std::function<void(T&)> Stage;
+
+private:
+    std::vector<Stage> stages;
+    std::vector<std::unique_ptr<BoundedQueue<T> > > queues;
+    std::vector<std::vector<std::thread> > threads;
+    std::mutex mutex;
+    std::condition_variable has_room;
+    const size_t max_in_flight;
+    size_t in_flight;
+
+    void work(size_t stage)
+    {
+        T item;
+        while (queues[stage]->pop(item))
+        {
+            {
+                // not held while waiting for room in the next stage
+                Jobserver::Token token;
+                stages[stage](item);
+            }
+            if (stage+1 < stages.size())
+            {
+                queues[stage+1]->push(std::move(item));
+                continue;
+            }
+            item = T();
+            std::lock_guard<std::mutex> lock(mutex);
+            in_flight--;
+            has_room.notify_one();
+        }
+    }
+
+public:
+    Pipeline(const std::vector<Stage>& stages, size_t threads_per_stage, size_t max_in_flight)
+        : stages(stages), threads(stages.size()), max_in_flight(max_in_flight > 0 ? max_in_flight : 1), in_flight(0)
+    {
+        if (threads_per_stage < 1) threads_per_stage = 1;
+        for (size_t s=0; s<stages.size(); s++)
+        {
+            queues.emplace_back(new BoundedQueue<T>(this->max_in_flight));
+        }
+        for (size_t s=0; s<stages.size(); s++)
+        {
+            for (size_t t=0; t<threads_per_stage; t++) threads[s].emplace_back(&Pipeline::work, this, s);
+        }
+    }
+
+    ~Pipeline(){ finish(); }
+
+    void push(T item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            has_room.wait(lock, [&]{ return in_flight < max_in_flight; });
+            in_flight++;
+        }
+        queues[0]->push(std::move(item));
+    }
+
+    // waits until every pushed item went through all the stages, then stops the threads
+    void finish()
+    {
+        for (size_t s=0; s<stages.size(); s++)
+        {
+            queues[s]->close();
+            for (auto& thread : threads[s]) if (thread.joinable()) thread.join();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,319 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Reactor.h"
+#include "Interrupt.h"
+#include "Settings.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace Reactor
+{
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// a command, queued or running
+struct Command
+{
+    std::string line;
+    std::promise<Result> promise;
+    Result result;
+    int attempts = 0;
+
+    pid_t pid = -1;
+    int out = -1; // read ends of its stdout and stderr, -1 once closed
+    int err = -1;
+    bool exited = false;
+    int wait_status = 0;
+    bool killed = false;
+    Clock::time_point deadline;
+};
+
+std::mutex mutex;
+std::deque<std::unique_ptr<Command> > queued;
+pid_t owner = 0;   // process the reactor thread runs in, as it doesn't survive a fork
+int wake[2] = {-1, -1}; // written to when a command is queued or a child exits
+
+// Process groups of the running tools, where the signal handler finds them: they don't get
+// the signals of the terminal, being in groups of their own, and would outlive us otherwise.
+// Only the reactor thread changes them.
+const int MAX_GROUPS = 1024;
+std::atomic<pid_t> groups[MAX_GROUPS];
+
+void track(pid_t group, pid_t replaced)
+{
+    for (auto& slot : groups)
+    {
+        if (slot != replaced) continue;
+        slot = group;
+        return;
+    }
+}
+
+void killGroups()
+{
+    for (auto& slot : groups)
+    {
+        const pid_t group = slot;
+        if (group > 0) kill(-group, SIGKILL);
+    }
+}
+
+void wakeUp()
+{
+    const int saved = errno;
+    const char byte = 0;
+    // the pipe is non-blocking: if it's full, the reactor is about to wake up anyway
+    if (write(wake[1], &byte, 1) < 0) {}
+    errno = saved;
+}
+
+void childExited(int)
+{
+    wakeUp();
+}
+
+// a pipe that isn't inherited, so a child only holds the ends given to it, and others
+// see end of file as soon as it exits
+bool makePipe(int fds[2])
+{
+#ifdef __linux
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+void closeFd(int& fd)
+{
+    if (fd >= 0) close(fd);
+    fd = -1;
+}
+
+// starts 'command', returns false with the reason in its errors if it can't
+bool start(Command& command)
+{
+    command.result = Result();
+    command.exited = false;
+    command.killed = false;
+    command.attempts++;
+
+    int out[2];
+    int err[2];
+    if (!makePipe(out)) return false;
+    if (!makePipe(err))
+    {
+        close(out[0]);
+        close(out[1]);
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, err[1], 2);
+
+    // in a process group of its own, so whatever it starts is killed with it on timeout
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+
+    const char* argv[] = { "/bin/sh", "-c", command.line.c_str(), NULL };
+    const int error = posix_spawn(&command.pid, "/bin/sh", &actions, &attributes, const_cast<char**>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    close(out[1]);
+    close(err[1]);
+    if (error != 0)
+    {
+        close(out[0]);
+        close(err[0]);
+        command.result.errors = "An error occured while executing command " + command.line + " : " + strerror(error) + "\n";
+        return false;
+    }
+    track(command.pid, 0);
+    command.out = out[0];
+    command.err = err[0];
+    const int timeout = Settings::toolTimeout();
+    command.deadline = Clock::now() + std::chrono::seconds(timeout > 0 ? timeout : 0);
+    return true;
+}
+
+// reads what's available on 'fd', closing it at the end
+void drain(int& fd, std::string& into)
+{
+    char buffer[1 << 16];
+    const ssize_t amount = read(fd, buffer, sizeof(buffer));
+    if (amount > 0) into.append(buffer, amount);
+    else if (amount == 0 || (errno != EINTR && errno != EAGAIN)) closeFd(fd);
+}
+
+void loop()
+{
+    std::vector<std::unique_ptr<Command> > running;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!queued.empty() && running.size() < size_t(Settings::jobs()))
+            {
+                std::unique_ptr<Command> command = std::move(queued.front());
+                queued.pop_front();
+                if (start(*command)) running.push_back(std::move(command));
+                else command->promise.set_value(command->result);
+            }
+        }
+
+        // wake up at the next deadline, and at least every second in case a SIGCHLD was missed
+        int timeout_ms = 1000;
+        std::vector<pollfd> fds(1, pollfd{ wake[0], POLLIN, 0 });
+        for (const auto& command : running)
+        {
+            if (command->out >= 0) fds.push_back(pollfd{ command->out, POLLIN, 0 });
+            if (command->err >= 0) fds.push_back(pollfd{ command->err, POLLIN, 0 });
+            if (Settings::toolTimeout() > 0 && !command->killed)
+            {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(command->deadline - Clock::now()).count();
+                if (left < timeout_ms) timeout_ms = left > 0 ? int(left) : 0;
+            }
+        }
+        if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR) continue;
+
+        char bytes[64];
+        while (read(wake[0], bytes, sizeof(bytes)) > 0) {}
+        for (size_t n = 1; n < fds.size(); n++)
+        {
+            if (fds[n].revents == 0) continue;
+            for (const auto& command : running)
+            {
+                if (command->out == fds[n].fd) drain(command->out, command->result.output);
+                else if (command->err == fds[n].fd) drain(command->err, command->result.errors);
+            }
+        }
+
+        const auto now = Clock::now();
+        for (size_t n = 0; n < running.size(); )
+        {
+            Command& command = *running[n];
+            if (!command.exited && waitpid(command.pid, &command.wait_status, WNOHANG) == command.pid)
+            {
+                command.exited = true;
+                track(0, command.pid);
+            }
+            if (!command.exited && !command.killed && Settings::toolTimeout() > 0 && now >= command.deadline)
+            {
+                kill(-command.pid, SIGKILL);
+                command.killed = true;
+            }
+            // done once it exited and everything it wrote was read
+            if (!command.exited || command.out >= 0 || command.err >= 0)
+            {
+                n++;
+                continue;
+            }
+
+            if (command.killed && command.attempts <= Settings::toolRetries())
+            {
+                std::cerr << "\n/!\\ WARNING : " << command.line << " was still running after " << Settings::toolTimeout() << " s, running it again" << std::endl;
+                if (start(command))
+                {
+                    n++;
+                    continue;
+                }
+            }
+            else if (command.killed)
+            {
+                std::cerr << "\n/!\\ WARNING : " << command.line << " was still running after " << Settings::toolTimeout() << " s, giving up" << std::endl;
+                command.result.timed_out = true;
+            }
+            else if (WIFEXITED(command.wait_status)) command.result.status = WEXITSTATUS(command.wait_status);
+            command.promise.set_value(command.result);
+            running.erase(running.begin() + n);
+        }
+    }
+}
+
+}
+
+std::future<Result> run(const std::string& line)
+{
+    std::unique_ptr<Command> command(new Command());
+    command->line = line;
+    std::future<Result> result = command->promise.get_future();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (owner != getpid())
+    {
+        // first command of this process
+        owner = getpid();
+        queued.clear();
+        if (!makePipe(wake))
+        {
+            std::cerr << "\n\nError : Cannot run external tools : " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        for (int fd : wake) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = childExited;
+        action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGCHLD, &action, NULL);
+        static bool registered = false;
+        if (!registered) Interrupt::atStop(killGroups);
+        registered = true;
+        std::thread(loop).detach();
+    }
+    queued.push_back(std::move(command));
+    wakeUp();
+    return result;
+}
+
+}
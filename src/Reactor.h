@@ -0,0 +1,51 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _reactor_h_
+#define _reactor_h_
+
+#include <future>
+#include <string>
+
+// Runs the external tools. A single thread starts the commands, up to Settings::jobs() at a
+// time, collects their output as it comes with poll, and learns they exited from SIGCHLD,
+// so any amount of callers may wait on commands without a thread per command.
+namespace Reactor
+{
+
+struct Result
+{
+    int status = -1;        // exit code, -1 if it couldn't be started or was killed
+    std::string output;     // what it wrote to stdout
+    std::string errors;     // and to stderr
+    bool timed_out = false; // killed every time it was tried, for running longer than --tool-timeout
+};
+
+// Runs 'command' with /bin/sh once a slot is free. If it runs longer than --tool-timeout,
+// it is killed along with whatever it started, and run again up to --tool-retries times.
+std::future<Result> run(const std::string& command);
+
+}
+
+#endif
@@ -0,0 +1,319 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "SearchIndex.h"
+#include "MachO.h"
+#include "Parallel.h"
+#include "Settings.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace SearchIndex
+{
+
+namespace
+{
+
+const char* const SNAPSHOT_HEADER = "dylibbundler-search-index 1";
+
+struct DirectoryRecord
+{
+    int64_t mtime_sec = 0;
+    int64_t mtime_nsec = 0;
+    uint64_t ino = 0;
+    std::vector<std::string> files;
+    std::vector<std::string> subdirs;
+};
+
+bool built = false;
+std::map<std::string, DirectoryRecord> directories;
+std::map<std::string, std::vector<std::string> > files_by_name;
+
+// what a library needs from its dependency
+struct Requirements
+{
+    std::set<uint32_t> cputypes;
+    uint32_t compatibility_version = 0;
+};
+
+std::string joinPath(const std::string& dir, const std::string& name)
+{
+    if (!dir.empty() && dir[dir.size()-1] == '/') return dir + name;
+    return dir + "/" + name;
+}
+
+bool stampDirectory(const std::string& path, DirectoryRecord& record)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+    record.ino = st.st_ino;
+    record.mtime_sec = st.st_mtime;
+#ifdef __APPLE__
+    record.mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    record.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+void listDirectory(const std::string& path, DirectoryRecord& record)
+{
+    DIR* handle = opendir(path.c_str());
+    if (handle == NULL) return;
+    while (struct dirent* ent = readdir(handle))
+    {
+        const std::string name = ent->d_name;
+        if (name == "." || name == "..") continue;
+        // names that would break the line-based snapshot are of no interest anyway
+        if (name.find('\n') != std::string::npos) continue;
+
+        bool is_dir = false;
+#ifdef DT_DIR
+        if (ent->d_type != DT_UNKNOWN) is_dir = ent->d_type == DT_DIR;
+        else
+#endif
+        {
+            struct stat st;
+            is_dir = lstat(joinPath(path, name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        // symlinks, even to directories, are indexed as files and never followed
+        if (is_dir) record.subdirs.push_back(name);
+        else record.files.push_back(name);
+    }
+    closedir(handle);
+}
+
+std::string rootsLine()
+{
+    std::string line = "roots";
+    for (int n=0; n<Settings::searchRootAmount(); n++) line += " " + Settings::searchRoot(n);
+    return line;
+}
+
+void loadSnapshot(std::map<std::string, DirectoryRecord>& snapshot)
+{
+    std::ifstream in(Settings::searchIndexFile().c_str());
+    std::string line;
+    if (!std::getline(in, line) || line != SNAPSHOT_HEADER) return;
+    if (!std::getline(in, line) || line != rootsLine()) return;
+
+    DirectoryRecord* current = NULL;
+    while (std::getline(in, line))
+    {
+        if (line.size() < 2) return;
+        const std::string value = line.substr(2);
+        if (line[0] == 'D')
+        {
+            std::istringstream fields(value);
+            DirectoryRecord record;
+            std::string path;
+            fields >> record.mtime_sec >> record.mtime_nsec >> record.ino;
+            fields.get();
+            std::getline(fields, path);
+            current = &snapshot[path];
+            *current = record;
+        }
+        else if (current == NULL) return;
+        else if (line[0] == 'F') current->files.push_back(value);
+        else if (line[0] == 'S') current->subdirs.push_back(value);
+    }
+}
+
+void saveSnapshot()
+{
+    const std::string path = Settings::searchIndexFile();
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path.c_str());
+        out << SNAPSHOT_HEADER << "\n" << rootsLine() << "\n";
+        for (const auto& dir : directories)
+        {
+            const DirectoryRecord& record = dir.second;
+            out << "D " << record.mtime_sec << " " << record.mtime_nsec << " " << record.ino << " " << dir.first << "\n";
+            for (const auto& file : record.files) out << "F " << file << "\n";
+            for (const auto& subdir : record.subdirs) out << "S " << subdir << "\n";
+        }
+        if (!out)
+        {
+            std::cerr << "\n/!\\ WARNING : could not save search index to " << path << std::endl;
+            return;
+        }
+    }
+    if (rename(temp_path.c_str(), path.c_str()) != 0)
+        std::cerr << "\n/!\\ WARNING : could not save search index to " << path << std::endl;
+}
+
+void build()
+{
+    built = true;
+
+    std::map<std::string, DirectoryRecord> snapshot;
+    if (!Settings::searchIndexFile().empty()) loadSnapshot(snapshot);
+
+    std::vector<std::string> roots;
+    for (int n=0; n<Settings::searchRootAmount(); n++) roots.push_back(Settings::searchRoot(n));
+
+    std::mutex mutex;
+    size_t relisted = 0;
+    parallelWalk(roots, [&](const std::string& path, std::vector<std::string>& children)
+    {
+        DirectoryRecord record;
+        if (!stampDirectory(path, record)) return;
+
+        // a directory's mtime changes whenever an entry is added, removed or renamed in it
+        std::map<std::string, DirectoryRecord>::const_iterator previous = snapshot.find(path);
+        const bool unchanged = previous != snapshot.end() && previous->second.ino == record.ino &&
+                               previous->second.mtime_sec == record.mtime_sec &&
+                               previous->second.mtime_nsec == record.mtime_nsec;
+        if (unchanged) record = previous->second;
+        else listDirectory(path, record);
+
+        for (const auto& subdir : record.subdirs) children.push_back(joinPath(path, subdir));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!unchanged) relisted++;
+        directories[path] = record;
+    });
+
+    for (const auto& dir : directories)
+    {
+        for (const auto& file : dir.second.files)
+            files_by_name[file].push_back(joinPath(dir.first, file));
+    }
+
+    if (!Settings::searchIndexFile().empty() && (relisted > 0 || snapshot.size() != directories.size()))
+        saveSnapshot();
+}
+
+Requirements requirementsOf(const std::string& name, const std::string& dependent_file)
+{
+    static std::map<std::string, std::vector<MachO::Slice> > dependents;
+    std::map<std::string, std::vector<MachO::Slice> >::iterator found = dependents.find(dependent_file);
+    if (found == dependents.end())
+    {
+        found = dependents.insert(std::make_pair(dependent_file, std::vector<MachO::Slice>())).first;
+        MachO::readHeaders(dependent_file, found->second);
+    }
+
+    Requirements requirements;
+    for (const auto& slice : found->second)
+    {
+        requirements.cputypes.insert(slice.cputype);
+        for (const auto& dylib : slice.dylibs)
+        {
+            const std::string& dep = dylib.name;
+            const bool same = dep == name ||
+                (dep.size() > name.size() && dep.compare(dep.size()-name.size(), name.size(), name) == 0 &&
+                 dep[dep.size()-name.size()-1] == '/');
+            if (same && dylib.compatibility_version > requirements.compatibility_version)
+                requirements.compatibility_version = dylib.compatibility_version;
+        }
+    }
+    return requirements;
+}
+
+struct Rank
+{
+    bool all_archs = false;
+    bool compatible = false;
+    size_t archs = 0;
+
+    bool operator<(const Rank& other) const
+    {
+        if (all_archs != other.all_archs) return other.all_archs;
+        if (compatible != other.compatible) return other.compatible;
+        return archs < other.archs;
+    }
+};
+
+Rank rank(const std::string& candidate, const Requirements& requirements)
+{
+    Rank result;
+    std::vector<MachO::Slice> slices;
+    if (!MachO::readHeaders(candidate, slices)) return result;
+
+    uint32_t current_version = 0;
+    for (const auto& slice : slices)
+    {
+        if (requirements.cputypes.count(slice.cputype)) result.archs++;
+        if (slice.has_id && slice.id.current_version > current_version) current_version = slice.id.current_version;
+    }
+    result.all_archs = result.archs >= requirements.cputypes.size();
+    result.compatible = current_version >= requirements.compatibility_version;
+    return result;
+}
+
+}
+
+std::string findDirectoryFor(const std::string& name, const std::string& dependent_file)
+{
+    if (Settings::searchRootAmount() == 0) return "";
+    if (!built) build();
+
+    const std::string basename = name.substr(name.rfind('/')+1);
+    std::map<std::string, std::vector<std::string> >::const_iterator found = files_by_name.find(basename);
+    if (found == files_by_name.end()) return "";
+
+    const Requirements requirements = requirementsOf(name, dependent_file);
+    std::string best;
+    Rank best_rank;
+    for (const auto& candidate : found->second)
+    {
+        // 'name' may have directories in it, e.g. when it comes from an @rpath
+        if (candidate.size() <= name.size() || candidate[candidate.size()-name.size()-1] != '/' ||
+            candidate.compare(candidate.size()-name.size(), name.size(), name) != 0) continue;
+
+        const Rank candidate_rank = rank(candidate, requirements);
+        // on ties, prefer the shallowest path, so results don't depend on listing order
+        const bool better = best.empty() || best_rank < candidate_rank ||
+            (!(candidate_rank < best_rank) && (candidate.size() < best.size() ||
+                                               (candidate.size() == best.size() && candidate < best)));
+        if (better)
+        {
+            best = candidate;
+            best_rank = candidate_rank;
+        }
+    }
+
+    if (best.empty()) return "";
+    if (!best_rank.all_archs || !best_rank.compatible)
+    {
+        std::cerr << "\n/!\\ WARNING : best match for " << name << " is " << best << ", but it";
+        if (!best_rank.all_archs) std::cerr << " lacks architectures needed by " << dependent_file;
+        else std::cerr << " is older than the version " << MachO::versionString(requirements.compatibility_version) << " required by " << dependent_file;
+        std::cerr << std::endl;
+    }
+    return best.substr(0, best.size() - name.size());
+}
+
+}
@@ -0,0 +1,45 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _search_index_h_
+#define _search_index_h_
+
+#include <string>
+
+// Index of every file below the search roots (--search-root), keyed by file name.
+// It is built in parallel the first time it's needed, and saved to
+// Settings::searchIndexFile() if set, so later runs only list again
+// the directories that were modified since.
+namespace SearchIndex
+{
+
+// Directory (ending with '/') of the best file below the search roots whose path ends with 'name',
+// for use by 'dependent_file'. Candidates are ranked by how well their architectures cover those of
+// 'dependent_file', and by whether their version satisfies the compatibility version it requires.
+// Returns an empty string if there is none.
+std::string findDirectoryFor(const std::string& name, const std::string& dependent_file);
+
+}
+
+#endif
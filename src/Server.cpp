@@ -0,0 +1,344 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Server.h"
+#include "Cache.h"
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+namespace
+{
+
+int cache_pipe = -1;
+
+bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// runs when a job process exits, however it exits
+void sendCacheToServer()
+{
+    if (cache_pipe < 0) return;
+    std::cout.flush();
+    std::cerr.flush();
+    const std::string entries = Cache::takeNewEntries();
+    writeAll(cache_pipe, entries.data(), entries.size());
+    close(cache_pipe);
+    cache_pipe = -1;
+}
+
+bool makeAddress(const std::string& socket_path, struct sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Error : socket path " << socket_path << " is too long" << std::endl;
+        return false;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+    return true;
+}
+
+// a connection, from the request to the job's exit code
+struct Job
+{
+    int connection;
+    std::vector<std::string> args;
+    std::string argument;   // being read
+    pid_t pid = -1;
+    int cache = -1;         // where the job sends what it added to the caches
+    std::string entries;
+    bool reaping = false;   // the job closed its end, and is exiting
+
+    explicit Job(int connection) : connection(connection), args(1, "dylibbundler"){}
+};
+
+// Reads what the client sent of its request, NUL-terminated arguments until an empty one.
+// Returns false if the client went away before the end.
+bool readRequest(Job& job, bool& complete)
+{
+    char buffer[4096];
+    ssize_t amount;
+    while ((amount = read(job.connection, buffer, sizeof(buffer))) < 0 && errno == EINTR) {}
+    if (amount <= 0) return false;
+    for (ssize_t n=0; n<amount && !complete; n++)
+    {
+        if (buffer[n] != '\0') job.argument += buffer[n];
+        else if (job.argument.empty()) complete = true;
+        else
+        {
+            job.args.push_back(job.argument);
+            job.argument.clear();
+        }
+    }
+    return true;
+}
+
+// forks the process running 'job', which talks to the client directly
+bool startJob(Job& job, int listener, const std::vector<Job>& others, JobFunction function)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        std::cerr << "Error : could not create pipe for job" << std::endl;
+        return false;
+    }
+    // not for the tools the job runs, which would keep it open after the job exits
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    std::cout.flush();
+    std::cerr.flush();
+    job.pid = fork();
+    if (job.pid < 0)
+    {
+        std::cerr << "Error : could not start job" << std::endl;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (job.pid == 0)
+    {
+        // never wait for user input, nor keep the connections of the other jobs open
+        close(listener);
+        for (const Job& other : others)
+        {
+            if (&other == &job) continue;
+            close(other.connection);
+            if (other.cache >= 0) close(other.cache);
+        }
+        close(fds[0]);
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) dup2(null_fd, 0);
+        dup2(job.connection, 1);
+        dup2(job.connection, 2);
+        close(job.connection);
+        signal(SIGPIPE, SIG_DFL);
+
+        cache_pipe = fds[1];
+        atexit(sendCacheToServer);
+
+        std::vector<char*> argv;
+        for (auto& arg : job.args) argv.push_back(&arg[0]);
+        argv.push_back(NULL);
+        exit(function(argv.size()-1, &argv[0]));
+    }
+
+    close(fds[1]);
+    job.cache = fds[0];
+    return true;
+}
+
+// Reads what the job sends to the caches. Once it's all there, the job is exiting, and what
+// it learned goes to the caches the next jobs start with.
+void readCacheEntries(Job& job)
+{
+    char buffer[65536];
+    ssize_t amount;
+    while ((amount = read(job.cache, buffer, sizeof(buffer))) < 0 && errno == EINTR) {}
+    if (amount > 0)
+    {
+        job.entries.append(buffer, amount);
+        return;
+    }
+    close(job.cache);
+    job.cache = -1;
+    Cache::merge(job.entries);
+    job.entries.clear();
+    job.reaping = true;
+}
+
+// Whether the job exited, in which case the client gets its exit code
+bool reap(Job& job)
+{
+    int status = 0;
+    pid_t reaped;
+    while ((reaped = waitpid(job.pid, &status, WNOHANG)) < 0 && errno == EINTR) {}
+    if (reaped == 0) return false;
+    const int exit_code = reaped < 0 ? 1 : WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    std::string trailer(1, '\0');
+    trailer += std::to_string(exit_code) + "\n";
+    writeAll(job.connection, trailer.data(), trailer.size());
+    std::cout << "* Job finished with exit code " << exit_code << std::endl;
+    return true;
+}
+
+}
+
+void runServer(const std::string& socket_path, size_t max_jobs, JobFunction function)
+{
+    struct sockaddr_un address;
+    if (!makeAddress(socket_path, address)) exit(1);
+
+    // a client that goes away must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        std::cerr << "Error : could not create socket" << std::endl;
+        exit(1);
+    }
+    unlink(socket_path.c_str());
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        std::cerr << "Error : could not listen on " << socket_path << " (" << strerror(errno) << ")" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "* Waiting for jobs on " << socket_path << ", running up to " << max_jobs << " at once" << std::endl;
+    // Jobs run in processes of their own, while this one waits on all of them, and on new
+    // connections as long as fewer than 'max_jobs' are running; the others wait to be accepted.
+    std::vector<Job> jobs;
+    while (true)
+    {
+        std::vector<struct pollfd> fds;
+        bool reaping = false;
+        for (const Job& job : jobs)
+        {
+            const int fd = job.pid < 0 ? job.connection : job.cache;
+            if (fd >= 0) fds.push_back({ fd, POLLIN, 0 });
+            reaping = reaping || job.reaping;
+        }
+        const bool accepting = jobs.size() < max_jobs;
+        if (accepting) fds.push_back({ listener, POLLIN, 0 });
+
+        // a job that closed its end exits right after, so it's only polled for a short while
+        if (poll(fds.data(), fds.size(), reaping ? 10 : -1) < 0 && errno != EINTR)
+        {
+            std::cerr << "Error : poll failed (" << strerror(errno) << ")" << std::endl;
+            break;
+        }
+
+        size_t polled = 0;
+        for (size_t n=0; n<jobs.size(); n++)
+        {
+            Job& job = jobs[n];
+            const bool ready = (job.pid >= 0 ? job.cache : job.connection) >= 0 && (fds[polled++].revents & (POLLIN | POLLHUP | POLLERR));
+            bool done = false;
+            if (job.pid < 0 && ready)
+            {
+                bool complete = false;
+                done = !readRequest(job, complete) || (complete && !startJob(job, listener, jobs, function));
+            }
+            else if (ready) readCacheEntries(job);
+            if (job.reaping) done = reap(job);
+            if (!done) continue;
+            close(job.connection);
+            jobs.erase(jobs.begin() + n--);
+        }
+
+        if (accepting && (fds.back().revents & POLLIN))
+        {
+            const int connection = accept(listener, NULL, NULL);
+            if (connection >= 0) jobs.push_back(Job(connection));
+            else if (errno != EINTR && errno != ECONNABORTED)
+            {
+                std::cerr << "Error : accept failed (" << strerror(errno) << ")" << std::endl;
+                break;
+            }
+        }
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+}
+
+int runClient(const std::string& socket_path, int argc, char* const argv[])
+{
+    struct sockaddr_un address;
+    if (!makeAddress(socket_path, address)) return 1;
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 || connect(connection, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        std::cerr << "Error : could not connect to " << socket_path << " (" << strerror(errno) << ")" << std::endl;
+        return 1;
+    }
+
+    std::string request;
+    for (int n=0; n<argc; n++)
+    {
+        request += argv[n];
+        request += '\0';
+    }
+    request += '\0';
+    if (!writeAll(connection, request.data(), request.size()))
+    {
+        std::cerr << "Error : could not send request to " << socket_path << std::endl;
+        return 1;
+    }
+
+    // relay output until the trailer
+    bool in_trailer = false;
+    std::string trailer;
+    char buffer[4096];
+    while (true)
+    {
+        ssize_t amount = read(connection, buffer, sizeof(buffer));
+        if (amount < 0 && errno == EINTR) continue;
+        if (amount <= 0) break;
+        for (ssize_t n=0; n<amount; n++)
+        {
+            if (in_trailer) trailer += buffer[n];
+            else if (buffer[n] == '\0') in_trailer = true;
+            else putchar(buffer[n]);
+        }
+        fflush(stdout);
+    }
+    close(connection);
+
+    if (!in_trailer)
+    {
+        std::cerr << "Error : server closed the connection before the job finished" << std::endl;
+        return 1;
+    }
+    return atoi(trailer.c_str());
+}
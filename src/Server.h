@@ -0,0 +1,45 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _server_h_
+#define _server_h_
+
+#include <cstddef>
+#include <string>
+
+typedef int (*JobFunction)(int argc, char* const argv[]);
+
+// Listens on the Unix domain socket 'socket_path' and runs one bundling job per
+// connection. A request is the job's command line arguments, each terminated by
+// a NUL byte, followed by an empty argument. The job's output is streamed back
+// as it is produced, followed by a NUL byte and the job's exit code.
+// Each job runs in a forked process so it starts from default settings, while
+// caches learned by a job are handed back to the server for the next ones.
+// Up to 'max_jobs' jobs run at once; further connections wait to be accepted.
+void runServer(const std::string& socket_path, size_t max_jobs, JobFunction job);
+
+// sends a request to a running server and relays its output, returns the job's exit code
+int runClient(const std::string& socket_path, int argc, char* const argv[]);
+
+#endif
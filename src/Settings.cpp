@@ -23,6 +23,10 @@ THE SOFTWARE.
  */
 
 #include "Settings.h"
+#include "PathRules.h"
+#include "Vfs.h"
+#include <set>
+#include <thread>
 #include <vector>
 
 namespace Settings
@@ -58,8 +62,16 @@ void destFolder(const std::string& path)
     if( dest_folder_str[ dest_folder_str.size()-1 ] != '/' ) dest_folder_str += "/";
 }
 
+// the same file given twice, or by several names, is only fixed once
+bool addedBefore(std::set<std::string>& added, const std::string& path)
+{
+    const std::string canonical = Vfs::realPath(path);
+    return !added.insert(canonical.empty() ? path : canonical).second;
+}
+
 std::vector<std::string> files;
-void addFileToFix(const std::string& path){ files.push_back(path); }
+std::set<std::string> files_added;
+void addFileToFix(const std::string& path){ if( !addedBefore(files_added, path) ) files.push_back(path); }
 int fileToFixAmount(){ return files.size(); }
 std::string fileToFix(const int n){ return files[n]; }
 
@@ -72,30 +84,42 @@ void inside_lib_path(const std::string& p)
     if( inside_path_str[ inside_path_str.size()-1 ] != '/' ) inside_path_str += "/";
 }
 
-std::vector<std::string> prefixes_to_ignore;
+PathRules::RuleSet systemRules()
+{
+    PathRules::RuleSet rules;
+    rules.add(PathRules::SYSTEM, "/usr/lib/**");
+    rules.add(PathRules::SYSTEM, "/System/Library/**");
+    return rules;
+}
+PathRules::RuleSet path_rules = systemRules();
+
+std::set<std::string> ignored_prefixes;
 void ignore_prefix(std::string prefix)
 {
     if( prefix[ prefix.size()-1 ] != '/' ) prefix += "/";
-    prefixes_to_ignore.push_back(prefix);
+    // compared to paths as they are written, so only the same spelling is the same prefix
+    if( !ignored_prefixes.insert(prefix).second ) return;
+    // only libraries right in this directory, and '*', '?' or '[' are part of its name
+    path_rules.addLiteral(PathRules::IGNORE, prefix);
 }
 
-bool isSystemLibrary(const std::string& prefix)
+bool addPathRule(const std::string& rule)
 {
-    if(prefix.find("/usr/lib/") == 0) return true;
-    if(prefix.find("/System/Library/") == 0) return true;
+    PathRules::Action action;
+    std::string pattern;
+    if( !PathRules::parse(rule, action, pattern) ) return false;
+    path_rules.add(action, pattern);
+    return true;
+}
 
-    return false;
+bool isSystemLibrary(const std::string& prefix)
+{
+    return path_rules.classify(prefix) == PathRules::SYSTEM;
 }
 
 bool isPrefixIgnored(const std::string& prefix)
 {
-    const int prefix_amount = prefixes_to_ignore.size();
-    for(int n=0; n<prefix_amount; n++)
-    {
-        if(prefix.compare(prefixes_to_ignore[n]) == 0) return true;
-    }
-
-    return false;
+    return path_rules.classify(prefix) == PathRules::IGNORE;
 }
 
 bool isPrefixBundled(const std::string& prefix)
@@ -109,8 +133,127 @@ bool isPrefixBundled(const std::string& prefix)
 }
 
 std::vector<std::string> searchPaths;
-void addSearchPath(const std::string& path){ searchPaths.push_back(path); }
+std::set<std::string> search_paths_added;
+void addSearchPath(const std::string& path)
+{
+    std::string search_path = path;
+    // fix path if needed so it ends with '/'
+    if( !search_path.empty() && search_path[ search_path.size()-1 ] != '/' ) search_path += "/";
+    if( addedBefore(search_paths_added, search_path) ) return;
+    searchPaths.push_back(search_path);
+}
 int searchPathAmount(){ return searchPaths.size(); }
 std::string searchPath(const int n){ return searchPaths[n]; }
 
+std::vector<std::string> searchRoots;
+void addSearchRoot(const std::string& path)
+{
+    std::string root = path;
+    // roots are kept without the trailing '/', except for '/' itself
+    while( root.size() > 1 && root[ root.size()-1 ] == '/' ) root.erase(root.size()-1);
+    searchRoots.push_back(root);
+}
+int searchRootAmount(){ return searchRoots.size(); }
+std::string searchRoot(const int n){ return searchRoots[n]; }
+
+std::string search_index_file_str = "";
+std::string searchIndexFile(){ return search_index_file_str; }
+void searchIndexFile(const std::string& path){ search_index_file_str = path; }
+
+bool prompt = true;
+bool canPrompt(){ return prompt; }
+void canPrompt(bool permission){ prompt = permission; }
+
+std::string thin_arch_str = "";
+std::string thinArch(){ return thin_arch_str; }
+void thinArch(const std::string& arch){ thin_arch_str = arch; }
+
+bool strip_debug = false;
+bool stripDebug(){ return strip_debug; }
+void stripDebug(bool on){ strip_debug = on; }
+
+bool report_unused = false;
+bool drop_unused = false;
+bool reportUnused(){ return report_unused; }
+void reportUnused(bool on){ report_unused = on; }
+bool dropUnused(){ return drop_unused; }
+void dropUnused(bool on){ drop_unused = on; }
+
+bool analyze_load_paths = false;
+bool optimize_load_paths = false;
+bool analyzeLoadPaths(){ return analyze_load_paths; }
+void analyzeLoadPaths(bool on){ analyze_load_paths = on; }
+bool optimizeLoadPaths(){ return optimize_load_paths; }
+void optimizeLoadPaths(bool on){ optimize_load_paths = on; }
+
+bool verify_bundle = false;
+std::string verify_report;
+bool verify(){ return verify_bundle; }
+void verify(bool on){ verify_bundle = on; }
+std::string verifyReport(){ return verify_report; }
+void verifyReport(const std::string& path){ verify_report = path; }
+bool keep_journal = true;
+bool journal(){ return keep_journal; }
+void journal(bool on){ keep_journal = on; }
+bool check_symbols = false;
+bool checkSymbols(){ return check_symbols; }
+void checkSymbols(bool on){ check_symbols = on; }
+std::string size_report;
+std::string sizeReport(){ return size_report; }
+void sizeReport(const std::string& path){ size_report = path; }
+
+std::string tool_backend = "external";
+std::string record_trace;
+std::string replay_trace;
+std::string toolBackend(){ return tool_backend; }
+void toolBackend(const std::string& name){ tool_backend = name; }
+std::string recordTrace(){ return record_trace; }
+void recordTrace(const std::string& path){ record_trace = path; }
+std::string replayTrace(){ return replay_trace; }
+void replayTrace(const std::string& path){ replay_trace = path; }
+
+std::string store_path;
+std::string store(){ return store_path; }
+void store(const std::string& path){ store_path = path; }
+unsigned long long store_size = 5ULL << 30;
+unsigned long long storeSize(){ return store_size; }
+void storeSize(unsigned long long bytes){ store_size = bytes; }
+
+bool watch_files = false;
+bool watch(){ return watch_files; }
+void watch(bool on){ watch_files = on; }
+
+int jobs_amount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+int jobs(){ return jobs_amount; }
+void jobs(int amount){ jobs_amount = amount > 0 ? amount : 1; }
+
+bool use_pipeline = false;
+bool pipeline(){ return use_pipeline; }
+void pipeline(bool on){ use_pipeline = on; }
+int max_in_flight = 0;
+int maxInFlight(){ return max_in_flight > 0 ? max_in_flight : 4*jobs(); }
+void maxInFlight(int amount){ max_in_flight = amount > 0 ? amount : 0; }
+
+int tool_timeout = 300;
+int toolTimeout(){ return tool_timeout; }
+void toolTimeout(int seconds){ tool_timeout = seconds > 0 ? seconds : 0; }
+int tool_retries = 1;
+int toolRetries(){ return tool_retries; }
+void toolRetries(int amount){ tool_retries = amount > 0 ? amount : 0; }
+
+std::string delta_from;
+std::string deltaFrom(){ return delta_from; }
+void deltaFrom(const std::string& path){ delta_from = path; }
+std::string delta_output = "delta";
+std::string deltaOutput(){ return delta_output; }
+void deltaOutput(const std::string& path){ delta_output = path; }
+
+std::string archive_path;
+std::string archive(){ return archive_path; }
+void archive(const std::string& path){ archive_path = path; }
+
+std::string stats_file;
+std::string statsFile(){ return stats_file; }
+void statsFile(const std::string& path){ stats_file = path; }
+
 }
@@ -30,10 +30,14 @@ THE SOFTWARE.
 namespace Settings
 {
 
+// These classify a library from its path, or the directory it is in, according to the
+// rules given with -i, --rule and --rules-file, and those for system locations.
 bool isSystemLibrary(const std::string& prefix);
 bool isPrefixBundled(const std::string& prefix);
 bool isPrefixIgnored(const std::string& prefix);
 void ignore_prefix(std::string prefix);
+// "include:pattern", "exclude:pattern" or "system:pattern". Returns false if invalid.
+bool addPathRule(const std::string& rule);
     
 bool canOverwriteFiles();
 void canOverwriteFiles(bool permission);
@@ -64,5 +68,106 @@ void addSearchPath(const std::string& path);
 int searchPathAmount();
 std::string searchPath(const int n);
 
+// directories searched recursively (through an index) for libraries that can't be found otherwise
+void addSearchRoot(const std::string& path);
+int searchRootAmount();
+std::string searchRoot(const int n);
+
+// file where the index of search roots is kept between runs, empty for none
+std::string searchIndexFile();
+void searchIndexFile(const std::string& path);
+
+// whether the user may be asked where a missing library is
+bool canPrompt();
+void canPrompt(bool permission);
+
+// architecture to keep in bundled libraries, empty to keep all of them
+std::string thinArch();
+void thinArch(const std::string& arch);
+
+// whether to remove debugging symbols from bundled libraries
+bool stripDebug();
+void stripDebug(bool on);
+
+// whether to report dependencies nothing is bound to, and to remove them
+bool reportUnused();
+void reportUnused(bool on);
+bool dropUnused();
+void dropUnused(bool on);
+
+// whether to report how many probes dyld needs to find dependencies, and to reduce them
+bool analyzeLoadPaths();
+void analyzeLoadPaths(bool on);
+bool optimizeLoadPaths();
+void optimizeLoadPaths(bool on);
+
+// whether to check the bundle once done, and where to write the report of it
+bool verify();
+void verify(bool on);
+std::string verifyReport();
+void verifyReport(const std::string& path);
+// keep a journal in the dest folder, for an interrupted run to be resumed
+bool journal();
+void journal(bool on);
+// check that the symbols imported from bundled libraries are exported by them
+bool checkSymbols();
+void checkSymbols(bool on);
+// where to write the size of each file of the bundle and of what it pulls in, - for the output
+std::string sizeReport();
+void sizeReport(const std::string& path);
+
+// how tools are run: "external" processes or "native" in-process code, and optionally
+// a trace file to record their results to, or to replay them from
+std::string toolBackend();
+void toolBackend(const std::string& name);
+std::string recordTrace();
+void recordTrace(const std::string& path);
+std::string replayTrace();
+void replayTrace(const std::string& path);
+
+// directory of the store shared between runs, empty if there's none, and how
+// big it may get, in bytes
+std::string store();
+void store(const std::string& path);
+unsigned long long storeSize();
+void storeSize(unsigned long long bytes);
+
+// whether to keep running and bundle again what changes
+bool watch();
+void watch(bool on);
+
+// amount of tasks that may run at the same time
+int jobs();
+void jobs(int amount);
+
+// whether files are copied, fixed and signed while the crawl goes on, and how many of them
+// may be in the pipeline at once (by default, four per job)
+bool pipeline();
+void pipeline(bool on);
+int maxInFlight();
+void maxInFlight(int amount);
+
+// how long an external tool may run before it's killed, in seconds (0 for no limit),
+// and how many times it's run again then
+int toolTimeout();
+void toolTimeout(int seconds);
+int toolRetries();
+void toolRetries(int amount);
+
+// dest folder of a previous bundle to write an update package from, empty if there's none,
+// and the directory it's written to
+std::string deltaFrom();
+void deltaFrom(const std::string& path);
+std::string deltaOutput();
+void deltaOutput(const std::string& path);
+
+// archive the bundled libraries and fixed files are written to, empty if there's none
+std::string archive();
+void archive(const std::string& path);
+
+// file the figures of the run are written to, empty if there's none
+std::string statsFile();
+void statsFile(const std::string& path);
+
 }
 #endif
@@ -0,0 +1,56 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _sha256_h_
+#define _sha256_h_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SHA-256 (FIPS 180-4), for code signatures and content hashes
+class Sha256
+{
+public:
+    Sha256();
+    void update(const void* data, size_t size);
+    void update(const std::string& data){ update(data.data(), data.size()); }
+    // the 32 bytes of the digest. The object can't be updated anymore afterwards
+    std::string finish();
+
+    static std::string digest(const void* data, size_t size);
+    static std::string digest(const std::string& data){ return digest(data.data(), data.size()); }
+    // lowercase hexadecimal form of a digest
+    static std::string hex(const std::string& digest);
+
+private:
+    void block(const unsigned char* data);
+
+    uint32_t state[8];
+    unsigned char buffer[64];
+    size_t buffered;
+    uint64_t length;
+};
+
+#endif
@@ -0,0 +1,346 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "SizeReport.h"
+#include "Log.h"
+#include "Settings.h"
+#include "Utils.h"
+#include "Verify.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+
+namespace
+{
+
+struct Cost
+{
+    uint64_t bytes = 0;
+    uint64_t load_commands = 0;
+
+    Cost& operator+=(const Cost& other)
+    {
+        bytes += other.bytes;
+        load_commands += other.load_commands;
+        return *this;
+    }
+};
+
+struct FileCosts
+{
+    std::string file;
+    const char* kind;  // fixed, direct (loaded by a fixed file), indirect or unused (loaded by none)
+    Cost exclusive;
+    Cost inclusive;
+    Cost retained;
+};
+
+// Calls 'visit' with the nodes reachable from 'start' that aren't marked yet, marking them, each
+// after those it leads to. Iterative, as chains of dependencies can be long.
+template <typename Visit>
+void depthFirst(const std::vector<std::vector<size_t> >& successors, size_t start, std::vector<char>& marked, Visit visit)
+{
+    if (marked[start]) return;
+    std::vector<std::pair<size_t, size_t> > stack(1, std::make_pair(start, size_t(0)));
+    marked[start] = 1;
+    while (!stack.empty())
+    {
+        const size_t node = stack.back().first;
+        const size_t next = stack.back().second++;
+        if (next == successors[node].size())
+        {
+            stack.pop_back();
+            visit(node);
+            continue;
+        }
+        const size_t successor = successors[node][next];
+        if (marked[successor]) continue;
+        marked[successor] = 1;
+        stack.push_back(std::make_pair(successor, size_t(0)));
+    }
+}
+
+// Immediate dominator of every node, the root being the last node, with the iterative algorithm
+// of Cooper, Harvey and Kennedy. Nodes are taken in reverse postorder, so on a graph without
+// cycles, as dependencies nearly always are, it's settled by the first pass.
+std::vector<size_t> dominators(const std::vector<std::vector<size_t> >& successors, std::vector<size_t>& postorder)
+{
+    const size_t root = successors.size() - 1;
+    std::vector<char> marked(successors.size(), 0);
+    depthFirst(successors, root, marked, [&](size_t node){ postorder.push_back(node); });
+
+    const size_t none = successors.size();
+    std::vector<size_t> number(successors.size(), none);
+    for (size_t n=0; n<postorder.size(); n++) number[postorder[n]] = n;
+    std::vector<std::vector<size_t> > predecessors(successors.size());
+    for (size_t node=0; node<successors.size(); node++)
+    {
+        if (number[node] == none) continue;
+        for (const size_t successor : successors[node]) predecessors[successor].push_back(node);
+    }
+
+    std::vector<size_t> dominator(successors.size(), none);
+    dominator[root] = root;
+    const auto intersect = [&](size_t a, size_t b)
+    {
+        while (a != b)
+        {
+            while (number[a] < number[b]) a = dominator[a];
+            while (number[b] < number[a]) b = dominator[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (size_t n=postorder.size()-1; n-- > 0; )
+        {
+            const size_t node = postorder[n];
+            size_t found = none;
+            for (const size_t predecessor : predecessors[node])
+            {
+                if (dominator[predecessor] == none) continue;
+                found = found == none ? predecessor : intersect(predecessor, found);
+            }
+            if (dominator[node] != found)
+            {
+                dominator[node] = found;
+                changed = true;
+            }
+        }
+    }
+    return dominator;
+}
+
+// Strongly connected components, with Tarjan's algorithm made iterative: component[node] is
+// numbered so that components only lead to components with smaller numbers.
+size_t components(const std::vector<std::vector<size_t> >& successors, std::vector<size_t>& component)
+{
+    const size_t none = successors.size();
+    std::vector<size_t> index(successors.size(), none), low(successors.size());
+    std::vector<char> on_stack(successors.size(), 0);
+    std::vector<size_t> stack;
+    std::vector<std::pair<size_t, size_t> > calls;
+    component.assign(successors.size(), none);
+    size_t counter = 0, amount = 0;
+    const auto enter = [&](size_t node)
+    {
+        index[node] = low[node] = counter++;
+        stack.push_back(node);
+        on_stack[node] = 1;
+        calls.push_back(std::make_pair(node, size_t(0)));
+    };
+    for (size_t start=0; start<successors.size(); start++)
+    {
+        if (index[start] != none) continue;
+        enter(start);
+        while (!calls.empty())
+        {
+            const size_t node = calls.back().first;
+            const size_t next = calls.back().second++;
+            if (next < successors[node].size())
+            {
+                const size_t successor = successors[node][next];
+                if (index[successor] == none) enter(successor);
+                else if (on_stack[successor]) low[node] = std::min(low[node], index[successor]);
+                continue;
+            }
+            calls.pop_back();
+            if (!calls.empty()) low[calls.back().first] = std::min(low[calls.back().first], low[node]);
+            if (low[node] != index[node]) continue;
+            size_t member;
+            do
+            {
+                member = stack.back();
+                stack.pop_back();
+                on_stack[member] = 0;
+                component[member] = amount;
+            } while (member != node);
+            amount++;
+        }
+    }
+    return amount;
+}
+
+std::vector<FileCosts> computeCosts(const BundleGraph& graph)
+{
+    const size_t amount = graph.files.size();
+    std::vector<FileCosts> costs(amount);
+    for (size_t n=0; n<amount; n++)
+    {
+        costs[n].file = graph.files[n];
+        costs[n].kind = n < graph.fixed_amount ? "fixed" : "unused";
+        struct stat st;
+        if (stat(graph.files[n].c_str(), &st) == 0) costs[n].exclusive.bytes = st.st_size;
+        costs[n].exclusive.load_commands = graph.load_commands[n];
+    }
+
+    // A root loads the fixed files, then the files they don't lead to: they're unused, but their
+    // retained costs still say what they hold alone
+    std::vector<std::vector<size_t> > successors = graph.dependencies;
+    successors.emplace_back();
+    std::vector<size_t>& roots = successors.back();
+    std::vector<char> marked(amount + 1, 0);
+    for (size_t n=0; n<graph.fixed_amount; n++)
+    {
+        roots.push_back(n);
+        depthFirst(successors, n, marked, [](size_t){});
+    }
+    for (size_t n=graph.fixed_amount; n<amount; n++)
+    {
+        if (marked[n]) costs[n].kind = "indirect";
+    }
+    for (size_t n=0; n<graph.fixed_amount; n++)
+    {
+        for (const size_t dependency : graph.dependencies[n])
+            if (dependency >= graph.fixed_amount) costs[dependency].kind = "direct";
+    }
+    for (size_t n=graph.fixed_amount; n<amount; n++)
+    {
+        if (marked[n]) continue;
+        roots.push_back(n);
+        depthFirst(successors, n, marked, [](size_t){});
+    }
+
+    // retained: a file's own cost and that of the files it dominates, children coming first
+    // in postorder
+    std::vector<size_t> postorder;
+    const std::vector<size_t> dominator = dominators(successors, postorder);
+    for (size_t n=0; n<amount; n++) costs[n].retained = costs[n].exclusive;
+    for (const size_t node : postorder)
+    {
+        if (node != amount && dominator[node] != amount) costs[dominator[node]].retained += costs[node].retained;
+    }
+
+    // inclusive: the files reachable from each component, as bit sets, built from the components
+    // it leads to, which come first. Unlike the rest this isn't linear, as the reachable sets of a
+    // DAG overlap and a sum can't be carried along its edges: it takes O(V*E/64) time and
+    // O(V*V/64) memory for V files and E dependencies, about 12 MB for 10000 libraries
+    std::vector<size_t> component;
+    const size_t component_amount = components(graph.dependencies, component);
+    std::vector<std::vector<size_t> > members(component_amount);
+    for (size_t n=0; n<amount; n++) members[component[n]].push_back(n);
+    const size_t words = (amount + 63) / 64;
+    std::vector<uint64_t> reachable(component_amount * words, 0);
+    for (size_t c=0; c<component_amount; c++)
+    {
+        uint64_t* bits = &reachable[c * words];
+        for (const size_t member : members[c])
+        {
+            bits[member / 64] |= uint64_t(1) << (member % 64);
+            for (const size_t dependency : graph.dependencies[member])
+            {
+                const size_t other = component[dependency];
+                if (other == c) continue;
+                const uint64_t* other_bits = &reachable[other * words];
+                for (size_t w=0; w<words; w++) bits[w] |= other_bits[w];
+            }
+        }
+        Cost inclusive;
+        for (size_t w=0; w<words; w++)
+        {
+            for (uint64_t word = bits[w]; word != 0; word &= word - 1)
+                inclusive += costs[w * 64 + __builtin_ctzll(word)].exclusive;
+        }
+        for (const size_t member : members[c]) costs[member].inclusive = inclusive;
+    }
+    return costs;
+}
+
+void writeTable(std::ostream& out, const std::vector<FileCosts>& costs, const Cost& total)
+{
+    out << std::setw(12) << "retained" << std::setw(12) << "inclusive" << std::setw(12) << "exclusive"
+        << std::setw(10) << "ret. cmds" << std::setw(10) << "inc. cmds" << std::setw(6) << "cmds"
+        << "  " << std::left << std::setw(9) << "kind" << std::right << "file\n";
+    for (const auto& cost : costs)
+    {
+        out << std::setw(12) << cost.retained.bytes << std::setw(12) << cost.inclusive.bytes << std::setw(12) << cost.exclusive.bytes
+            << std::setw(10) << cost.retained.load_commands << std::setw(10) << cost.inclusive.load_commands << std::setw(6) << cost.exclusive.load_commands
+            << "  " << std::left << std::setw(9) << cost.kind << std::right << cost.file << "\n";
+    }
+    out << costs.size() << " files, " << total.bytes << " bytes, " << total.load_commands << " load commands\n";
+}
+
+void writeJson(std::ostream& out, const std::vector<FileCosts>& costs, const Cost& total)
+{
+    out << "{\n  \"bytes\": " << total.bytes << ",\n  \"load_commands\": " << total.load_commands << ",\n  \"files\": [";
+    for (size_t n=0; n<costs.size(); n++)
+    {
+        const FileCosts& cost = costs[n];
+        out << (n ? ",\n" : "\n") << "    {\"file\": " << jsonString(cost.file) << ", \"kind\": " << jsonString(cost.kind)
+            << ", \"bytes\": " << cost.exclusive.bytes << ", \"inclusive_bytes\": " << cost.inclusive.bytes
+            << ", \"retained_bytes\": " << cost.retained.bytes << ", \"load_commands\": " << cost.exclusive.load_commands
+            << ", \"inclusive_load_commands\": " << cost.inclusive.load_commands
+            << ", \"retained_load_commands\": " << cost.retained.load_commands << "}";
+    }
+    out << (costs.empty() ? "]\n}\n" : "\n  ]\n}\n");
+}
+
+bool endsWith(const std::string& text, const std::string& end)
+{
+    return text.size() >= end.size() && text.compare(text.size() - end.size(), end.size(), end) == 0;
+}
+
+}
+
+void reportBundleSizes()
+{
+    Log::info() << "\n* Measuring bundle";
+    std::vector<FileCosts> costs = computeCosts(readBundleGraph());
+    Cost total;
+    for (const auto& cost : costs) total += cost.exclusive;
+    // what's worth removing first
+    std::stable_sort(costs.begin(), costs.end(), [](const FileCosts& a, const FileCosts& b)
+    {
+        return a.retained.bytes > b.retained.bytes;
+    });
+
+    const std::string report_path = Settings::sizeReport();
+    if (report_path == "-")
+    {
+        std::ostringstream table;
+        writeTable(table, costs, total);
+        std::istringstream lines(table.str());
+        for (std::string line; std::getline(lines, line); ) Log::info() << "  " << line;
+        return;
+    }
+
+    std::ofstream out(report_path.c_str(), std::ios::trunc);
+    if (endsWith(report_path, ".json")) writeJson(out, costs, total);
+    else writeTable(out, costs, total);
+    if (!out)
+    {
+        std::cerr << "\n\nError : Cannot write size report to " << report_path << std::endl;
+        exit(1);
+    }
+    Log::info() << "  " << costs.size() << " files, " << total.bytes << " bytes, size report written to " << report_path;
+}
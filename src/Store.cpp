@@ -0,0 +1,305 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Store.h"
+#include "Archive.h"
+#include "Log.h"
+#include "Materialize.h"
+#include "Settings.h"
+#include "Sha256.h"
+#include "Utils.h"
+#include "Vfs.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <tuple>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace Store
+{
+
+namespace
+{
+
+std::atomic<size_t> hits(0);
+std::atomic<size_t> misses(0);
+std::atomic<size_t> temp_counter(0);
+
+void createDirectories(const std::string& path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+    {
+        mkdir(path.substr(0, slash).c_str(), 0777);
+        if (slash == std::string::npos) break;
+    }
+}
+
+// Held while reading or adding entries (shared), or removing them (exclusive). flock locks
+// belong to the open file, so threads of this process exclude each other too.
+class Lock
+{
+    int fd;
+public:
+    explicit Lock(int operation)
+    {
+        createDirectories(Settings::store());
+        fd = open((Settings::store() + "/lock").c_str(), O_RDWR | O_CREAT, 0666);
+        if (fd >= 0) while (flock(fd, operation) != 0 && errno == EINTR) {}
+    }
+    ~Lock(){ if (fd >= 0) close(fd); }
+};
+
+std::string entryPath(const std::string& key)
+{
+    return Settings::store() + "/" + key.substr(0, 2) + "/" + key;
+}
+
+bool readFile(const std::string& path, std::string& contents)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) return false;
+    contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool hashFile(const std::string& path, std::string& hex)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) return false;
+    Sha256 hash;
+    char buffer[1 << 16];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) hash.update(buffer, in.gcount());
+    hex = Sha256::hex(hash.finish());
+    return true;
+}
+
+// a copy-on-write clone of 'from', on file systems that have them
+bool cloneFile(const std::string& from, const std::string& to)
+{
+#if defined(__APPLE__)
+    return clonefile(from.c_str(), to.c_str(), 0) == 0;
+#elif defined(__linux__) && defined(FICLONE)
+    const int in = open(from.c_str(), O_RDONLY);
+    if (in < 0) return false;
+    struct stat st;
+    const int out = fstat(in, &st) == 0 ? open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 07777) : -1;
+    const bool cloned = out >= 0 && ioctl(out, FICLONE, in) == 0;
+    if (out >= 0) close(out);
+    close(in);
+    if (!cloned && out >= 0) unlink(to.c_str());
+    return cloned;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
+
+// Puts 'entry' at 'to', or in the archive when files only go there
+bool place(const std::string& entry, const std::string& to)
+{
+    std::string contents;
+    struct stat st;
+    if (Archive::replacesFiles())
+    {
+        if (stat(entry.c_str(), &st) != 0 || !readFile(entry, contents)) return false;
+        Archive::addFile(to, contents, st.st_mode & 07777);
+        return true;
+    }
+
+    // next to 'to', so the rename is atomic
+    const std::string temp = to + ".store-" + std::to_string(getpid()) + "-" + std::to_string(temp_counter++);
+    unlink(temp.c_str());
+    if (cloneFile(entry, temp) || link(entry.c_str(), temp.c_str()) == 0)
+    {
+        if (rename(temp.c_str(), to.c_str()) == 0)
+        {
+            Vfs::changed();
+            return true;
+        }
+        unlink(temp.c_str());
+        return false;
+    }
+    // another file system, or no links allowed: copy it
+    return stat(entry.c_str(), &st) == 0 && readFile(entry, contents) &&
+           writeFileAtomically(to, contents, st.st_mode & 07777);
+}
+
+void removeEntry(const std::string& entry)
+{
+    unlink(entry.c_str());
+    unlink((entry + ".sha256").c_str());
+}
+
+}
+
+bool enabled()
+{
+    return !Settings::store().empty();
+}
+
+std::string key(const std::string& contents, const FileEdits& edits, const std::string& to)
+{
+    // every field is prefixed with its length, so no two different inputs hash the same text
+    Sha256 hash;
+    const auto field = [&](const std::string& value)
+    {
+        hash.update(std::to_string(value.size()) + ":");
+        hash.update(value);
+    };
+    field("dylibbundler store 1");
+    field(Sha256::digest(contents));
+    hashEdits(hash, edits, to);
+    return Sha256::hex(hash.finish());
+}
+
+bool fetch(const std::string& key, const std::string& to)
+{
+    Lock lock(LOCK_SH);
+    const std::string entry = entryPath(key);
+    std::string expected;
+    std::string actual;
+    if (!readFile(entry + ".sha256", expected) || !hashFile(entry, actual))
+    {
+        misses++;
+        return false;
+    }
+    if (expected.substr(0, actual.size()) != actual)
+    {
+        std::cerr << "\n/!\\ WARNING : Store entry " << entry << " was modified, removing it" << std::endl;
+        removeEntry(entry);
+        misses++;
+        return false;
+    }
+
+    if (!place(entry, to))
+    {
+        misses++;
+        return false;
+    }
+
+    // The modification time of the digest tells which entries were used last. Not that of the
+    // entry, which may be hard linked into bundles that would see it change.
+    utimes((entry + ".sha256").c_str(), NULL);
+    Log::verbose() << "  * Taken from the store: " << entry;
+    hits++;
+    return true;
+}
+
+void put(const std::string& key, const std::string& contents, mode_t mode)
+{
+    Lock lock(LOCK_SH);
+    const std::string entry = entryPath(key);
+    createDirectories(entry.substr(0, entry.rfind('/')));
+    // the entry only counts once its digest is there, which is written last
+    if (!writeFileAtomically(entry, contents, mode) ||
+        !writeFileAtomically(entry + ".sha256", Sha256::hex(Sha256::digest(contents)) + "\n", 0644))
+    {
+        std::cerr << "\n/!\\ WARNING : Cannot add " << entry << " to the store" << std::endl;
+        removeEntry(entry);
+    }
+}
+
+void put(const std::string& key, const std::string& file)
+{
+    std::string contents;
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0 || !readFile(file, contents))
+    {
+        std::cerr << "\n/!\\ WARNING : Cannot read " << file << " to add it to the store" << std::endl;
+        return;
+    }
+    put(key, contents, st.st_mode & 07777);
+}
+
+void finish()
+{
+    if (!enabled()) return;
+    if (hits + misses > 0)
+    {
+        Log::info() << "\n* " << hits << " of " << (hits + misses) << " libraries taken from the store";
+    }
+
+    Lock lock(LOCK_EX);
+    // entries by last use: modification time of their digest, size, path
+    std::vector<std::tuple<time_t, off_t, std::string> > entries;
+    off_t total = 0;
+    DIR* store = opendir(Settings::store().c_str());
+    if (store == NULL) return;
+    while (struct dirent* bucket = readdir(store))
+    {
+        if (strlen(bucket->d_name) != 2) continue;
+        const std::string bucket_path = Settings::store() + "/" + bucket->d_name;
+        DIR* dir = opendir(bucket_path.c_str());
+        if (dir == NULL) continue;
+        while (struct dirent* file = readdir(dir))
+        {
+            const std::string name = file->d_name;
+            if (name.size() != 64) continue; // digests and temporary files go with their entry
+            const std::string path = bucket_path + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) continue;
+            // without a digest, it's not used, and goes first
+            struct stat digest;
+            const time_t used = stat((path + ".sha256").c_str(), &digest) == 0 ? digest.st_mtime : 0;
+            entries.push_back(std::make_tuple(used, st.st_size, path));
+            total += st.st_size;
+        }
+        closedir(dir);
+    }
+    closedir(store);
+
+    const off_t limit = Settings::storeSize();
+    if (total <= limit) return;
+    std::sort(entries.begin(), entries.end());
+    size_t removed = 0;
+    for (const auto& entry : entries)
+    {
+        if (total <= limit) break;
+        removeEntry(std::get<2>(entry));
+        total -= std::get<1>(entry);
+        removed++;
+    }
+    Log::verbose() << "* " << removed << " entries removed from the store to keep it under " << (limit >> 20) << " MB";
+}
+
+}
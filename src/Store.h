@@ -0,0 +1,61 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _store_h_
+#define _store_h_
+
+#include <string>
+#include <sys/types.h>
+
+struct FileEdits;
+
+// A directory shared between runs, and between projects, holding libraries as they were
+// written to a bundle. Entries are named after a hash of everything the result depends on,
+// so a library bundled the same way again is taken from there instead of being processed.
+// Several runs may use the same store at once.
+namespace Store
+{
+
+// whether --store was given
+bool enabled();
+
+// key of what writing 'contents' to 'to' with 'edits' gives
+std::string key(const std::string& contents, const FileEdits& edits, const std::string& to);
+
+// Puts the entry for 'key' at 'to', as a clone or a hard link of it when the file system allows,
+// or in the archive when files only go there.
+// Returns false, and removes the entry, if it doesn't have the contents it was stored with.
+bool fetch(const std::string& key, const std::string& to);
+
+// adds an entry for 'key' with the given contents, or those of 'file'
+void put(const std::string& key, const std::string& contents, mode_t mode);
+void put(const std::string& key, const std::string& file);
+
+// removes the least recently used entries until the store is within --store-size,
+// and prints how many libraries were found in it
+void finish();
+
+}
+
+#endif
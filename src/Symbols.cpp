@@ -0,0 +1,622 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Symbols.h"
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace Symbols
+{
+
+namespace
+{
+
+const uint8_t N_STAB = 0xe0;
+const uint8_t N_TYPE = 0x0e;
+const uint8_t N_EXT = 0x01;
+const uint8_t N_UNDF = 0x0;
+const uint8_t N_SECT = 0xe;
+const uint16_t N_WEAK_REF = 0x40;
+const int DYNAMIC_LOOKUP_ORDINAL = 0xfe;
+const int EXECUTABLE_ORDINAL = 0xff;
+
+const uint8_t BIND_OPCODE_MASK = 0xf0;
+const uint8_t BIND_IMMEDIATE_MASK = 0x0f;
+const uint8_t BIND_OPCODE_SET_DYLIB_ORDINAL_IMM = 0x10;
+const uint8_t BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB = 0x20;
+const uint8_t BIND_OPCODE_SET_DYLIB_SPECIAL_IMM = 0x30;
+const uint8_t BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM = 0x40;
+const uint8_t BIND_OPCODE_SET_TYPE_IMM = 0x50;
+const uint8_t BIND_OPCODE_SET_ADDEND_SLEB = 0x60;
+const uint8_t BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB = 0x70;
+const uint8_t BIND_OPCODE_ADD_ADDR_ULEB = 0x80;
+const uint8_t BIND_OPCODE_DO_BIND = 0x90;
+const uint8_t BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB = 0xa0;
+const uint8_t BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED = 0xb0;
+const uint8_t BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB = 0xc0;
+const uint8_t BIND_OPCODE_THREADED = 0xd0;
+const uint8_t BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB = 0x00;
+const uint8_t BIND_SYMBOL_FLAGS_WEAK_IMPORT = 0x1;
+
+const uint64_t EXPORT_SYMBOL_FLAGS_REEXPORT = 0x08;
+const uint64_t EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER = 0x10;
+
+// a range of bytes in the slice, after bounds checking
+struct Range
+{
+    uint32_t offset = 0;
+    uint32_t size = 0;
+};
+
+bool validRange(const MachO::Slice& slice, uint32_t offset, uint32_t size, Range& range)
+{
+    if (size == 0 || uint64_t(offset) + size > slice.data.size()) return false;
+    range.offset = offset;
+    range.size = size;
+    return true;
+}
+
+// reads an unsigned LEB128 at 'pos', moves 'pos' past it
+uint64_t readUleb(const std::string& data, size_t& pos, size_t end)
+{
+    uint64_t value = 0;
+    int shift = 0;
+    while (pos < end)
+    {
+        const uint8_t byte = data[pos++];
+        if (shift < 64) value |= uint64_t(byte & 0x7f) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0) break;
+    }
+    return value;
+}
+
+// rewrites the ULEB128 at [pos, pos+length) in place, padding it to the same length
+void writeUleb(std::string& data, size_t pos, size_t length, uint64_t value)
+{
+    for (size_t n=0; n<length; n++)
+    {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (n+1 < length) byte |= 0x80;
+        data[pos+n] = byte;
+    }
+}
+
+std::string readCString(const std::string& data, size_t& pos, size_t end)
+{
+    const size_t start = pos;
+    while (pos < end && data[pos] != '\0') pos++;
+    std::string value = data.substr(start, pos - start);
+    if (pos < end) pos++;
+    return value;
+}
+
+// an ordinal operand found in a bind opcode stream or an export trie
+struct OrdinalOperand
+{
+    size_t pos;
+    size_t length;   // 0 for an immediate in the low 4 bits of the opcode at 'pos'
+    int ordinal;
+};
+
+// Walks a bind opcode stream. 'bound' is called on every bind, 'ordinal_set' every time a
+// positive ordinal is set, with where it is encoded.
+void walkBindOpcodes(const std::string& data, const Range& range,
+                     const std::function<void(const Import&)>& bound,
+                     const std::function<void(const OrdinalOperand&)>& ordinal_set)
+{
+    size_t pos = range.offset;
+    const size_t end = range.offset + range.size;
+    Import current;
+    current.ordinal = 0;
+    current.weak = false;
+
+    while (pos < end)
+    {
+        const size_t opcode_pos = pos;
+        const uint8_t byte = data[pos++];
+        const uint8_t opcode = byte & BIND_OPCODE_MASK;
+        const uint8_t immediate = byte & BIND_IMMEDIATE_MASK;
+        switch (opcode)
+        {
+            case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+            {
+                current.ordinal = immediate;
+                OrdinalOperand operand = { opcode_pos, 0, current.ordinal };
+                if (current.ordinal > 0) ordinal_set(operand);
+                break;
+            }
+            case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB:
+            {
+                const size_t start = pos;
+                current.ordinal = readUleb(data, pos, end);
+                OrdinalOperand operand = { start, pos - start, current.ordinal };
+                if (current.ordinal > 0) ordinal_set(operand);
+                break;
+            }
+            case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+                current.ordinal = immediate == 0 ? 0 : int8_t(BIND_OPCODE_MASK | immediate);
+                break;
+            case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM:
+                current.name = readCString(data, pos, end);
+                current.weak = (immediate & BIND_SYMBOL_FLAGS_WEAK_IMPORT) != 0;
+                break;
+            case BIND_OPCODE_SET_ADDEND_SLEB:
+            case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+            case BIND_OPCODE_ADD_ADDR_ULEB:
+                readUleb(data, pos, end);
+                break;
+            case BIND_OPCODE_DO_BIND:
+            case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+                bound(current);
+                break;
+            case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
+                readUleb(data, pos, end);
+                bound(current);
+                break;
+            case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB:
+                readUleb(data, pos, end);
+                readUleb(data, pos, end);
+                bound(current);
+                break;
+            case BIND_OPCODE_THREADED:
+                if (immediate == BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB) readUleb(data, pos, end);
+                break;
+            default:
+                // BIND_OPCODE_DONE separates entries in lazy bind info, SET_TYPE_IMM has no operand
+                break;
+        }
+    }
+}
+
+// the bind, weak bind and lazy bind streams of LC_DYLD_INFO(_ONLY)
+void dyldInfoRanges(const MachO::Slice& slice, std::vector<Range>& ordinal_ranges, Range& weak_range, Range& export_range)
+{
+    int index = MachO::findCommand(slice, MachO::LC_DYLD_INFO_ONLY);
+    if (index < 0) index = MachO::findCommand(slice, MachO::LC_DYLD_INFO);
+    if (index < 0 || slice.commands[index].size < 48) return;
+
+    const uint32_t at = slice.commands[index].offset;
+    Range range;
+    if (validRange(slice, MachO::read32(slice.data, at+16), MachO::read32(slice.data, at+20), range)) ordinal_ranges.push_back(range);
+    if (validRange(slice, MachO::read32(slice.data, at+32), MachO::read32(slice.data, at+36), range)) ordinal_ranges.push_back(range);
+    validRange(slice, MachO::read32(slice.data, at+24), MachO::read32(slice.data, at+28), weak_range);
+    validRange(slice, MachO::read32(slice.data, at+40), MachO::read32(slice.data, at+44), export_range);
+}
+
+bool linkeditData(const MachO::Slice& slice, uint32_t cmd, Range& range)
+{
+    const int index = MachO::findCommand(slice, cmd);
+    if (index < 0 || slice.commands[index].size < 16) return false;
+    const uint32_t at = slice.commands[index].offset;
+    return validRange(slice, MachO::read32(slice.data, at+8), MachO::read32(slice.data, at+12), range);
+}
+
+Range exportTrie(const MachO::Slice& slice)
+{
+    std::vector<Range> ordinal_ranges;
+    Range weak_range, export_range;
+    if (!linkeditData(slice, MachO::LC_DYLD_EXPORTS_TRIE, export_range))
+        dyldInfoRanges(slice, ordinal_ranges, weak_range, export_range);
+    return export_range;
+}
+
+// Walks an export trie. 'exported' gets every exported name, 'reexport' where the ordinal
+// of each re-exported symbol is encoded.
+void walkExportTrie(const std::string& data, const Range& range,
+                    const std::function<void(const std::string&)>& exported,
+                    const std::function<void(const OrdinalOperand&)>& reexport)
+{
+    if (range.size == 0) return;
+    const size_t end = range.offset + range.size;
+
+    std::vector<std::pair<uint64_t, std::string> > pending(1, std::make_pair(uint64_t(0), std::string()));
+    std::set<uint64_t> visited;
+    while (!pending.empty())
+    {
+        const uint64_t node = pending.back().first;
+        const std::string prefix = pending.back().second;
+        pending.pop_back();
+        if (node >= range.size || !visited.insert(node).second) continue;
+
+        size_t pos = range.offset + node;
+        const uint64_t terminal_size = readUleb(data, pos, end);
+        const size_t children_pos = pos + terminal_size;
+        if (terminal_size > 0)
+        {
+            exported(prefix);
+            const uint64_t flags = readUleb(data, pos, end);
+            if (flags & EXPORT_SYMBOL_FLAGS_REEXPORT)
+            {
+                const size_t start = pos;
+                const int ordinal = readUleb(data, pos, end);
+                OrdinalOperand operand = { start, pos - start, ordinal };
+                reexport(operand);
+            }
+        }
+
+        pos = children_pos;
+        if (pos >= end) continue;
+        const uint8_t child_amount = data[pos++];
+        for (uint8_t n=0; n<child_amount && pos < end; n++)
+        {
+            const std::string edge = readCString(data, pos, end);
+            const uint64_t child = readUleb(data, pos, end);
+            pending.push_back(std::make_pair(child, prefix + edge));
+        }
+    }
+}
+
+struct ChainedImports
+{
+    Range range;
+    uint32_t imports_offset = 0;
+    uint32_t imports_count = 0;
+    uint32_t imports_format = 0;
+    uint32_t symbols_offset = 0;
+};
+
+const uint32_t DYLD_CHAINED_IMPORT = 1;
+const uint32_t DYLD_CHAINED_IMPORT_ADDEND = 2;
+const uint32_t DYLD_CHAINED_IMPORT_ADDEND64 = 3;
+
+bool chainedImports(const MachO::Slice& slice, ChainedImports& chained)
+{
+    if (!linkeditData(slice, MachO::LC_DYLD_CHAINED_FIXUPS, chained.range) || chained.range.size < 28) return false;
+    const uint32_t at = chained.range.offset;
+    chained.imports_offset = MachO::read32(slice.data, at+8);
+    chained.symbols_offset = MachO::read32(slice.data, at+12);
+    chained.imports_count = MachO::read32(slice.data, at+16);
+    chained.imports_format = MachO::read32(slice.data, at+20);
+
+    uint32_t entry_size = 0;
+    if (chained.imports_format == DYLD_CHAINED_IMPORT) entry_size = 4;
+    else if (chained.imports_format == DYLD_CHAINED_IMPORT_ADDEND) entry_size = 8;
+    else if (chained.imports_format == DYLD_CHAINED_IMPORT_ADDEND64) entry_size = 16;
+    else return false;
+    return uint64_t(chained.imports_offset) + uint64_t(chained.imports_count) * entry_size <= chained.range.size;
+}
+
+// Calls 'import' for each entry of the chained fixups imports table,
+// with the position of the entry in the slice.
+void walkChainedImports(const MachO::Slice& slice, const ChainedImports& chained,
+                        const std::function<void(const Import&, size_t)>& import)
+{
+    const size_t end = chained.range.offset + chained.range.size;
+    const bool wide = chained.imports_format == DYLD_CHAINED_IMPORT_ADDEND64;
+    const uint32_t entry_size = wide ? 16 : (chained.imports_format == DYLD_CHAINED_IMPORT_ADDEND ? 8 : 4);
+
+    for (uint32_t n=0; n<chained.imports_count; n++)
+    {
+        const size_t pos = chained.range.offset + chained.imports_offset + n * entry_size;
+        Import entry;
+        uint64_t name_offset;
+        if (wide)
+        {
+            const uint64_t value = MachO::read64(slice.data, pos);
+            const uint16_t ordinal = value & 0xffff;
+            entry.ordinal = ordinal >= 0xfff0 ? int(int16_t(ordinal)) : int(ordinal);
+            entry.weak = (value >> 16) & 1;
+            name_offset = value >> 32;
+        }
+        else
+        {
+            const uint32_t value = MachO::read32(slice.data, pos);
+            const uint8_t ordinal = value & 0xff;
+            entry.ordinal = ordinal >= 0xf0 ? int(int8_t(ordinal)) : int(ordinal);
+            entry.weak = (value >> 8) & 1;
+            name_offset = value >> 9;
+        }
+        size_t name_pos = chained.range.offset + chained.symbols_offset + name_offset;
+        if (name_pos < end) entry.name = readCString(slice.data, name_pos, end);
+        import(entry, pos);
+    }
+}
+
+struct SymbolTable
+{
+    uint32_t symoff = 0;
+    uint32_t nsyms = 0;
+    uint32_t stroff = 0;
+    uint32_t strsize = 0;
+    uint32_t entry_size = 0;
+};
+
+bool symbolTable(const MachO::Slice& slice, SymbolTable& table)
+{
+    const int index = MachO::findCommand(slice, MachO::LC_SYMTAB);
+    if (index < 0 || slice.commands[index].size < 24) return false;
+    const uint32_t at = slice.commands[index].offset;
+    table.symoff = MachO::read32(slice.data, at+8);
+    table.nsyms = MachO::read32(slice.data, at+12);
+    table.stroff = MachO::read32(slice.data, at+16);
+    table.strsize = MachO::read32(slice.data, at+20);
+    table.entry_size = slice.is64 ? 16 : 12;
+    return uint64_t(table.symoff) + uint64_t(table.nsyms) * table.entry_size <= slice.data.size() &&
+           uint64_t(table.stroff) + table.strsize <= slice.data.size();
+}
+
+std::string symbolName(const MachO::Slice& slice, const SymbolTable& table, uint32_t strx)
+{
+    if (strx >= table.strsize) return "";
+    size_t pos = table.stroff + strx;
+    return readCString(slice.data, pos, table.stroff + table.strsize);
+}
+
+}
+
+void readImports(const MachO::Slice& slice, std::vector<Import>& imports)
+{
+    std::set<std::pair<std::string, int> > seen;
+    const auto add = [&](const Import& import)
+    {
+        if (seen.insert(std::make_pair(import.name, import.ordinal)).second) imports.push_back(import);
+    };
+
+    // in a flat namespace image, symbols are searched in all loaded images
+    const bool two_level = (slice.flags & MachO::MH_TWOLEVEL) != 0;
+
+    ChainedImports chained;
+    if (chainedImports(slice, chained))
+        walkChainedImports(slice, chained, [&](const Import& import, size_t) { add(import); });
+
+    std::vector<Range> ordinal_ranges;
+    Range weak_range, export_range;
+    dyldInfoRanges(slice, ordinal_ranges, weak_range, export_range);
+    for (const auto& range : ordinal_ranges)
+        walkBindOpcodes(slice.data, range, add, [](const OrdinalOperand&) {});
+    // weak binds are by name only, coalesced across all images
+    walkBindOpcodes(slice.data, weak_range, [&](const Import& import)
+    {
+        Import weak = import;
+        weak.ordinal = WEAK_LOOKUP_ORDINAL;
+        add(weak);
+    }, [](const OrdinalOperand&) {});
+
+    SymbolTable table;
+    if (symbolTable(slice, table))
+    {
+        for (uint32_t n=0; n<table.nsyms; n++)
+        {
+            const size_t at = table.symoff + n * table.entry_size;
+            const uint8_t type = slice.data[at+4];
+            if ((type & N_STAB) || (type & N_TYPE) != N_UNDF || !(type & N_EXT)) continue;
+            uint16_t desc;
+            memcpy(&desc, slice.data.data() + at + 6, sizeof(desc));
+
+            Import import;
+            import.name = symbolName(slice, table, MachO::read32(slice.data, at));
+            import.weak = (desc & N_WEAK_REF) != 0;
+            const int ordinal = desc >> 8;
+            if (!two_level || ordinal == DYNAMIC_LOOKUP_ORDINAL) import.ordinal = FLAT_LOOKUP_ORDINAL;
+            else if (ordinal == EXECUTABLE_ORDINAL) import.ordinal = MAIN_EXECUTABLE_ORDINAL;
+            else import.ordinal = ordinal;
+            if (!import.name.empty()) add(import);
+        }
+    }
+}
+
+void readExports(const MachO::Slice& slice, std::vector<std::string>& exports)
+{
+    const Range trie = exportTrie(slice);
+    if (trie.size > 0)
+    {
+        walkExportTrie(slice.data, trie, [&](const std::string& name) { exports.push_back(name); },
+                       [](const OrdinalOperand&) {});
+        return;
+    }
+
+    // old images have no export trie, their exports are the defined external symbols
+    SymbolTable table;
+    if (!symbolTable(slice, table)) return;
+    for (uint32_t n=0; n<table.nsyms; n++)
+    {
+        const size_t at = table.symoff + n * table.entry_size;
+        const uint8_t type = slice.data[at+4];
+        if ((type & N_STAB) || (type & N_TYPE) != N_SECT || !(type & N_EXT)) continue;
+        exports.push_back(symbolName(slice, table, MachO::read32(slice.data, at)));
+    }
+}
+
+bool stripDebugSymbols(MachO::Slice& slice)
+{
+    SymbolTable table;
+    if (!symbolTable(slice, table)) return false;
+    const int symtab = MachO::findCommand(slice, MachO::LC_SYMTAB);
+    const int dysymtab = MachO::findCommand(slice, MachO::LC_DYSYMTAB);
+    const uint32_t dysymtab_at = dysymtab >= 0 ? slice.commands[dysymtab].offset : 0;
+    // the table of contents and module table of very old libraries refer to symbols too
+    if (dysymtab >= 0 && (MachO::read32(slice.data, dysymtab_at+36) != 0 || MachO::read32(slice.data, dysymtab_at+44) != 0))
+        return false;
+
+    const uint32_t REMOVED = 0xffffffff;
+    std::vector<uint32_t> new_index(table.nsyms, REMOVED);
+    std::string symbols;
+    std::string strings = slice.data.substr(table.stroff, table.strsize < 2 ? table.strsize : 2);
+    std::map<std::string, uint32_t> string_offsets;
+    uint32_t kept = 0;
+    for (uint32_t n=0; n<table.nsyms; n++)
+    {
+        const size_t at = table.symoff + n * table.entry_size;
+        if (uint8_t(slice.data[at+4]) & N_STAB) continue;
+
+        std::string entry = slice.data.substr(at, table.entry_size);
+        const uint32_t strx = MachO::read32(entry, 0);
+        if (strx >= strings.size())
+        {
+            const std::string name = symbolName(slice, table, strx);
+            std::map<std::string, uint32_t>::const_iterator found = string_offsets.find(name);
+            uint32_t new_strx;
+            if (found != string_offsets.end()) new_strx = found->second;
+            else
+            {
+                new_strx = strings.size();
+                string_offsets[name] = new_strx;
+                strings += name;
+                strings += '\0';
+            }
+            MachO::write32(entry, 0, new_strx);
+        }
+        symbols += entry;
+        new_index[n] = kept++;
+    }
+    if (kept == table.nsyms) return false;
+
+    // keep the size differences multiples of 16 so everything after stays aligned
+    const uint32_t symbols_size = table.nsyms * table.entry_size;
+    while ((symbols_size - symbols.size()) % 16 != 0) symbols += '\0';
+    while (strings.size() % 16 != table.strsize % 16) strings += '\0';
+
+    const auto remap = [&](uint32_t index)
+    {
+        // first kept symbol at or after 'index', for the bounds of ranges
+        while (index < table.nsyms && new_index[index] == REMOVED) index++;
+        return index < table.nsyms ? new_index[index] : kept;
+    };
+
+    if (dysymtab >= 0)
+    {
+        // local, defined external and undefined symbol ranges
+        for (uint32_t field = 8; field <= 24; field += 8)
+        {
+            const uint32_t first = MachO::read32(slice.data, dysymtab_at+field);
+            const uint32_t amount = MachO::read32(slice.data, dysymtab_at+field+4);
+            const uint32_t new_first = remap(first);
+            MachO::write32(slice.data, dysymtab_at+field, new_first);
+            MachO::write32(slice.data, dysymtab_at+field+4, remap(first + amount) - new_first);
+        }
+
+        const uint32_t INDIRECT_SYMBOL_LOCAL = 0x80000000;
+        const uint32_t INDIRECT_SYMBOL_ABS = 0x40000000;
+        const uint32_t indirectsymoff = MachO::read32(slice.data, dysymtab_at+56);
+        const uint32_t nindirectsyms = MachO::read32(slice.data, dysymtab_at+60);
+        if (uint64_t(indirectsymoff) + uint64_t(nindirectsyms) * 4 <= slice.data.size())
+        {
+            for (uint32_t n=0; n<nindirectsyms; n++)
+            {
+                const uint32_t index = MachO::read32(slice.data, indirectsymoff + n*4);
+                if (index & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS)) continue;
+                if (index < table.nsyms) MachO::write32(slice.data, indirectsymoff + n*4, new_index[index]);
+            }
+        }
+
+        // external relocations refer to symbols by index
+        const uint32_t extreloff = MachO::read32(slice.data, dysymtab_at+64);
+        const uint32_t nextrel = MachO::read32(slice.data, dysymtab_at+68);
+        if (uint64_t(extreloff) + uint64_t(nextrel) * 8 <= slice.data.size())
+        {
+            for (uint32_t n=0; n<nextrel; n++)
+            {
+                const size_t at = extreloff + n*8 + 4;
+                const uint32_t info = MachO::read32(slice.data, at);
+                const bool is_extern = (info >> 27) & 1;
+                const uint32_t index = info & 0xffffff;
+                if (is_extern && index < table.nsyms)
+                    MachO::write32(slice.data, at, (info & 0xff000000) | new_index[index]);
+            }
+        }
+    }
+
+    const uint32_t symtab_at = slice.commands[symtab].offset;
+    MachO::write32(slice.data, symtab_at+12, kept);
+    MachO::write32(slice.data, symtab_at+20, strings.size());
+
+    // the later range first, so the offset of the other one is still valid
+    if (table.stroff > table.symoff)
+    {
+        MachO::replaceLinkeditRange(slice, table.stroff, table.strsize, strings);
+        MachO::replaceLinkeditRange(slice, table.symoff, symbols_size, symbols);
+    }
+    else
+    {
+        MachO::replaceLinkeditRange(slice, table.symoff, symbols_size, symbols);
+        MachO::replaceLinkeditRange(slice, table.stroff, table.strsize, strings);
+    }
+    return true;
+}
+
+void removeDependency(MachO::Slice& slice, int ordinal)
+{
+    const auto renumber = [&](const OrdinalOperand& operand)
+    {
+        if (operand.ordinal <= ordinal) return;
+        if (operand.length == 0) slice.data[operand.pos] = char(BIND_OPCODE_SET_DYLIB_ORDINAL_IMM | (operand.ordinal - 1));
+        else writeUleb(slice.data, operand.pos, operand.length, operand.ordinal - 1);
+    };
+
+    std::vector<Range> ordinal_ranges;
+    Range weak_range, export_range;
+    dyldInfoRanges(slice, ordinal_ranges, weak_range, export_range);
+    for (const auto& range : ordinal_ranges)
+        walkBindOpcodes(slice.data, range, [](const Import&) {}, renumber);
+    walkExportTrie(slice.data, exportTrie(slice), [](const std::string&) {}, renumber);
+
+    ChainedImports chained;
+    if (chainedImports(slice, chained))
+    {
+        const bool wide = chained.imports_format == DYLD_CHAINED_IMPORT_ADDEND64;
+        walkChainedImports(slice, chained, [&](const Import& import, size_t pos)
+        {
+            if (import.ordinal <= ordinal) return;
+            if (wide) MachO::write64(slice.data, pos, (MachO::read64(slice.data, pos) & ~uint64_t(0xffff)) | uint64_t(import.ordinal - 1));
+            else MachO::write32(slice.data, pos, (MachO::read32(slice.data, pos) & ~uint32_t(0xff)) | uint32_t(import.ordinal - 1));
+        });
+    }
+
+    SymbolTable table;
+    if ((slice.flags & MachO::MH_TWOLEVEL) && symbolTable(slice, table))
+    {
+        for (uint32_t n=0; n<table.nsyms; n++)
+        {
+            const size_t at = table.symoff + n * table.entry_size;
+            const uint8_t type = slice.data[at+4];
+            if ((type & N_STAB) || (type & N_TYPE) != N_UNDF || !(type & N_EXT)) continue;
+            uint16_t desc;
+            memcpy(&desc, slice.data.data() + at + 6, sizeof(desc));
+            const int symbol_ordinal = desc >> 8;
+            if (symbol_ordinal <= ordinal || symbol_ordinal >= DYNAMIC_LOOKUP_ORDINAL) continue;
+            desc = (desc & 0xff) | ((symbol_ordinal - 1) << 8);
+            memcpy(&slice.data[at+6], &desc, sizeof(desc));
+        }
+    }
+
+    // finally remove the load command itself
+    int dylib_index = 0;
+    for (size_t n=0; n<slice.commands.size(); n++)
+    {
+        if (!MachO::isDylibCommand(slice.commands[n].cmd)) continue;
+        if (++dylib_index == ordinal)
+        {
+            MachO::removeCommand(slice, n);
+            return;
+        }
+    }
+}
+
+}
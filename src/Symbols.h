@@ -0,0 +1,68 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _symbols_h_
+#define _symbols_h_
+
+#include <string>
+#include <vector>
+#include "MachO.h"
+
+// Reading of the symbols a Mach-O slice imports and exports, from chained fixups,
+// dyld info bind opcodes, export tries and the symbol table.
+namespace Symbols
+{
+
+// library ordinals that don't designate a dependency
+const int SELF_LIBRARY_ORDINAL = 0;
+const int MAIN_EXECUTABLE_ORDINAL = -1;
+const int FLAT_LOOKUP_ORDINAL = -2;
+const int WEAK_LOOKUP_ORDINAL = -3;
+
+struct Import
+{
+    std::string name;
+    // 1-based index in slice.dylibs, or one of the special ordinals above
+    int ordinal;
+    bool weak;
+};
+
+// every symbol 'slice' binds to, each listed once per ordinal it is bound through
+void readImports(const MachO::Slice& slice, std::vector<Import>& imports);
+
+// every symbol exported by 'slice', including re-exported ones
+void readExports(const MachO::Slice& slice, std::vector<std::string>& exports);
+
+// Removes debugging symbols (STABS) from the symbol table of 'slice' and the names only they
+// used from the string table, renumbering references to the remaining symbols. Returns false,
+// leaving the slice untouched, if there is nothing to strip.
+bool stripDebugSymbols(MachO::Slice& slice);
+
+// Removes dependency 'ordinal' (1-based) from 'slice', and renumbers every reference to the
+// dependencies after it. Nothing may be bound through that ordinal anymore.
+void removeDependency(MachO::Slice& slice, int ordinal);
+
+}
+
+#endif
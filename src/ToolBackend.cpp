@@ -0,0 +1,601 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "ToolBackend.h"
+#include "Cache.h"
+#include "CodeSign.h"
+#include "MachO.h"
+#include "Settings.h"
+#include "Utils.h"
+#include "Vfs.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace
+{
+
+std::string quoted(const std::string& text)
+{
+    return "\"" + text + "\"";
+}
+
+// what was known not to exist may now, after files were created
+bool created(bool ok)
+{
+    Vfs::changed();
+    return ok;
+}
+
+// nothing known about files may hold anymore, after some were removed
+bool removed(bool ok)
+{
+    Vfs::clear();
+    return ok;
+}
+
+// Runs the usual command line tools. Only questions about the file system are answered
+// in-process, as they always were.
+class ExternalTools : public ToolBackend
+{
+public:
+    std::string name() const override{ return "external"; }
+    size_t processLaunches() const override{ return launches; }
+
+    std::string loadCommands(const std::string& file) override
+    {
+        launches++;
+        return system_get_output("otool -l " + quoted(file));
+    }
+
+    bool changeInstallName(const std::string& file, const std::string& old_name, const std::string& new_name) override
+    {
+        return run("install_name_tool -change " + quoted(old_name) + " " + quoted(new_name) + " " + quoted(file));
+    }
+
+    bool changeId(const std::string& file, const std::string& id) override
+    {
+        return run("install_name_tool -id " + quoted(id) + " " + quoted(file));
+    }
+
+    bool changeRpath(const std::string& file, const std::string& old_path, const std::string& new_path) override
+    {
+        return run("install_name_tool -rpath " + quoted(old_path) + " " + quoted(new_path) + " " + quoted(file));
+    }
+
+    bool codesign(const std::string& file) override
+    {
+        return run("codesign --force --deep --preserve-metadata=entitlements,requirements,flags,runtime --sign - " + quoted(file));
+    }
+
+    bool copyFile(const std::string& from, const std::string& to, bool overwrite) override
+    {
+        return created(run(std::string("cp ") + (overwrite ? "-f " : "-n ") + quoted(from) + " " + quoted(to)));
+    }
+
+    bool moveFile(const std::string& from, const std::string& to) override
+    {
+        return removed(run("mv -f " + quoted(from) + " " + quoted(to)));
+    }
+
+    bool makeWritable(const std::string& file) override
+    {
+        return run("chmod +w " + quoted(file));
+    }
+
+    bool createDirectory(const std::string& path) override
+    {
+        return created(run("mkdir -p " + quoted(path)));
+    }
+
+    bool removeTree(const std::string& path) override
+    {
+        return removed(run("rm -r " + quoted(path)));
+    }
+
+    std::string machine() override
+    {
+        launches++;
+        return system_get_output("machine");
+    }
+
+    std::string realPath(const std::string& path) override
+    {
+        return Vfs::realPath(path);
+    }
+
+    bool fileExists(const std::string& path) override
+    {
+        return ::fileExists(path);
+    }
+
+    bool directoryContains(const std::string& dir, const std::string& name) override
+    {
+        return Cache::directoryContains(dir, name);
+    }
+
+protected:
+    bool run(const std::string& command)
+    {
+        launches++;
+        return systemp(command) == 0;
+    }
+
+    std::atomic<size_t> launches{0};
+};
+
+const char* commandName(uint32_t cmd)
+{
+    switch (cmd)
+    {
+        case MachO::LC_SEGMENT: return "LC_SEGMENT";
+        case MachO::LC_SYMTAB: return "LC_SYMTAB";
+        case MachO::LC_DYSYMTAB: return "LC_DYSYMTAB";
+        case MachO::LC_LOAD_DYLIB: return "LC_LOAD_DYLIB";
+        case MachO::LC_ID_DYLIB: return "LC_ID_DYLIB";
+        case MachO::LC_LOAD_WEAK_DYLIB: return "LC_LOAD_WEAK_DYLIB";
+        case MachO::LC_SEGMENT_64: return "LC_SEGMENT_64";
+        case MachO::LC_RPATH: return "LC_RPATH";
+        case MachO::LC_CODE_SIGNATURE: return "LC_CODE_SIGNATURE";
+        case MachO::LC_REEXPORT_DYLIB: return "LC_REEXPORT_DYLIB";
+        case MachO::LC_LAZY_LOAD_DYLIB: return "LC_LAZY_LOAD_DYLIB";
+        case MachO::LC_DYLD_INFO: return "LC_DYLD_INFO";
+        case MachO::LC_DYLD_INFO_ONLY: return "LC_DYLD_INFO_ONLY";
+        case MachO::LC_LOAD_UPWARD_DYLIB: return "LC_LOAD_UPWARD_DYLIB";
+        case MachO::LC_FUNCTION_STARTS: return "LC_FUNCTION_STARTS";
+        case MachO::LC_DATA_IN_CODE: return "LC_DATA_IN_CODE";
+        case MachO::LC_DYLD_EXPORTS_TRIE: return "LC_DYLD_EXPORTS_TRIE";
+        case MachO::LC_DYLD_CHAINED_FIXUPS: return "LC_DYLD_CHAINED_FIXUPS";
+        default: return nullptr;
+    }
+}
+
+int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+// Reads and edits Mach-O files in-process and does file operations with system calls, so
+// that no process is started.
+class NativeTools : public ExternalTools
+{
+public:
+    std::string name() const override{ return "native"; }
+
+    std::string loadCommands(const std::string& file) override
+    {
+        std::vector<MachO::Slice> slices;
+        if (!MachO::readHeaders(file, slices)) return "";
+
+        // like otool, only show one architecture
+        const MachO::Slice& slice = slices[0];
+        std::string output = file + ":\n";
+        for (size_t n=0; n<slice.commands.size(); n++)
+        {
+            const MachO::LoadCommand& lc = slice.commands[n];
+            const char* cmd_name = commandName(lc.cmd);
+            char line[64];
+            output += "Load command " + std::to_string(n) + "\n";
+            if (cmd_name) output += std::string("          cmd ") + cmd_name + "\n";
+            else
+            {
+                snprintf(line, sizeof(line), "          cmd 0x%x\n", lc.cmd);
+                output += line;
+            }
+            output += "      cmdsize " + std::to_string(lc.size) + "\n";
+
+            const char* field = nullptr;
+            if (MachO::isDylibCommand(lc.cmd) || lc.cmd == MachO::LC_ID_DYLIB) field = "name";
+            else if (lc.cmd == MachO::LC_RPATH) field = "path";
+            const uint32_t str_offset = field ? MachO::read32(slice.header, lc.offset + 8) : 0;
+            if (field && str_offset < lc.size)
+            {
+                const std::string value = slice.header.substr(lc.offset + str_offset, lc.size - str_offset).c_str();
+                output += std::string("         ") + field + " " + value + " (offset " + std::to_string(str_offset) + ")\n";
+            }
+        }
+        return output;
+    }
+
+    bool changeInstallName(const std::string& file, const std::string& old_name, const std::string& new_name) override
+    {
+        // like install_name_tool, not depending on 'old_name' isn't an error
+        return editStrings(file, [&](size_t, uint32_t cmd, const std::string& value, std::string& new_value)
+        {
+            new_value = new_name;
+            return MachO::isDylibCommand(cmd) && value == old_name;
+        }, false);
+    }
+
+    bool changeId(const std::string& file, const std::string& id) override
+    {
+        return editStrings(file, [&](size_t, uint32_t cmd, const std::string&, std::string& new_value)
+        {
+            new_value = id;
+            return cmd == MachO::LC_ID_DYLIB;
+        }, true);
+    }
+
+    bool changeRpath(const std::string& file, const std::string& old_path, const std::string& new_path) override
+    {
+        return editStrings(file, MachO::rpathEdit(old_path, new_path), true);
+    }
+
+    bool codesign(const std::string& file) override
+    {
+        // written to a new inode, as the kernel may still have the old signature cached for this one
+        MachO::File macho;
+        struct stat st;
+        return stat(file.c_str(), &st) == 0 && macho.load(file) &&
+               CodeSign::adhocSign(macho, CodeSign::identifierFor(file)) &&
+               writeFileAtomically(file, macho.serialize(), st.st_mode & 07777);
+    }
+
+    bool copyFile(const std::string& from, const std::string& to, bool overwrite) override
+    {
+        const int in = open(from.c_str(), O_RDONLY);
+        if (in < 0) return false;
+        struct stat st;
+        if (fstat(in, &st) != 0)
+        {
+            close(in);
+            return false;
+        }
+        const int out = open(to.c_str(), O_WRONLY | O_CREAT | (overwrite ? O_TRUNC : O_EXCL), st.st_mode & 07777);
+        if (out < 0)
+        {
+            close(in);
+            return !overwrite && errno == EEXIST;
+        }
+
+        bool ok = true;
+        char buffer[1 << 16];
+        while (ok)
+        {
+            const ssize_t amount = read(in, buffer, sizeof(buffer));
+            if (amount < 0 && errno == EINTR) continue;
+            if (amount <= 0)
+            {
+                ok = amount == 0;
+                break;
+            }
+            for (ssize_t done = 0; ok && done < amount; )
+            {
+                const ssize_t written = write(out, buffer + done, amount - done);
+                if (written < 0 && errno == EINTR) continue;
+                ok = written > 0;
+                if (ok) done += written;
+            }
+        }
+        close(in);
+        return created(close(out) == 0 && ok);
+    }
+
+    bool moveFile(const std::string& from, const std::string& to) override
+    {
+        if (rename(from.c_str(), to.c_str()) == 0) return removed(true);
+        if (errno != EXDEV) return false;
+        // to another file system: copy, then remove the original
+        return removed(copyFile(from, to, true) && unlink(from.c_str()) == 0);
+    }
+
+    bool makeWritable(const std::string& file) override
+    {
+        struct stat st;
+        return stat(file.c_str(), &st) == 0 && chmod(file.c_str(), (st.st_mode & 07777) | S_IWUSR) == 0;
+    }
+
+    bool createDirectory(const std::string& path) override
+    {
+        for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+        {
+            const std::string parent = path.substr(0, slash);
+            if (!parent.empty() && mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) return false;
+            if (slash == std::string::npos) break;
+        }
+        struct stat st;
+        return created(stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+    }
+
+    bool removeTree(const std::string& path) override
+    {
+        return removed(nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS) == 0);
+    }
+
+    std::string machine() override
+    {
+        struct utsname names;
+        if (uname(&names) != 0) return "";
+        return std::string(names.machine) + "\n";
+    }
+
+private:
+    // Sets the string of every dylib or rpath command 'edit' matches to the value it gives, in
+    // all slices. With 'must_match', fails if no command matched.
+    bool editStrings(const std::string& path, const MachO::StringEdit& edit, bool must_match)
+    {
+        MachO::File file;
+        if (!file.load(path)) return false;
+
+        bool matched = false;
+        bool changed = false;
+        std::string error;
+        if (!MachO::editCommandStrings(file, edit, matched, changed, error))
+        {
+            std::cerr << "\n\nError : " << error << " in " << path << std::endl;
+            return false;
+        }
+        if (must_match && !matched) return false;
+        return !changed || file.save(path);
+    }
+};
+
+// one call and its result, fields as length-prefixed strings
+typedef std::vector<std::string> TraceRecord;
+
+const char* const trace_magic = "dylibbundler-trace 1";
+
+void writeRecord(std::ostream& out, const TraceRecord& record)
+{
+    out << "record " << record.size() << "\n";
+    for (const auto& field : record) out << field.size() << "\n" << field << "\n";
+}
+
+bool readRecord(std::istream& in, TraceRecord& record)
+{
+    std::string word;
+    size_t fields = 0;
+    if (!(in >> word >> fields) || word != "record") return false;
+    record.assign(fields, "");
+    for (auto& field : record)
+    {
+        size_t size = 0;
+        if (!(in >> size) || in.get() != '\n') return false;
+        field.resize(size);
+        if (size > 0 && !in.read(&field[0], size)) return false;
+        if (in.get() != '\n') return false;
+    }
+    return true;
+}
+
+std::string flag(bool value){ return value ? "1" : "0"; }
+
+// Lets another backend do the work and writes every call with its result to a trace file.
+class TraceRecorder : public ToolBackend
+{
+public:
+    TraceRecorder(ToolBackend* inner, const std::string& path) : inner(inner), out(path.c_str(), std::ios::binary | std::ios::trunc)
+    {
+        if (!out)
+        {
+            std::cerr << "\n\nError : Cannot write trace to " << path << std::endl;
+            exit(1);
+        }
+        out << trace_magic << "\n";
+    }
+
+    std::string name() const override{ return inner->name() + ", recorded"; }
+    size_t processLaunches() const override{ return inner->processLaunches(); }
+
+    std::string loadCommands(const std::string& file) override
+    {
+        return record({"loadCommands", file}, inner->loadCommands(file));
+    }
+    bool changeInstallName(const std::string& file, const std::string& old_name, const std::string& new_name) override
+    {
+        return record({"changeInstallName", file, old_name, new_name}, inner->changeInstallName(file, old_name, new_name));
+    }
+    bool changeId(const std::string& file, const std::string& id) override
+    {
+        return record({"changeId", file, id}, inner->changeId(file, id));
+    }
+    bool changeRpath(const std::string& file, const std::string& old_path, const std::string& new_path) override
+    {
+        return record({"changeRpath", file, old_path, new_path}, inner->changeRpath(file, old_path, new_path));
+    }
+    bool codesign(const std::string& file) override
+    {
+        return record({"codesign", file}, inner->codesign(file));
+    }
+    bool copyFile(const std::string& from, const std::string& to, bool overwrite) override
+    {
+        return record({"copyFile", from, to, flag(overwrite)}, inner->copyFile(from, to, overwrite));
+    }
+    bool moveFile(const std::string& from, const std::string& to) override
+    {
+        return record({"moveFile", from, to}, inner->moveFile(from, to));
+    }
+    bool makeWritable(const std::string& file) override
+    {
+        return record({"makeWritable", file}, inner->makeWritable(file));
+    }
+    bool createDirectory(const std::string& path) override
+    {
+        return record({"createDirectory", path}, inner->createDirectory(path));
+    }
+    bool removeTree(const std::string& path) override
+    {
+        return record({"removeTree", path}, inner->removeTree(path));
+    }
+    std::string machine() override
+    {
+        return record({"machine"}, inner->machine());
+    }
+    std::string realPath(const std::string& path) override
+    {
+        return record({"realPath", path}, inner->realPath(path));
+    }
+    bool fileExists(const std::string& path) override
+    {
+        return record({"fileExists", path}, inner->fileExists(path));
+    }
+    bool directoryContains(const std::string& dir, const std::string& name) override
+    {
+        return record({"directoryContains", dir, name}, inner->directoryContains(dir, name));
+    }
+
+private:
+    std::string record(TraceRecord call, const std::string& result)
+    {
+        call.push_back(result);
+        std::lock_guard<std::mutex> lock(mutex);
+        writeRecord(out, call);
+        out.flush(); // a job ending with exit() must still leave a complete trace
+        return result;
+    }
+
+    bool record(TraceRecord call, bool result)
+    {
+        record(call, flag(result));
+        return result;
+    }
+
+    std::unique_ptr<ToolBackend> inner;
+    std::mutex mutex;
+    std::ofstream out;
+};
+
+// Answers every call with the result recorded for it, in the order they were recorded,
+// without touching any file.
+class TraceReplayer : public ToolBackend
+{
+public:
+    explicit TraceReplayer(const std::string& path) : path(path)
+    {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        std::string magic;
+        if (!std::getline(in, magic) || magic != trace_magic)
+        {
+            std::cerr << "\n\nError : " << path << " is not a dylibbundler trace" << std::endl;
+            exit(1);
+        }
+        TraceRecord record;
+        while (readRecord(in, record))
+        {
+            if (record.size() < 2) continue;
+            const std::string result = record.back();
+            record.pop_back();
+            results[key(record)].push_back(result);
+        }
+    }
+
+    std::string name() const override{ return "replay"; }
+    size_t processLaunches() const override{ return 0; }
+
+    std::string loadCommands(const std::string& file) override{ return replay({"loadCommands", file}); }
+    bool changeInstallName(const std::string& file, const std::string& old_name, const std::string& new_name) override
+    {
+        return replay({"changeInstallName", file, old_name, new_name}) == "1";
+    }
+    bool changeId(const std::string& file, const std::string& id) override{ return replay({"changeId", file, id}) == "1"; }
+    bool changeRpath(const std::string& file, const std::string& old_path, const std::string& new_path) override
+    {
+        return replay({"changeRpath", file, old_path, new_path}) == "1";
+    }
+    bool codesign(const std::string& file) override{ return replay({"codesign", file}) == "1"; }
+    bool copyFile(const std::string& from, const std::string& to, bool overwrite) override
+    {
+        return replay({"copyFile", from, to, flag(overwrite)}) == "1";
+    }
+    bool moveFile(const std::string& from, const std::string& to) override{ return replay({"moveFile", from, to}) == "1"; }
+    bool makeWritable(const std::string& file) override{ return replay({"makeWritable", file}) == "1"; }
+    bool createDirectory(const std::string& path) override{ return replay({"createDirectory", path}) == "1"; }
+    bool removeTree(const std::string& path) override{ return replay({"removeTree", path}) == "1"; }
+    std::string machine() override{ return replay({"machine"}); }
+    std::string realPath(const std::string& path) override{ return replay({"realPath", path}); }
+    bool fileExists(const std::string& path) override{ return replay({"fileExists", path}) == "1"; }
+    bool directoryContains(const std::string& dir, const std::string& name) override
+    {
+        return replay({"directoryContains", dir, name}) == "1";
+    }
+
+private:
+    static std::string key(const TraceRecord& call)
+    {
+        std::string joined;
+        for (const auto& field : call) joined += field + '\0';
+        return joined;
+    }
+
+    std::string replay(const TraceRecord& call)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, std::deque<std::string> >::iterator found = results.find(key(call));
+        if (found == results.end() || found->second.empty())
+        {
+            std::string description = call[0];
+            for (size_t n=1; n<call.size(); n++) description += " \"" + call[n] + "\"";
+            std::cerr << "\n\nError : " << path << " has no result for " << description
+                      << ". Replay with the same arguments as the recorded run." << std::endl;
+            exit(1);
+        }
+        const std::string result = found->second.front();
+        // the last result stays for calls repeated more often than recorded, like questions
+        // answered from a cache in the recorded run
+        if (found->second.size() > 1) found->second.pop_front();
+        return result;
+    }
+
+    std::string path;
+    std::mutex mutex;
+    std::map<std::string, std::deque<std::string> > results;
+};
+
+std::unique_ptr<ToolBackend> current_tools(new ExternalTools());
+
+}
+
+ToolBackend& tools()
+{
+    return *current_tools;
+}
+
+void selectTools()
+{
+    if (!Settings::replayTrace().empty())
+    {
+        current_tools.reset(new TraceReplayer(Settings::replayTrace()));
+        return;
+    }
+
+    ToolBackend* backend = nullptr;
+    if (Settings::toolBackend() == "native") backend = new NativeTools();
+    else backend = new ExternalTools();
+
+    if (!Settings::recordTrace().empty()) backend = new TraceRecorder(backend, Settings::recordTrace());
+    current_tools.reset(backend);
+}
@@ -0,0 +1,71 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _tool_backend_h_
+#define _tool_backend_h_
+
+#include <string>
+
+// What dylibbundler asks of the system to inspect and modify files: running otool,
+// install_name_tool, codesign and friends, or doing the same work in-process. Going through
+// this interface lets a run be recorded into a trace and replayed anywhere, without macOS.
+class ToolBackend
+{
+public:
+    virtual ~ToolBackend(){}
+
+    virtual std::string name() const = 0;
+    // amount of processes started so far
+    virtual size_t processLaunches() const = 0;
+
+    // load commands of 'file' in the format of "otool -l", empty if it can't be read
+    virtual std::string loadCommands(const std::string& file) = 0;
+    virtual bool changeInstallName(const std::string& file, const std::string& old_name, const std::string& new_name) = 0;
+    virtual bool changeId(const std::string& file, const std::string& id) = 0;
+    virtual bool changeRpath(const std::string& file, const std::string& old_path, const std::string& new_path) = 0;
+    // ad-hoc signature
+    virtual bool codesign(const std::string& file) = 0;
+
+    // an existing 'to' is left alone unless 'overwrite'
+    virtual bool copyFile(const std::string& from, const std::string& to, bool overwrite) = 0;
+    virtual bool moveFile(const std::string& from, const std::string& to) = 0;
+    virtual bool makeWritable(const std::string& file) = 0;
+    // creates missing parents too
+    virtual bool createDirectory(const std::string& path) = 0;
+    virtual bool removeTree(const std::string& path) = 0;
+
+    // hardware name, as printed by "machine"
+    virtual std::string machine() = 0;
+    // canonical absolute path, empty if it doesn't exist
+    virtual std::string realPath(const std::string& path) = 0;
+    virtual bool fileExists(const std::string& path) = 0;
+    virtual bool directoryContains(const std::string& dir, const std::string& name) = 0;
+};
+
+// the backend chosen with --tool-backend, --record-trace and --replay-trace
+ToolBackend& tools();
+// sets up the backend from the settings, once all arguments are parsed
+void selectTools();
+
+#endif
@@ -0,0 +1,146 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "UnusedDependencies.h"
+#include "MachO.h"
+#include "Symbols.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+
+std::mutex exports_mutex;
+std::map<std::string, std::set<std::string> > exports_per_file;
+
+// exports of all slices of 'path', empty if it can't be read
+const std::set<std::string>& exportsOf(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(exports_mutex);
+    std::map<std::string, std::set<std::string> >::iterator found = exports_per_file.find(path);
+    if (found != exports_per_file.end()) return found->second;
+
+    std::set<std::string>& exports = exports_per_file[path];
+    MachO::File file;
+    if (!path.empty() && file.load(path))
+    {
+        for (size_t n=0; n<file.sliceAmount(); n++)
+        {
+            std::vector<std::string> names;
+            Symbols::readExports(file.slice(n), names);
+            exports.insert(names.begin(), names.end());
+        }
+    }
+    return exports;
+}
+
+}
+
+bool findDependencyUsage(const std::string& path, const std::function<std::string(const std::string&)>& resolve,
+                         DependencyUsage& usage)
+{
+    MachO::File file;
+    if (!file.load(path)) return false;
+
+    std::set<std::string> names;
+    for (size_t n=0; n<file.sliceAmount(); n++)
+    {
+        const MachO::Slice& slice = file.slice(n);
+        std::vector<bool> used(slice.dylibs.size(), false);
+        for (size_t d=0; d<slice.dylibs.size(); d++)
+        {
+            names.insert(slice.dylibs[d].name);
+            if (slice.dylibs[d].cmd == MachO::LC_REEXPORT_DYLIB) used[d] = true;
+        }
+
+        std::vector<Symbols::Import> imports;
+        Symbols::readImports(slice, imports);
+        for (const auto& import : imports)
+        {
+            if (import.ordinal > 0 && size_t(import.ordinal) <= slice.dylibs.size())
+            {
+                used[import.ordinal-1] = true;
+            }
+            else if (import.ordinal == Symbols::FLAT_LOOKUP_ORDINAL)
+            {
+                // the first dependency that exports the symbol provides it; if none
+                // of those we can read does, we can't tell which one is used
+                bool found = false;
+                for (size_t d=0; d<slice.dylibs.size() && !found; d++)
+                {
+                    if (exportsOf(resolve(slice.dylibs[d].name)).count(import.name)) used[d] = found = true;
+                }
+                if (!found && !import.weak) used.assign(used.size(), true);
+            }
+        }
+
+        for (size_t d=0; d<slice.dylibs.size(); d++)
+        {
+            if (used[d]) usage.used.insert(slice.dylibs[d].name);
+        }
+    }
+
+    // a dependency is only unused if it is unused in every slice
+    for (const auto& name : names)
+    {
+        if (!usage.used.count(name)) usage.unused.insert(name);
+    }
+    return true;
+}
+
+void removeDependencies(const std::string& path, const std::set<std::string>& names)
+{
+    if (names.empty()) return;
+
+    MachO::File file;
+    if (!file.load(path))
+    {
+        std::cerr << "\n\nError : Cannot read " << path << " to remove unused dependencies" << std::endl;
+        exit(1);
+    }
+
+    removeDependencies(file, names);
+
+    if (!file.save(path))
+    {
+        std::cerr << "\n\nError : An error occured while trying to remove unused dependencies of " << path << std::endl;
+        exit(1);
+    }
+}
+
+void removeDependencies(MachO::File& file, const std::set<std::string>& names)
+{
+    for (size_t n=0; n<file.sliceAmount(); n++)
+    {
+        MachO::Slice& slice = file.slice(n);
+        // from the last one, so ordinals of those still to remove don't change
+        for (int ordinal = slice.dylibs.size(); ordinal > 0; ordinal--)
+        {
+            if (names.count(slice.dylibs[ordinal-1].name)) Symbols::removeDependency(slice, ordinal);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _unused_dependencies_h_
+#define _unused_dependencies_h_
+
+#include <functional>
+#include <set>
+#include <string>
+
+namespace MachO { class File; }
+
+struct DependencyUsage
+{
+    // names of dependencies, as written in the load commands
+    std::set<std::string> used;
+    std::set<std::string> unused;
+};
+
+// Sorts the dependencies of 'file' by whether any import binds to them, in any slice.
+// Re-exported libraries are always used. 'resolve' gives the path of a dependency from its
+// name, to look up its exports when a symbol is bound through a flat namespace lookup.
+// Returns false if 'file' can't be read, in which case all dependencies count as used.
+bool findDependencyUsage(const std::string& file, const std::function<std::string(const std::string&)>& resolve,
+                         DependencyUsage& usage);
+
+// removes the load commands of the given dependencies from 'file', renumbering the others
+void removeDependencies(const std::string& file, const std::set<std::string>& names);
+// the same, on a file already in memory
+void removeDependencies(MachO::File& file, const std::set<std::string>& names);
+
+#endif
@@ -25,12 +25,24 @@ THE SOFTWARE.
 
 #include "Utils.h"
 #include "Dependency.h"
+#include "Journal.h"
 #include "Settings.h"
+#include "Log.h"
+#include "ToolBackend.h"
+#include "SearchIndex.h"
+#include "MachO.h"
+#include "Symbols.h"
+#include "Reactor.h"
+#include "Vfs.h"
+#include <cerrno>
+#include <map>
+#include <set>
 #include <cstdlib>
 #include <unistd.h>
 #include <iostream>
 #include <cstdio>
 #include <stdio.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 using namespace std;
@@ -71,7 +83,7 @@ void tokenize(const string& str, const char* delim, vector<string>* vectorarg)
 
 bool fileExists(const std::string& filename)
 {
-    if (access( filename.c_str(), F_OK ) != -1)
+    if (Vfs::exists(filename))
     {
         return true; // file exists
     }
@@ -81,7 +93,7 @@ bool fileExists(const std::string& filename)
         std::string delims = " \f\n\r\t\v";
         std::string rtrimmed = filename.substr(0, filename.find_last_not_of(delims) + 1);
         std::string ftrimmed = rtrimmed.substr(rtrimmed.find_first_not_of(delims));
-        if (access( ftrimmed.c_str(), F_OK ) != -1)
+        if (Vfs::exists(ftrimmed))
         {
             return true;
         }
@@ -98,86 +110,159 @@ void copyFile(const string& from, const string& to)
     bool override = Settings::canOverwriteFiles();
     if( from != to && !override )
     {
-        if(fileExists( to ))
+        if(tools().fileExists( to ))
         {
             cerr << "\n\nError : File " << to.c_str() << " already exists. Remove it or enable overwriting." << endl;
             exit(1);
         }
     }
 
-    string override_permission = string(override ? "-f " : "-n ");
-        
     // copy file to local directory
-    string command = string("cp ") + override_permission + string("\"") + from + string("\" \"") + to + string("\"");
-    if( from != to && systemp( command ) != 0 )
+    if( from != to && !tools().copyFile(from, to, override) )
     {
         cerr << "\n\nError : An error occured while trying to copy file " << from << " to " << to << endl;
         exit(1);
     }
     
     // give it write permission
-    string command2 = string("chmod +w \"") + to + "\"";
-    if( systemp( command2 ) != 0 )
+    if( !tools().makeWritable(to) )
     {
         cerr << "\n\nError : An error occured while trying to set write permissions on file " << to << endl;
         exit(1);
     }
 }
 
-std::string system_get_output(const std::string& cmd)
+void copyFileTrimmed(const string& from, const string& to)
 {
-    FILE * command_output;
-    char output[128];
-    int amount_read = 1;
-    
-    std::string full_output;
-    
-    try
+    if( !Settings::canOverwriteFiles() && from != to && fileExists( to ) )
     {
-        command_output = popen(cmd.c_str(), "r");
-        if(command_output == NULL) throw;
-        
-        while(amount_read > 0)
-        {
-            amount_read = fread(output, 1, 127, command_output);
-            if(amount_read <= 0) break;
-            else
-            {
-                output[amount_read] = '\0';
-                full_output += output;
-            }
-        }
+        cerr << "\n\nError : File " << to.c_str() << " already exists. Remove it or enable overwriting." << endl;
+        exit(1);
     }
-    catch(...)
+
+    MachO::File file;
+    loadTrimmed(from, file);
+
+    struct stat st;
+    const mode_t mode = stat(from.c_str(), &st) == 0 ? (st.st_mode & 07777) : 0644;
+    if( from != to ) unlink(to.c_str());
+    if( !file.save(to) || chmod(to.c_str(), mode | S_IWUSR) != 0 )
     {
-        std::cerr << "An error occured while executing command " << cmd.c_str() << std::endl;
-        pclose(command_output);
-        return "";
+        cerr << "\n\nError : An error occured while trying to copy file " << from << " to " << to << endl;
+        exit(1);
     }
-    
-    int return_value = pclose(command_output);
-    if(return_value != 0) return "";
-    
-    return full_output;
+}
+
+void loadTrimmed(const string& from, MachO::File& file)
+{
+    if( !file.load(from) )
+    {
+        cerr << "\n\nError : Cannot read " << from << " as a Mach-O file" << endl;
+        exit(1);
+    }
+    trimFile(from, file);
+}
+
+void trimFile(const string& from, MachO::File& file)
+{
+
+    const string arch = Settings::thinArch();
+    if( !arch.empty() && file.isFat() && !file.thin(MachO::cpuTypeFromName(arch)) )
+    {
+        cerr << "\n\nError : " << from << " has no " << arch << " architecture" << endl;
+        exit(1);
+    }
+    if( !arch.empty() && !file.isFat() && file.slice(0).cputype != MachO::cpuTypeFromName(arch) )
+    {
+        cerr << "\n\nError : " << from << " is " << MachO::cpuTypeName(file.slice(0).cputype) << ", not " << arch << endl;
+        exit(1);
+    }
+
+    if( Settings::stripDebug() )
+    {
+        for(size_t n=0; n<file.sliceAmount(); n++)
+            Symbols::stripDebugSymbols(file.slice(n));
+    }
+}
+
+namespace
+{
+
+// reserves 'size' bytes for 'fd' up front, so the file isn't grown piece by piece
+bool preallocate(int fd, off_t size)
+{
+    if (size == 0) return true;
+#ifdef __APPLE__
+    fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, size, 0 };
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+    {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(fd, F_PREALLOCATE, &store) == -1) return errno != ENOSPC;
+    }
+    return true;
+#else
+    // not being supported by the file system isn't an error, running out of space is
+    return posix_fallocate(fd, 0, size) != ENOSPC;
+#endif
+}
+
+}
+
+bool writeFileAtomically(const std::string& path, const std::string& contents, mode_t mode)
+{
+    std::string temp = path + ".XXXXXX";
+    const int fd = mkstemp(&temp[0]);
+    if (fd < 0) return false;
+
+    bool ok = preallocate(fd, contents.size());
+    for (size_t done = 0; ok && done < contents.size(); )
+    {
+        const ssize_t written = write(fd, contents.data() + done, contents.size() - done);
+        if (written < 0 && errno == EINTR) continue;
+        ok = written > 0;
+        if (ok) done += written;
+    }
+    ok = fchmod(fd, mode) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+    ok = ok && rename(temp.c_str(), path.c_str()) == 0;
+    if (!ok) unlink(temp.c_str());
+    Vfs::changed();
+    return ok;
+}
+
+std::string system_get_output(const std::string& cmd)
+{
+    const Reactor::Result result = Reactor::run(cmd).get();
+    if(!result.errors.empty()) std::cerr << result.errors << std::flush;
+    if(result.status != 0) return "";
+    return result.output;
 }
 
 int systemp(const std::string& cmd)
 {
-    std::cout << "    " << cmd.c_str() << std::endl;
-    return system(cmd.c_str());
+    Log::verbose() << "    " << cmd.c_str();
+    const Reactor::Result result = Reactor::run(cmd).get();
+    // printed in one piece, as other commands may be running meanwhile
+    if(!result.output.empty()) Log::info() << result.output.substr(0, result.output.find_last_not_of('\n') + 1);
+    if(!result.errors.empty()) std::cerr << result.errors << std::flush;
+    return result.status;
 }
 
 void changeInstallName(const std::string& binary_file, const std::string& old_name, const std::string& new_name)
 {
-    std::string command = std::string("install_name_tool -change \"") + old_name + "\" \"" + new_name + "\" \"" + binary_file + "\"";
-    if( systemp( command ) != 0 )
+    if( !tools().changeInstallName(binary_file, old_name, new_name) )
     {
         std::cerr << "\n\nError: An error occured while trying to fix dependencies of " << binary_file << std::endl;
         exit(1);
     }
+    Journal::edited(binary_file);
 }
 
-std::string getUserInputDirForFile(const std::string& filename)
+// the files that need each library that couldn't be found
+std::map<std::string, std::set<std::string> > unresolved_libraries;
+int unresolved_lookups = 0;
+
+std::string getUserInputDirForFile(const std::string& filename, const std::string& dependent_file)
 {
     const int searchPathAmount = Settings::searchPathAmount();
     for(int n=0; n<searchPathAmount; n++)
@@ -185,13 +270,31 @@ std::string getUserInputDirForFile(const std::string& filename)
         auto searchPath = Settings::searchPath(n);
         if( !searchPath.empty() && searchPath[ searchPath.size()-1 ] != '/' ) searchPath += "/";
 
-        if( fileExists( searchPath+filename ) )
+        if( tools().directoryContains( searchPath, filename ) )
         {
             std::cerr << (searchPath+filename) << " was found. /!\\ DYLIBBUNDLER MAY NOT CORRECTLY HANDLE THIS DEPENDENCY: Manually check the executable with 'otool -L'" << std::endl;
             return searchPath;
         }
     }
 
+    std::string indexedPath = SearchIndex::findDirectoryFor(filename, dependent_file);
+    if( !indexedPath.empty() )
+    {
+        Log::info() << "FOUND " << filename << " in " << indexedPath;
+        Settings::addSearchPath(indexedPath);
+        return indexedPath;
+    }
+
+    if( !Settings::canPrompt() )
+    {
+        unresolved_libraries[filename].insert(dependent_file);
+        unresolved_lookups++;
+        return "";
+    }
+
+    // the question must come after everything already printed, on a line of its own
+    Log::progressDone();
+    Log::flush();
     while (true)
     {
         std::cout << "Please specify the directory where this library is located (or enter 'quit' to abort): ";  fflush(stdout);
@@ -200,11 +303,17 @@ std::string getUserInputDirForFile(const std::string& filename)
         std::cin >> prefix;
         std::cout << std::endl;
 
+        if(!std::cin)
+        {
+            std::cerr << "\n\nError : No input available to locate " << filename << std::endl;
+            exit(1);
+        }
+
         if(prefix.compare("quit")==0) exit(1);
 
         if( !prefix.empty() && prefix[ prefix.size()-1 ] != '/' ) prefix += "/";
 
-        if( !fileExists( prefix+filename ) )
+        if( !tools().fileExists( prefix+filename ) )
         {
             std::cerr << (prefix+filename) << " does not exist. Try again" << std::endl;
             continue;
@@ -218,20 +327,40 @@ std::string getUserInputDirForFile(const std::string& filename)
     }
 }
 
+int unresolvedLibraryAmount()
+{
+    return unresolved_lookups;
+}
+
+int reportUnresolvedLibraries()
+{
+    if( unresolved_libraries.empty() ) return 0;
+
+    std::cerr << "\n\nError : " << unresolved_libraries.size() << " libraries could not be found:" << std::endl;
+    for(const auto& library : unresolved_libraries)
+    {
+        // one line per library, however many files need it
+        std::cerr << "    " << library.first << " (needed by " << *library.second.begin();
+        if( library.second.size() > 1 ) std::cerr << " and " << library.second.size() - 1 << " other files";
+        std::cerr << ")" << std::endl;
+    }
+    std::cerr << "Add the directories containing them with --search-path or --search-root." << std::endl;
+    return unresolved_libraries.size();
+}
+
 void adhocCodeSign(const std::string& file)
 {
     if( Settings::canCodesign() == false ) return;
 
     // Add ad-hoc signature for ARM (Apple Silicon) binaries
-    std::string signCommand = std::string("codesign --force --deep --preserve-metadata=entitlements,requirements,flags,runtime --sign - \"") + file + "\"";
-    if( systemp( signCommand ) != 0 )
+    if( !tools().codesign(file) )
     {
         // If the codesigning fails, it may be a bug in Apple's codesign utility.
         // A known workaround is to copy the file to another inode, then move it back
         // erasing the previous file. Then sign again.
         std::cerr << "  * Error : An error occurred while applying ad-hoc signature to " << file << ". Attempting workaround" << std::endl;
 
-        std::string machine = system_get_output("machine");
+        std::string machine = tools().machine();
         bool isArm = machine.find("arm") != std::string::npos;
         std::string tempDirTemplate = std::string(std::getenv("TMPDIR") + std::string("dylibbundler.XXXXXXXX"));
         std::string filename = file.substr(file.rfind("/")+1);
@@ -246,9 +375,9 @@ void adhocCodeSign(const std::string& file)
         }
         std::string tmpDir = std::string(tmpDirCstr);
         std::string tmpFile = tmpDir+"/"+filename;
-        const auto runCommand = [isArm](const std::string& command, const std::string& errMsg)
+        const auto check = [isArm](bool succeeded, const std::string& errMsg)
         {
-            if( systemp( command ) != 0 )
+            if( !succeeded )
             {
                 std::cerr << errMsg << std::endl;
                 if( isArm )
@@ -257,12 +386,35 @@ void adhocCodeSign(const std::string& file)
                 }
             }
         };
-        std::string command = std::string("cp -p \"") + file + "\" \"" + tmpFile + "\"";
-        runCommand(command, "  * Error : An error occurred copying " + file + " to " + tmpDir);
-        command = std::string("mv -f \"") + tmpFile + "\" \"" + file + "\"";
-        runCommand(command, "  * Error : An error occurred moving " + tmpFile + " to " + file);
-        command = std::string("rm -rf \"") + tmpDir + "\"";
-        systemp( command );
-        runCommand(signCommand, "  * Error : An error occurred while applying ad-hoc signature to " + file);
+        check(tools().copyFile(file, tmpFile, true), "  * Error : An error occurred copying " + file + " to " + tmpDir);
+        check(tools().moveFile(tmpFile, file), "  * Error : An error occurred moving " + tmpFile + " to " + file);
+        Journal::edited(file);
+        tools().removeTree(tmpDir);
+        check(tools().codesign(file), "  * Error : An error occurred while applying ad-hoc signature to " + file);
+    }
+    Journal::edited(file);
+}
+
+std::string jsonString(const std::string& text)
+{
+    std::string escaped = "\"";
+    for (unsigned char c : text)
+    {
+        switch (c)
+        {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (c < 0x20)
+                {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                }
+                else escaped += c;
+        }
     }
+    return escaped + "\"";
 }
@@ -27,22 +27,48 @@ THE SOFTWARE.
 #define _utils_h_
 
 #include <string>
+#include <sys/types.h>
 #include <vector>
 
 class Library;
+namespace MachO { class File; }
 
 void tokenize(const std::string& str, const char* delimiters, std::vector<std::string>*);
 bool fileExists(const std::string& filename);
 
 void copyFile(const std::string& from, const std::string& to);
+// like copyFile, but keeps only the architecture from --thin and drops debugging
+// symbols if --strip-debug is on, while the file is in memory
+void copyFileTrimmed(const std::string& from, const std::string& to);
+// Writes 'contents' to a new file next to 'path', preallocated to its final size, and renames
+// it to 'path', so 'path' is never seen half written and gets a new inode.
+bool writeFileAtomically(const std::string& path, const std::string& contents, mode_t mode);
+// reads 'from' into 'file', trimmed like copyFileTrimmed does
+void loadTrimmed(const std::string& from, MachO::File& file);
+// the same, on 'file' already read from 'from'
+void trimFile(const std::string& from, MachO::File& file);
 
-// executes a command in the native shell and returns output in string
+// executes a command in the native shell and returns output in string, empty if it fails.
+// Commands run through the Reactor, so several threads may run them at once.
 std::string system_get_output(const std::string& cmd);
 
 // like 'system', runs a command on the system shell, but also prints the command to stdout.
+// What the command printed is printed once it's done; returns its exit code.
 int systemp(const std::string& cmd);
 void changeInstallName(const std::string& binary_file, const std::string& old_name, const std::string& new_name);
-std::string getUserInputDirForFile(const std::string& filename);
+
+// Directory where 'filename', needed by 'dependent_file', is located: found in the search paths,
+// found below the search roots, or given by the user. If prompting is disabled and it can't be
+// found, it is recorded as unresolved and an empty string is returned.
+std::string getUserInputDirForFile(const std::string& filename, const std::string& dependent_file);
+
+// prints all libraries recorded as unresolved, once each, returns how many there are
+int reportUnresolvedLibraries();
+// how many times a library couldn't be found, which grows even for a library already recorded
+int unresolvedLibraryAmount();
+
+// 'text' as a quoted JSON string
+std::string jsonString(const std::string& text);
 
 // sign `file` with an ad-hoc code signature: required for ARM (Apple Silicon) binaries
 void adhocCodeSign(const std::string& file);
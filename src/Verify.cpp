@@ -0,0 +1,484 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Verify.h"
+#include "Log.h"
+#include "MachO.h"
+#include "Parallel.h"
+#include "Settings.h"
+#include "Symbols.h"
+#include "Utils.h"
+#include "Vfs.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+struct Problem
+{
+    std::string file;
+    std::string kind; // missing, outside, absolute, rpath, id or unreadable
+    std::string reference;
+    std::string detail;
+};
+
+std::string canonical(const std::string& path)
+{
+    return Vfs::realPath(path);
+}
+
+std::string directoryOf(const std::string& path)
+{
+    return path.substr(0, path.rfind('/') + 1);
+}
+
+void findMachOFiles(const std::string& dir, std::vector<std::string>& files)
+{
+    DIR* handle = opendir(dir.c_str());
+    if (handle == NULL) return;
+    while (struct dirent* entry = readdir(handle))
+    {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        const std::string path = dir + name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) findMachOFiles(path + "/", files);
+        else if (S_ISREG(st.st_mode) && MachO::isMachO(path)) files.push_back(path);
+    }
+    closedir(handle);
+}
+
+class Verifier
+{
+public:
+    Verifier(const std::vector<std::string>& fixed_files, const std::string& dest_folder)
+    {
+        for (const auto& file : fixed_files)
+        {
+            const std::string path = canonical(file);
+            if (path.empty()) continue;
+            inside_files.insert(path);
+            std::vector<MachO::Slice> slices;
+            if (executable.empty() && MachO::readHeaders(path, slices) && slices[0].filetype == MachO::MH_EXECUTE)
+            {
+                executable = path;
+                executable_rpaths = slices[0].rpaths;
+            }
+        }
+        dest = canonical(dest_folder);
+        if (!dest.empty()) dest += "/";
+    }
+
+    void verify(const std::string& file, std::vector<Problem>& problems) const
+    {
+        const std::string path = canonical(file);
+        std::vector<MachO::Slice> slices;
+        if (path.empty() || !MachO::readHeaders(path, slices))
+        {
+            problems.push_back(Problem{file, "unreadable", "", "cannot be read as a Mach-O file"});
+            return;
+        }
+
+        // slices of a universal file usually agree, report each problem once
+        std::set<std::string> reported;
+        const auto report = [&](const std::string& kind, const std::string& reference, const std::string& detail)
+        {
+            if (reported.insert(kind + '\0' + reference).second) problems.push_back(Problem{file, kind, reference, detail});
+        };
+
+        for (const auto& slice : slices)
+        {
+            for (const auto& rpath : slice.rpaths)
+            {
+                const std::string expanded = expand(rpath, path);
+                if (expanded.empty()) report("rpath", rpath, "uses @executable_path but no executable was fixed");
+                else if (!isInside(canonical(expanded), true)) report("rpath", rpath, "does not point inside the bundle");
+            }
+
+            for (const auto& dylib : slice.dylibs)
+            {
+                const std::string& name = dylib.name;
+                if (Settings::isSystemLibrary(name) || Settings::isPrefixIgnored(name)) continue;
+
+                if (name[0] == '/')
+                {
+                    report("absolute", name, "is referenced by absolute path");
+                    continue;
+                }
+
+                const std::string target = resolve(name, path, slice.rpaths);
+                if (target.empty())
+                {
+                    // dyld doesn't mind missing weak libraries
+                    if (dylib.cmd != MachO::LC_LOAD_WEAK_DYLIB) report("missing", name, "does not resolve to any file");
+                }
+                else if (!isInside(target, false)) report("outside", name, "resolves to " + target + ", outside the bundle");
+            }
+
+            // bundled libraries get their id from where they are expected to be found
+            if (slice.has_id && !dest.empty() && path.compare(0, dest.size(), dest) == 0)
+            {
+                const std::string expected = Settings::inside_lib_path() + path.substr(path.rfind('/') + 1);
+                if (slice.id.name != expected) report("id", slice.id.name, "should be " + expected);
+            }
+        }
+    }
+
+    // the file a dependency of 'loader' is loaded from, empty if there's none
+    std::string resolve(const std::string& name, const std::string& loader, const std::vector<std::string>& rpaths) const
+    {
+        if (name.compare(0, 7, "@rpath/") != 0)
+        {
+            const std::string expanded = expand(name, loader);
+            return expanded.empty() ? "" : canonical(expanded);
+        }
+
+        // the loader's own rpaths are tried first, then those of the main executable
+        std::vector<std::pair<std::string, std::string> > candidates;
+        for (const auto& rpath : rpaths) candidates.push_back(std::make_pair(rpath, loader));
+        if (loader != executable)
+            for (const auto& rpath : executable_rpaths) candidates.push_back(std::make_pair(rpath, executable));
+
+        for (const auto& candidate : candidates)
+        {
+            std::string dir = expand(candidate.first, candidate.second);
+            if (dir.empty()) continue;
+            if (dir[dir.size()-1] != '/') dir += "/";
+            const std::string target = canonical(dir + name.substr(7));
+            if (!target.empty()) return target;
+        }
+        return "";
+    }
+
+private:
+    // empty if it can't be expanded
+    std::string expand(const std::string& path, const std::string& loader) const
+    {
+        if (path.compare(0, 17, "@executable_path/") == 0)
+            return executable.empty() ? "" : directoryOf(executable) + path.substr(17);
+        if (path.compare(0, 13, "@loader_path/") == 0) return directoryOf(loader) + path.substr(13);
+        return path;
+    }
+
+    bool isInside(const std::string& path, bool is_directory) const
+    {
+        if (path.empty()) return false;
+        if (!dest.empty())
+        {
+            if (path.compare(0, dest.size(), dest) == 0) return true;
+            if (is_directory && path + "/" == dest) return true;
+        }
+        if (is_directory)
+        {
+            // an rpath to where fixed files are, e.g. the executable's own directory
+            for (const auto& file : inside_files)
+                if (directoryOf(file) == path + "/") return true;
+            return false;
+        }
+        return inside_files.count(path) > 0;
+    }
+
+    std::string dest;
+    std::set<std::string> inside_files;
+    std::string executable;
+    std::vector<std::string> executable_rpaths;
+};
+
+// the fixed files, then the Mach-O files in the dest folder
+std::vector<std::string> bundleFiles(std::vector<std::string>& fixed_files, std::string& dest_folder)
+{
+    const int fileToFixAmount = Settings::fileToFixAmount();
+    for (int n=0; n<fileToFixAmount; n++) fixed_files.push_back(Settings::fileToFix(n));
+
+    std::vector<std::string> files = fixed_files;
+    dest_folder = Settings::destFolder();
+    if (!dest_folder.empty() && dest_folder[dest_folder.size()-1] != '/') dest_folder += "/";
+    if (Settings::bundleLibs()) findMachOFiles(dest_folder, files);
+    return files;
+}
+
+// what one slice of a bundle file imports, and where from
+struct SliceSymbols
+{
+    uint32_t cputype;
+    std::vector<Symbols::Import> imports;
+    // by ordinal - 1: the name, and the index of the bundle file it resolves to, -1 if it isn't checked
+    std::vector<std::string> dependency_names;
+    std::vector<int> dependencies;
+    std::vector<int> reexported;
+};
+
+// The exports of every bundle file by (file index, architecture, symbol). Filled from all
+// threads at once, so it is split in shards with a lock each; only read once it's filled.
+class ExportTable
+{
+public:
+    void add(uint32_t library, uint32_t cputype, const std::vector<std::string>& names)
+    {
+        for (const auto& name : names)
+        {
+            std::string entry = key(library, cputype, name);
+            Shard& shard = shards[std::hash<std::string>()(entry) % SHARDS];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.entries.insert(std::move(entry));
+        }
+    }
+
+    bool contains(uint32_t library, uint32_t cputype, const std::string& name) const
+    {
+        const std::string entry = key(library, cputype, name);
+        return shards[std::hash<std::string>()(entry) % SHARDS].entries.count(entry) > 0;
+    }
+
+private:
+    static std::string key(uint32_t library, uint32_t cputype, const std::string& name)
+    {
+        std::string entry = name;
+        entry.append(reinterpret_cast<const char*>(&library), sizeof(library));
+        entry.append(reinterpret_cast<const char*>(&cputype), sizeof(cputype));
+        return entry;
+    }
+
+    static const size_t SHARDS = 64;
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_set<std::string> entries;
+    };
+    Shard shards[SHARDS];
+};
+
+void writeReport(const std::string& report_path, size_t file_amount, const std::vector<Problem>& problems)
+{
+    std::ofstream out(report_path.c_str(), std::ios::trunc);
+    out << "{\n  \"files\": " << file_amount << ",\n  \"ok\": " << (problems.empty() ? "true" : "false") << ",\n  \"problems\": [";
+    for (size_t n=0; n<problems.size(); n++)
+    {
+        const Problem& problem = problems[n];
+        out << (n ? ",\n" : "\n") << "    {\"file\": " << jsonString(problem.file) << ", \"kind\": " << jsonString(problem.kind)
+            << ", \"reference\": " << jsonString(problem.reference) << ", \"detail\": " << jsonString(problem.detail) << "}";
+    }
+    out << (problems.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    if (!out)
+    {
+        std::cerr << "\n\nError : Cannot write verification report to " << report_path << std::endl;
+        exit(1);
+    }
+}
+
+}
+
+int verifyBundle()
+{
+    Log::info() << "\n* Verifying bundle";
+
+    std::vector<std::string> fixed_files;
+    std::string dest_folder;
+    const std::vector<std::string> files = bundleFiles(fixed_files, dest_folder);
+
+    const Verifier verifier(fixed_files, dest_folder);
+    std::vector<std::vector<Problem> > problems_per_file(files.size());
+    parallelFor(files.size(), [&](size_t n)
+    {
+        verifier.verify(files[n], problems_per_file[n]);
+    });
+
+    std::vector<Problem> problems;
+    for (const auto& file_problems : problems_per_file)
+        problems.insert(problems.end(), file_problems.begin(), file_problems.end());
+
+    for (const auto& problem : problems)
+    {
+        if (problem.reference.empty()) Log::info() << "  * " << problem.file << ": " << problem.detail;
+        else Log::info() << "  * " << problem.file << ": " << problem.reference << " " << problem.detail;
+    }
+    Log::info() << "  " << files.size() << " files verified, " << problems.size() << " problems found";
+
+    if (!Settings::verifyReport().empty()) writeReport(Settings::verifyReport(), files.size(), problems);
+    return problems.size();
+}
+
+int checkBundleSymbols()
+{
+    Log::info() << "\n* Checking symbols";
+
+    std::vector<std::string> fixed_files;
+    std::string dest_folder;
+    const std::vector<std::string> files = bundleFiles(fixed_files, dest_folder);
+    const Verifier verifier(fixed_files, dest_folder);
+
+    std::map<std::string, int> index_of;
+    std::vector<std::string> paths(files.size());
+    for (size_t n=0; n<files.size(); n++)
+    {
+        paths[n] = canonical(files[n]);
+        if (!paths[n].empty()) index_of.insert(std::make_pair(paths[n], int(n)));
+    }
+    const auto bundleFile = [&](const std::string& name, const std::string& loader, const std::vector<std::string>& rpaths)
+    {
+        if (Settings::isSystemLibrary(name) || Settings::isPrefixIgnored(name)) return -1;
+        const auto found = index_of.find(verifier.resolve(name, loader, rpaths));
+        return found == index_of.end() ? -1 : found->second;
+    };
+
+    // each file is read once, its exports going to the shared table and its imports kept
+    ExportTable exports;
+    std::vector<std::vector<SliceSymbols> > symbols(files.size());
+    parallelFor(files.size(), [&](size_t n)
+    {
+        MachO::File file;
+        // a file listed twice is only read once
+        if (paths[n].empty() || index_of.find(paths[n])->second != int(n) || !file.load(paths[n])) return;
+        for (size_t s=0; s<file.sliceAmount(); s++)
+        {
+            const MachO::Slice& slice = file.slice(s);
+            SliceSymbols slice_symbols;
+            slice_symbols.cputype = slice.cputype;
+            Symbols::readImports(slice, slice_symbols.imports);
+            for (const auto& dylib : slice.dylibs)
+            {
+                const int dependency = bundleFile(dylib.name, paths[n], slice.rpaths);
+                slice_symbols.dependency_names.push_back(dylib.name);
+                slice_symbols.dependencies.push_back(dependency);
+                if (dylib.cmd == MachO::LC_REEXPORT_DYLIB && dependency >= 0) slice_symbols.reexported.push_back(dependency);
+            }
+
+            std::vector<std::string> names;
+            Symbols::readExports(slice, names);
+            exports.add(n, slice.cputype, names);
+            symbols[n].push_back(std::move(slice_symbols));
+        }
+    });
+
+    const auto sliceOf = [&](int library, uint32_t cputype) -> const SliceSymbols*
+    {
+        for (const auto& slice : symbols[library])
+            if (slice.cputype == cputype) return &slice;
+        return nullptr;
+    };
+    // libraries re-exported by re-exported libraries count too, as deep as dyld goes
+    std::function<bool(int, uint32_t, const std::string&, int)> isExported = [&](int library, uint32_t cputype, const std::string& name, int depth)
+    {
+        if (exports.contains(library, cputype, name)) return true;
+        const SliceSymbols* slice = sliceOf(library, cputype);
+        if (slice == nullptr || depth == 16) return false;
+        for (const int reexported : slice->reexported)
+            if (isExported(reexported, cputype, name, depth + 1)) return true;
+        return false;
+    };
+
+    std::vector<std::vector<std::string> > problems_per_file(files.size());
+    parallelFor(files.size(), [&](size_t n)
+    {
+        std::set<std::string> reported;
+        const bool fat = symbols[n].size() > 1;
+        for (const auto& slice : symbols[n])
+        {
+            const std::string arch = fat ? " (" + MachO::cpuTypeName(slice.cputype) + ")" : "";
+            for (const auto& import : slice.imports)
+            {
+                // flat and main executable lookups have no library to check against
+                if (import.weak || import.ordinal < 1 || size_t(import.ordinal) > slice.dependencies.size()) continue;
+                const int library = slice.dependencies[import.ordinal - 1];
+                if (library < 0) continue;
+                const std::string& dependency = slice.dependency_names[import.ordinal - 1];
+                if (sliceOf(library, slice.cputype) == nullptr)
+                {
+                    if (reported.insert(dependency + arch).second)
+                        problems_per_file[n].push_back(dependency + " has no slice for this architecture" + arch);
+                }
+                else if (!isExported(library, slice.cputype, import.name, 0))
+                {
+                    problems_per_file[n].push_back(import.name + " is not exported by " + dependency + arch);
+                }
+            }
+        }
+    });
+
+    size_t problem_amount = 0;
+    for (size_t n=0; n<files.size(); n++)
+    {
+        for (const auto& problem : problems_per_file[n]) Log::info() << "  * " << files[n] << ": " << problem;
+        problem_amount += problems_per_file[n].size();
+    }
+    Log::info() << "  " << files.size() << " files checked, " << problem_amount << " unresolved symbols found";
+    return problem_amount;
+}
+
+BundleGraph readBundleGraph()
+{
+    std::vector<std::string> fixed_files;
+    std::string dest_folder;
+    const std::vector<std::string> listed = bundleFiles(fixed_files, dest_folder);
+    const Verifier verifier(fixed_files, dest_folder);
+
+    // a file listed twice, e.g. a fixed file in the dest folder, is only kept the first time
+    BundleGraph graph;
+    graph.fixed_amount = 0;
+    std::vector<std::string> paths;
+    std::map<std::string, size_t> index_of;
+    for (size_t n=0; n<listed.size(); n++)
+    {
+        std::string path = canonical(listed[n]);
+        if (path.empty()) path = listed[n];
+        if (!index_of.insert(std::make_pair(path, graph.files.size())).second) continue;
+        graph.files.push_back(listed[n]);
+        paths.push_back(path);
+        if (n < fixed_files.size()) graph.fixed_amount++;
+    }
+
+    graph.dependencies.resize(graph.files.size());
+    graph.load_commands.resize(graph.files.size());
+    parallelFor(graph.files.size(), [&](size_t n)
+    {
+        std::vector<MachO::Slice> slices;
+        if (!MachO::readHeaders(paths[n], slices)) return;
+        std::set<size_t> dependencies;
+        for (const auto& slice : slices)
+        {
+            graph.load_commands[n] = std::max(graph.load_commands[n], slice.commands.size());
+            for (const auto& dylib : slice.dylibs)
+            {
+                if (Settings::isSystemLibrary(dylib.name) || Settings::isPrefixIgnored(dylib.name)) continue;
+                const auto found = index_of.find(verifier.resolve(dylib.name, paths[n], slice.rpaths));
+                if (found != index_of.end() && found->second != n) dependencies.insert(found->second);
+            }
+        }
+        graph.dependencies[n].assign(dependencies.begin(), dependencies.end());
+    });
+    return graph;
+}
@@ -0,0 +1,54 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _verify_h_
+#define _verify_h_
+
+#include <string>
+#include <vector>
+
+// Checks the fixed files and every Mach-O file in the dest folder: each dependency and rpath
+// must resolve inside the bundle, nothing but system libraries may be referenced by absolute
+// path, and bundled libraries must have the id they were given. Prints the problems, writes
+// the report asked for with --verify-report, and returns how many problems were found.
+int verifyBundle();
+
+// Checks that every symbol the fixed files and bundled libraries import is exported by the
+// bundled library its two-level namespace ordinal points to, or by one that library re-exports.
+// Missing weak imports are fine, and libraries outside the bundle aren't checked. Prints each
+// unresolved symbol and returns how many there are.
+int checkBundleSymbols();
+
+// The files verifyBundle checks, each once, the fixed files first, and for each the bundle files
+// its dependencies are loaded from, as dyld would find them.
+struct BundleGraph
+{
+    std::vector<std::string> files;
+    size_t fixed_amount; // how many of 'files' are fixed files
+    std::vector<std::vector<size_t> > dependencies; // indices in 'files', for all slices together
+    std::vector<size_t> load_commands; // of the slice with the most, 0 if the file can't be read
+};
+BundleGraph readBundleGraph();
+
+#endif
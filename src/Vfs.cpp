@@ -0,0 +1,284 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Vfs.h"
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux
+#include <linux/limits.h>
+#endif
+
+namespace Vfs
+{
+
+namespace
+{
+
+// like realpath, which gives up after as many links
+const int MAX_LINKS = 40;
+// directories kept open to look up their entries, beyond which full paths are used
+const size_t MAX_DIRECTORY_FDS = 256;
+
+// what a path component is, without following it
+struct Entry
+{
+    enum Kind { MISSING, DIRECTORY, LINK, OTHER } kind;
+    std::string target;    // of a link
+    unsigned generation;   // when it was looked up, missing entries expire with changed()
+};
+
+std::mutex mutex;
+std::unordered_map<std::string, Entry> entries;   // by canonical path
+std::unordered_map<std::string, int> directories; // open directories, by canonical path
+std::vector<int> retired; // directories forgotten by clear(), closed once no lookup uses them
+size_t lookups_running = 0;
+std::unordered_map<std::string, Entry> resolved;  // realPath of absolute paths, as the target of a LINK, or MISSING
+unsigned generation = 0;
+std::string working_directory;
+
+std::atomic<size_t> lookup_count(0);
+std::atomic<size_t> hit_count(0);
+
+bool valid(const Entry& entry)
+{
+    return entry.kind != Entry::MISSING || entry.generation == generation;
+}
+
+// with the mutex held
+void closeRetired()
+{
+    if (lookups_running > 0) return;
+    for (int fd : retired) close(fd);
+    retired.clear();
+}
+
+// A descriptor of the canonical directory 'dir', or AT_FDCWD if it can't be kept open.
+// It stays open until release() is called, even if clear() runs meanwhile.
+int directoryFd(const std::string& dir)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lookups_running++;
+        const auto it = directories.find(dir);
+        if (it != directories.end()) return it->second;
+        if (directories.size() >= MAX_DIRECTORY_FDS) return AT_FDCWD;
+    }
+#ifdef O_PATH
+    const int fd = open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+#else
+    const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+    if (fd < 0) return AT_FDCWD;
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto inserted = directories.insert(std::make_pair(dir, fd));
+    // another thread opened it first
+    if (!inserted.second) close(fd);
+    return inserted.first->second;
+}
+
+// with the mutex held, once done with what directoryFd() gave
+void release()
+{
+    lookups_running--;
+    closeRetired();
+}
+
+// what 'name' is in the canonical directory 'dir'
+Entry lookup(const std::string& dir, const std::string& name)
+{
+    const std::string path = (dir == "/" ? "" : dir) + "/" + name;
+    lookup_count++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = entries.find(path);
+        if (it != entries.end() && valid(it->second))
+        {
+            hit_count++;
+            return it->second;
+        }
+    }
+
+    const int fd = directoryFd(dir);
+    // relative to the directory, so it isn't walked again
+    const char* relative = fd == AT_FDCWD ? path.c_str() : name.c_str();
+    Entry entry;
+    entry.kind = Entry::MISSING;
+    struct stat st;
+    if (fstatat(fd, relative, &st, AT_SYMLINK_NOFOLLOW) == 0)
+    {
+        if (S_ISDIR(st.st_mode)) entry.kind = Entry::DIRECTORY;
+        else if (S_ISLNK(st.st_mode))
+        {
+            char buffer[PATH_MAX];
+            const ssize_t length = readlinkat(fd, relative, buffer, sizeof(buffer));
+            if (length > 0)
+            {
+                entry.kind = Entry::LINK;
+                entry.target.assign(buffer, length);
+            }
+        }
+        else entry.kind = Entry::OTHER;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    release();
+    entry.generation = generation;
+    entries[path] = entry;
+    return entry;
+}
+
+std::string workingDirectory()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (working_directory.empty())
+    {
+        char buffer[PATH_MAX];
+        if (getcwd(buffer, sizeof(buffer))) working_directory = buffer;
+    }
+    return working_directory;
+}
+
+// pushes the components of 'path' so the first one is popped first
+void pushComponents(const std::string& path, std::vector<std::string>& pending)
+{
+    size_t end = path.size();
+    while (true)
+    {
+        const size_t slash = end == 0 ? std::string::npos : path.rfind('/', end - 1);
+        const size_t start = slash == std::string::npos ? 0 : slash + 1;
+        pending.push_back(path.substr(start, end - start));
+        if (slash == std::string::npos) break;
+        end = slash;
+    }
+}
+
+std::string resolve(const std::string& absolute)
+{
+    std::vector<std::string> pending;
+    pushComponents(absolute, pending);
+    std::string current; // canonical, empty for the root
+    int links = 0;
+    while (!pending.empty())
+    {
+        const std::string component = pending.back();
+        pending.pop_back();
+        if (component.empty() || component == ".") continue;
+        if (component == "..")
+        {
+            // already canonical, so its parent is found by removing the last component
+            if (!current.empty()) current.erase(current.rfind('/'));
+            continue;
+        }
+
+        const Entry entry = lookup(current.empty() ? "/" : current, component);
+        switch (entry.kind)
+        {
+            case Entry::MISSING:
+                return "";
+            case Entry::DIRECTORY:
+                current += "/" + component;
+                break;
+            case Entry::LINK:
+                if (++links > MAX_LINKS) return "";
+                pushComponents(entry.target, pending);
+                if (entry.target[0] == '/') current.clear();
+                break;
+            case Entry::OTHER:
+                // only a directory may be followed by more components, even "." or an empty one
+                if (!pending.empty()) return "";
+                current += "/" + component;
+                break;
+        }
+    }
+    return current.empty() ? "/" : current;
+}
+
+}
+
+std::string realPath(const std::string& path)
+{
+    if (path.empty()) return "";
+    const std::string absolute = path[0] == '/' ? path : workingDirectory() + "/" + path;
+    lookup_count++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = resolved.find(absolute);
+        if (it != resolved.end() && valid(it->second))
+        {
+            hit_count++;
+            return it->second.target;
+        }
+    }
+
+    Entry result;
+    result.target = resolve(absolute);
+    result.kind = result.target.empty() ? Entry::MISSING : Entry::LINK;
+    std::lock_guard<std::mutex> lock(mutex);
+    result.generation = generation;
+    resolved[absolute] = result;
+    return result.target;
+}
+
+bool exists(const std::string& path)
+{
+    return !realPath(path).empty();
+}
+
+void changed()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+}
+
+void clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& directory : directories) retired.push_back(directory.second);
+    directories.clear();
+    closeRetired();
+    entries.clear();
+    resolved.clear();
+    working_directory.clear();
+    generation++;
+}
+
+size_t lookups()
+{
+    return lookup_count;
+}
+
+size_t hits()
+{
+    return hit_count;
+}
+
+}
@@ -0,0 +1,55 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _vfs_h_
+#define _vfs_h_
+
+#include <cstddef>
+#include <string>
+
+// Answers realpath and existence questions from memory. Paths are resolved one component
+// at a time, relative to the already resolved directory, and what was learnt about each
+// component (what it is, where a symbolic link points) is kept for the rest of the run, so
+// the many paths sharing the same prefixes only cost a lookup for their last components.
+// May be used from several threads.
+namespace Vfs
+{
+
+// canonical absolute path, like realpath, empty if it doesn't resolve
+std::string realPath(const std::string& path);
+// whether 'path' resolves to something, like access(F_OK)
+bool exists(const std::string& path);
+
+// Files were created: forgets what didn't exist. Removing files takes clear(), which forgets
+// everything, as when files may have changed behind our back.
+void changed();
+void clear();
+
+// amount of paths and path components looked up, and of those answered from memory
+size_t lookups();
+size_t hits();
+
+}
+
+#endif
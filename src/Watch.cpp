@@ -0,0 +1,236 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Watch.h"
+#include "Log.h"
+#include <chrono>
+#include <cerrno>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace
+{
+
+// how long a file must be left alone before it's processed, as builds write in several steps
+const int DEBOUNCE_MS = 200;
+// how often files are checked when they can't be watched
+const int POLL_INTERVAL_MS = 500;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Stamp
+{
+    dev_t dev = 0;
+    ino_t ino = 0;
+    off_t size = 0;
+    struct timespec mtime = {0, 0};
+
+    bool operator!=(const Stamp& other) const
+    {
+        return dev != other.dev || ino != other.ino || size != other.size ||
+               mtime.tv_sec != other.mtime.tv_sec || mtime.tv_nsec != other.mtime.tv_nsec;
+    }
+};
+
+// false if 'path' doesn't exist, e.g. while a build replaces it
+bool stampOf(const std::string& path, Stamp& stamp)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    stamp.dev = st.st_dev;
+    stamp.ino = st.st_ino;
+    stamp.size = st.st_size;
+#ifdef __APPLE__
+    stamp.mtime = st.st_mtimespec;
+#else
+    stamp.mtime = st.st_mtim;
+#endif
+    return true;
+}
+
+std::string directoryOf(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos) return ".";
+    if (slash == 0) return "/";
+    return path.substr(0, slash);
+}
+
+std::string nameOf(const std::string& path)
+{
+    return path.substr(path.rfind('/') + 1);
+}
+
+// Where notifications come from. Files are watched through their directory, as builds
+// usually replace files rather than write into them.
+class Notifier
+{
+public:
+    virtual ~Notifier(){}
+    virtual void watch(const std::vector<std::string>& files) = 0;
+    // Waits up to 'timeout_ms' (forever if negative) for notifications, and adds the files they
+    // are about to 'touched'. Returns false if there was none.
+    virtual bool wait(int timeout_ms, std::set<std::string>& touched) = 0;
+};
+
+// checks every file, as the only way to know what changed when there are no notifications
+class Poller : public Notifier
+{
+    std::vector<std::string> files;
+    std::map<std::string, Stamp> stamps;
+public:
+    void watch(const std::vector<std::string>& new_files) override
+    {
+        files = new_files;
+        stamps.clear();
+        for (const auto& file : files) stampOf(file, stamps[file]);
+    }
+
+    bool wait(int timeout_ms, std::set<std::string>& touched) override
+    {
+        const int interval = timeout_ms >= 0 && timeout_ms < POLL_INTERVAL_MS ? timeout_ms : POLL_INTERVAL_MS;
+        const Clock::time_point end = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        bool notified = false;
+        do
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+            for (const auto& file : files)
+            {
+                Stamp stamp;
+                if (stampOf(file, stamp) && stamp != stamps[file])
+                {
+                    stamps[file] = stamp;
+                    touched.insert(file);
+                    notified = true;
+                }
+            }
+        } while (!notified && (timeout_ms < 0 || Clock::now() < end));
+        return notified;
+    }
+};
+
+#ifdef __linux__
+class Inotify : public Notifier
+{
+    int fd;
+    std::map<int, std::string> directories; // by watch descriptor
+    std::map<std::string, std::set<std::string> > files; // watched paths, by directory then name
+public:
+    Inotify() : fd(inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) {}
+    ~Inotify(){ if (fd >= 0) close(fd); }
+    bool valid() const{ return fd >= 0; }
+
+    void watch(const std::vector<std::string>& new_files) override
+    {
+        files.clear();
+        for (const auto& file : new_files) files[directoryOf(file)].insert(file);
+        for (const auto& dir : files)
+        {
+            bool watched = false;
+            for (const auto& known : directories) watched = watched || known.second == dir.first;
+            if (watched) continue;
+            const int wd = inotify_add_watch(fd, dir.first.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB);
+            if (wd < 0) std::cerr << "\n/!\\ WARNING : Cannot watch " << dir.first << " for changes" << std::endl;
+            else directories[wd] = dir.first;
+        }
+    }
+
+    bool wait(int timeout_ms, std::set<std::string>& touched) override
+    {
+        struct pollfd ready = { fd, POLLIN, 0 };
+        if (poll(&ready, 1, timeout_ms) <= 0) return false;
+
+        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t amount;
+        while ((amount = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* at = buffer; at < buffer + amount; )
+            {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(at);
+                at += sizeof(struct inotify_event) + event->len;
+                const auto dir = directories.find(event->wd);
+                if (dir == directories.end() || event->len == 0) continue;
+                const auto watched = files.find(dir->second);
+                if (watched == files.end()) continue;
+                for (const auto& file : watched->second)
+                {
+                    if (nameOf(file) == event->name) touched.insert(file);
+                }
+            }
+        }
+        return true;
+    }
+};
+#endif
+
+}
+
+void watchFiles(const std::function<std::vector<std::string>()>& files,
+                const std::function<void(const std::set<std::string>&)>& changed)
+{
+    std::unique_ptr<Notifier> notifier;
+#ifdef __linux__
+    std::unique_ptr<Inotify> inotify(new Inotify());
+    if (inotify->valid()) notifier.reset(inotify.release());
+#endif
+    if (!notifier) notifier.reset(new Poller());
+
+    while (true)
+    {
+        // what was last processed, to tell changes from notifications about our own writes
+        const std::vector<std::string> watched = files();
+        std::map<std::string, Stamp> stamps;
+        for (const auto& file : watched) stampOf(file, stamps[file]);
+        notifier->watch(watched);
+        Log::info() << "\n* Watching " << watched.size() << " files for changes";
+        Log::flush();
+
+        std::set<std::string> modified;
+        while (modified.empty())
+        {
+            std::set<std::string> touched;
+            notifier->wait(-1, touched);
+            // wait for things to settle down
+            while (notifier->wait(DEBOUNCE_MS, touched)) {}
+            for (const auto& file : touched)
+            {
+                Stamp stamp;
+                if (stampOf(file, stamp) && stamp != stamps[file]) modified.insert(file);
+            }
+        }
+
+        const Clock::time_point start = Clock::now();
+        changed(modified);
+        const long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+        Log::info() << "\n* Bundle updated in " << elapsed << " ms";
+    }
+}
@@ -22,15 +22,34 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
  */
 
+#include <cctype>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <cstdio>
+#include <fstream>
+#include <iterator>
 #include <vector>
+#include <sys/resource.h>
 #include "Settings.h"
 
 #include "Utils.h"
 #include "DylibBundler.h"
+#include "Server.h"
+#include "MachO.h"
+#include "Log.h"
+#include "ToolBackend.h"
+#include "Verify.h"
+#include "Store.h"
+#include "Watch.h"
+#include "Archive.h"
+#include "Vfs.h"
+#include "Jobserver.h"
+#include "Delta.h"
+#include "Interrupt.h"
+#include "Journal.h"
+#include "SizeReport.h"
 
 /*
  TODO
@@ -55,21 +74,227 @@ void showHelp()
     std::cout << "dylibbundler is a utility that helps bundle dynamic libraries inside macOS app bundles.\n" << std::endl;
     
     std::cout << "-x, --fix-file <file to fix (executable or app plug-in)>" << std::endl;
+    std::cout << "--fix-files-from <file listing files to fix, separated by new lines or NUL characters, - for the standard input>" << std::endl;
+    std::cout << "--fix-bundle <app bundle> (fix every executable, plug-in and library found inside the bundle)" << std::endl;
     std::cout << "-b, --bundle-deps" << std::endl;
+    std::cout << "--rule <include|exclude|system>:<pattern> (bundle, ignore or treat as system libraries the libraries matching this pattern; the last matching rule wins)" << std::endl;
+    std::cout << "--rules-file <file> (read rules from this file, one per line)" << std::endl;
     std::cout << "-d, --dest-dir <directory to send bundled libraries (relative to cwd)>" << std::endl;
     std::cout << "-p, --install-path <'inner' path of bundled libraries (usually relative to executable, by default '@executable_path/../libs/')>" << std::endl;
     std::cout << "-s, --search-path <directory to add to list of locations searched>" << std::endl;
+    std::cout << "--search-paths-from <file listing directories to search, like --fix-files-from>" << std::endl;
+    std::cout << "--search-root <directory to search recursively for libraries that can't be found otherwise>" << std::endl;
+    std::cout << "--search-index <file> (keep the index of search roots in this file, to speed up later runs)" << std::endl;
+    std::cout << "--no-prompt (never ask where a library is, report all libraries that can't be found and fail)" << std::endl;
+    std::cout << "--thin <architecture> (only keep this architecture in bundled libraries)" << std::endl;
+    std::cout << "--strip-debug (remove debugging symbols from bundled libraries)" << std::endl;
+    std::cout << "--report-unused (report dependencies that no imported symbol is bound to)" << std::endl;
+    std::cout << "--drop-unused (remove these dependencies, and libraries only they need, from the bundle. implies --report-unused)" << std::endl;
+    std::cout << "--analyze-load-paths (report how many files dyld checks to find each dependency of the bundle)" << std::endl;
+    std::cout << "--optimize-load-paths (remove duplicate rpaths and make @rpath install names direct where they need several checks. implies --analyze-load-paths)" << std::endl;
+    std::cout << "-q, --quiet (only print warnings and errors)" << std::endl;
+    std::cout << "-v, --verbose (also print every command run)" << std::endl;
+    std::cout << "--log-json (print one JSON object per message and progress update)" << std::endl;
+    std::cout << "--verify (check that everything the fixed files and bundled libraries need resolves inside the bundle)" << std::endl;
+    std::cout << "--verify-report <file> (write the result of the verification to this file as JSON. implies --verify)" << std::endl;
+    std::cout << "--check-symbols (check that every symbol imported from a bundled library is exported by it)" << std::endl;
+    std::cout << "--size-report <file> (write the bytes and load commands of each file of the bundle, of what it loads, and of what only it loads. as JSON for a .json file, - to print it)" << std::endl;
+    std::cout << "--tool-backend <external|native> (run otool, install_name_tool... or do their work in-process)" << std::endl;
+    std::cout << "--record-trace <file> (write every tool call and its result to this file)" << std::endl;
+    std::cout << "--replay-trace <file> (answer tool calls from a recorded trace instead of running them)" << std::endl;
+    std::cout << "-j, --jobs <amount of tasks to run in parallel (by default, the number of CPUs)>" << std::endl;
+    std::cout << "--watch (keep running, and bundle again the libraries and files to fix that change)" << std::endl;
+    std::cout << "--store <directory shared between runs where processed libraries are kept and taken from>" << std::endl;
+    std::cout << "--store-size <size the store is kept under, in MB (by default, 5120)>" << std::endl;
+    std::cout << "--pipeline (copy, fix and sign each library as soon as it's found, while the crawl goes on)" << std::endl;
+    std::cout << "--max-in-flight <amount of files the pipeline may hold at once (by default, four per job); the dependency graph itself is still kept whole. implies --pipeline>" << std::endl;
+    std::cout << "--tool-timeout <seconds an external tool may run before it's killed, 0 for no limit (by default, 300)>" << std::endl;
+    std::cout << "--tool-retries <times an external tool that was killed is run again (by default, 1)>" << std::endl;
+    std::cout << "--delta-from <dest folder of a previous bundle to write an update package from, with only what changed since>" << std::endl;
+    std::cout << "--delta-output <directory the update package is written to (by default, 'delta')>" << std::endl;
+    std::cout << "--archive <file> (write the bundled libraries and fixed files to this .tar, .tar.gz, .tar.zst or .zip archive)" << std::endl;
+    std::cout << "--no-journal (don't keep the journal that lets an interrupted run resume where it stopped)" << std::endl;
+    std::cout << "--stats <file> (write the time taken, peak memory, processes launched and path lookups to this file)" << std::endl;
     std::cout << "-of, --overwrite-files (allow overwriting files in output directory)" << std::endl;
     std::cout << "-od, --overwrite-dir (totally overwrite output directory if it already exists. implies --create-dir)" << std::endl;
     std::cout << "-cd, --create-dir (creates output directory if necessary)" << std::endl;
     std::cout << "-ns, --no-codesign (disables ad-hoc codesigning)" << std::endl;
     std::cout << "-i, --ignore <location to ignore> (will ignore libraries in this directory)" << std::endl;
+    std::cout << "--ignore-from <file listing locations to ignore, like --fix-files-from>" << std::endl;
+    std::cout << "@<file> (read more arguments from this file, separated by white space and quoted like in a shell)" << std::endl;
+    std::cout << "--serve <socket> [-j <amount>] (keep running and accept jobs on this Unix domain socket, running up to <amount> at once, must be the first flag)" << std::endl;
+    std::cout << "--connect <socket> <flags...> (run the job described by the remaining flags on a server started with --serve)" << std::endl;
     std::cout << "-h, --help" << std::endl;
 }
 
-int main (int argc, char * const argv[])
+// one rule per line, blank lines and lines starting with '#' are skipped
+void addPathRulesFromFile(const char* path)
 {
-    
+    std::ifstream file(path);
+    if(!file)
+    {
+        std::cerr << "\n\nError : Cannot read rules file " << path << std::endl;
+        exit(1);
+    }
+    std::string line;
+    int line_number = 0;
+    while(std::getline(file, line))
+    {
+        line_number++;
+        const size_t start = line.find_first_not_of(" \t");
+        if(start == std::string::npos or line[start] == '#') continue;
+        line = line.substr(start, line.find_last_not_of(" \t\r") + 1 - start);
+        if(!Settings::addPathRule(line))
+        {
+            std::cerr << "\n\nError : Invalid rule '" << line << "' on line " << line_number << " of " << path << std::endl;
+            exit(1);
+        }
+    }
+}
+
+// Entries of a list given with --fix-files-from and the like, from a file or from the standard
+// input for "-": separated by NUL characters if there is any, as find -print0 writes them, or
+// else one per line.
+std::vector<std::string> readList(const char* path)
+{
+    std::ifstream file;
+    if(strcmp(path, "-") != 0)
+    {
+        file.open(path, std::ios::binary);
+        if(!file)
+        {
+            std::cerr << "\n\nError : Cannot read list " << path << std::endl;
+            exit(1);
+        }
+    }
+    std::istream& in = strcmp(path, "-") == 0 ? std::cin : file;
+    const std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    const char separator = contents.find('\0') != std::string::npos ? '\0' : '\n';
+    std::vector<std::string> entries;
+    size_t start = 0;
+    while(start < contents.size())
+    {
+        size_t end = contents.find(separator, start);
+        if(end == std::string::npos) end = contents.size();
+        std::string entry = contents.substr(start, end - start);
+        if(separator == '\n' and not entry.empty() and entry[entry.size()-1] == '\r') entry.erase(entry.size()-1);
+        if(not entry.empty()) entries.push_back(entry);
+        start = end + 1;
+    }
+    return entries;
+}
+
+// Appends the arguments in response file 'path' to 'args': separated by white space, quoted
+// with ' or " to keep it, a backslash escaping the next character outside of single quotes.
+// Response files may name others.
+void readResponseFile(const std::string& path, std::vector<std::string>& args, int depth);
+
+void addArgument(const std::string& arg, std::vector<std::string>& args, int depth)
+{
+    // not the paths dyld expands, which are often given to -p
+    const bool response_file = arg.size() > 1 and arg[0] == '@' and arg.compare(0, 6, "@rpath") != 0 and
+                               arg.compare(0, 16, "@executable_path") != 0 and arg.compare(0, 12, "@loader_path") != 0;
+    if(not response_file)
+    {
+        args.push_back(arg);
+        return;
+    }
+    if(depth == 16)
+    {
+        std::cerr << "\n\nError : Response files nested too deep at " << arg << std::endl;
+        exit(1);
+    }
+    readResponseFile(arg.substr(1), args, depth + 1);
+}
+
+void readResponseFile(const std::string& path, std::vector<std::string>& args, int depth)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file)
+    {
+        std::cerr << "\n\nError : Cannot read response file " << path << std::endl;
+        exit(1);
+    }
+    const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::string arg;
+    bool in_arg = false;
+    char quote = 0;
+    for(size_t n=0; n<contents.size(); n++)
+    {
+        const char c = contents[n];
+        if(quote == '\'' and c != '\'') arg += c;
+        else if(c == '\\' and quote != '\'' and n+1 < contents.size()) arg += contents[++n];
+        else if(c == quote) quote = 0;
+        else if(quote == 0 and (c == '\'' or c == '"'))
+        {
+            quote = c;
+            in_arg = true;
+            continue;
+        }
+        else if(quote == 0 and isspace(static_cast<unsigned char>(c)))
+        {
+            if(in_arg) addArgument(arg, args, depth);
+            arg.clear();
+            in_arg = false;
+            continue;
+        }
+        else arg += c;
+        in_arg = true;
+    }
+    if(quote != 0)
+    {
+        std::cerr << "\n\nError : Unterminated quote in response file " << path << std::endl;
+        exit(1);
+    }
+    if(in_arg) addArgument(arg, args, depth);
+}
+
+// one "name value" line per figure, for scripts and benchmarks to read
+void writeStats(const std::chrono::steady_clock::time_point& start)
+{
+    const long long wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    const long long peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+    const long long peak_rss_kb = usage.ru_maxrss;
+#endif
+
+    std::ofstream file(Settings::statsFile().c_str());
+    file << "wall_ms " << wall_ms << "\n";
+    file << "peak_rss_kb " << peak_rss_kb << "\n";
+    file << "process_launches " << tools().processLaunches() << "\n";
+    file << "path_lookups " << Vfs::lookups() << "\n";
+    // the lookups that made system calls
+    file << "path_syscalls " << (Vfs::lookups() - Vfs::hits()) << "\n";
+    if(!file)
+    {
+        std::cerr << "\n\nError : Cannot write stats file " << Settings::statsFile() << std::endl;
+        exit(1);
+    }
+}
+
+int bundle(int argc, char * const argv[])
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::string> bundles_to_fix;
+
+    // @file arguments are replaced by those in the file, for more than a command line can hold
+    std::vector<std::string> args;
+    for(int i=0; i<argc; i++)
+    {
+        if(i == 0) args.push_back(argv[i]);
+        else addArgument(argv[i], args, 0);
+    }
+    std::vector<char*> arg_pointers;
+    for(auto& arg : args) arg_pointers.push_back(&arg[0]);
+    arg_pointers.push_back(NULL);
+    argc = args.size();
+    argv = arg_pointers.data();
+
     // parse arguments    
     for(int i=0; i<argc; i++)
     {
@@ -79,6 +304,18 @@ int main (int argc, char * const argv[])
             Settings::addFileToFix(argv[i]);
             continue;
         }
+        else if(strcmp(argv[i],"--fix-files-from")==0)
+        {
+            i++;
+            for(const auto& file : readList(argv[i])) Settings::addFileToFix(file);
+            continue;
+        }
+        else if(strcmp(argv[i],"--fix-bundle")==0)
+        {
+            i++;
+            bundles_to_fix.push_back(argv[i]);
+            continue;
+        }
         else if(strcmp(argv[i],"-b")==0 or strcmp(argv[i],"--bundle-deps")==0)
         {
             Settings::bundleLibs(true);
@@ -96,6 +333,28 @@ int main (int argc, char * const argv[])
             Settings::ignore_prefix(argv[i]);
             continue;
         }
+        else if(strcmp(argv[i],"--ignore-from")==0)
+        {
+            i++;
+            for(const auto& prefix : readList(argv[i])) Settings::ignore_prefix(prefix);
+            continue;
+        }
+        else if(strcmp(argv[i],"--rule")==0)
+        {
+            i++;
+            if(!Settings::addPathRule(argv[i]))
+            {
+                std::cerr << "Invalid rule " << argv[i] << ", expected include:<pattern>, exclude:<pattern> or system:<pattern>" << std::endl;
+                exit(1);
+            }
+            continue;
+        }
+        else if(strcmp(argv[i],"--rules-file")==0)
+        {
+            i++;
+            addPathRulesFromFile(argv[i]);
+            continue;
+        }
         else if(strcmp(argv[i],"-d")==0 or strcmp(argv[i],"--dest-dir")==0)
         {
             i++;
@@ -134,6 +393,206 @@ int main (int argc, char * const argv[])
             Settings::addSearchPath(argv[i]);
             continue;
         }
+        else if(strcmp(argv[i],"--search-paths-from")==0)
+        {
+            i++;
+            for(const auto& path : readList(argv[i])) Settings::addSearchPath(path);
+            continue;
+        }
+        else if(strcmp(argv[i],"--search-root")==0)
+        {
+            i++;
+            Settings::addSearchRoot(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--search-index")==0)
+        {
+            i++;
+            Settings::searchIndexFile(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--no-prompt")==0)
+        {
+            Settings::canPrompt(false);
+            continue;
+        }
+        else if(strcmp(argv[i],"--thin")==0)
+        {
+            i++;
+            if(MachO::cpuTypeFromName(argv[i]) == 0)
+            {
+                std::cerr << "Unknown architecture " << argv[i] << std::endl;
+                exit(1);
+            }
+            Settings::thinArch(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--strip-debug")==0)
+        {
+            Settings::stripDebug(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--report-unused")==0)
+        {
+            Settings::reportUnused(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--drop-unused")==0)
+        {
+            Settings::reportUnused(true);
+            Settings::dropUnused(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--analyze-load-paths")==0)
+        {
+            Settings::analyzeLoadPaths(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--optimize-load-paths")==0)
+        {
+            Settings::analyzeLoadPaths(true);
+            Settings::optimizeLoadPaths(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"-q")==0 or strcmp(argv[i],"--quiet")==0)
+        {
+            Log::level(Log::QUIET);
+            continue;
+        }
+        else if(strcmp(argv[i],"-v")==0 or strcmp(argv[i],"--verbose")==0)
+        {
+            Log::level(Log::VERBOSE);
+            continue;
+        }
+        else if(strcmp(argv[i],"--log-json")==0)
+        {
+            Log::json(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--verify")==0)
+        {
+            Settings::verify(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--check-symbols")==0)
+        {
+            Settings::checkSymbols(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--size-report")==0)
+        {
+            i++;
+            Settings::sizeReport(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--verify-report")==0)
+        {
+            i++;
+            Settings::verify(true);
+            Settings::verifyReport(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--tool-backend")==0)
+        {
+            i++;
+            if(strcmp(argv[i],"external")!=0 and strcmp(argv[i],"native")!=0)
+            {
+                std::cerr << "Unknown tool backend " << argv[i] << std::endl;
+                exit(1);
+            }
+            Settings::toolBackend(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--record-trace")==0)
+        {
+            i++;
+            Settings::recordTrace(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--replay-trace")==0)
+        {
+            i++;
+            Settings::replayTrace(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"-j")==0 or strcmp(argv[i],"--jobs")==0)
+        {
+            i++;
+            Settings::jobs(atoi(argv[i]));
+            continue;
+        }
+        else if(strcmp(argv[i],"--watch")==0)
+        {
+            Settings::watch(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--store")==0)
+        {
+            i++;
+            std::string path = argv[i];
+            while(path.size() > 1 and path[path.size()-1] == '/') path.erase(path.size()-1);
+            Settings::store(path);
+            continue;
+        }
+        else if(strcmp(argv[i],"--store-size")==0)
+        {
+            i++;
+            Settings::storeSize(strtoull(argv[i], NULL, 10) << 20);
+            continue;
+        }
+        else if(strcmp(argv[i],"--pipeline")==0)
+        {
+            Settings::pipeline(true);
+            continue;
+        }
+        else if(strcmp(argv[i],"--max-in-flight")==0)
+        {
+            i++;
+            Settings::pipeline(true);
+            Settings::maxInFlight(atoi(argv[i]));
+            continue;
+        }
+        else if(strcmp(argv[i],"--tool-timeout")==0)
+        {
+            i++;
+            Settings::toolTimeout(atoi(argv[i]));
+            continue;
+        }
+        else if(strcmp(argv[i],"--tool-retries")==0)
+        {
+            i++;
+            Settings::toolRetries(atoi(argv[i]));
+            continue;
+        }
+        else if(strcmp(argv[i],"--delta-from")==0)
+        {
+            i++;
+            Settings::deltaFrom(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--delta-output")==0)
+        {
+            i++;
+            Settings::deltaOutput(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--archive")==0)
+        {
+            i++;
+            Settings::archive(argv[i]);
+            continue;
+        }
+        else if(strcmp(argv[i],"--no-journal")==0)
+        {
+            Settings::journal(false);
+            continue;
+        }
+        else if(strcmp(argv[i],"--stats")==0)
+        {
+            i++;
+            Settings::statsFile(argv[i]);
+            continue;
+        }
         else if(i>0)
         {
             // if we meet an unknown flag, abort
@@ -144,20 +603,120 @@ int main (int argc, char * const argv[])
         }
     }
     
+    selectTools();
+    Interrupt::install();
+    Jobserver::connect();
+
+    // done after parsing all arguments, since the dest folder is excluded
+    for(const auto& bundle_to_fix : bundles_to_fix)
+        addFilesToFixFromBundle(bundle_to_fix);
+
     if(not Settings::bundleLibs() and Settings::fileToFixAmount()<1)
     {
         showHelp();
         exit(0);
     }
     
-    std::cout << "* Collecting dependencies"; fflush(stdout);
+    Log::start();
+    Log::info() << "* Collecting dependencies";
+    
+    if(Settings::pipeline() and Settings::reportUnused())
+    {
+        // finding unused dependencies needs the whole graph before anything is fixed
+        std::cerr << "\n/!\\ WARNING : --pipeline can't be used with --report-unused or --drop-unused, ignoring it" << std::endl;
+        Settings::pipeline(false);
+    }
+    
+    if(not Settings::deltaFrom().empty() and (not Settings::bundleLibs() or Archive::replacesFiles()))
+    {
+        // it compares the dest folder on disk
+        std::cerr << "\n/!\\ WARNING : --delta-from needs -b, and the external tools with --archive, ignoring it" << std::endl;
+        Settings::deltaFrom("");
+    }
+    
+    if(Archive::enabled())
+    {
+        if(Settings::watch())
+        {
+            std::cerr << "\n/!\\ WARNING : --watch can't be used with --archive, ignoring it" << std::endl;
+            Settings::watch(false);
+        }
+        if(Settings::optimizeLoadPaths())
+        {
+            // it would change files already in the archive
+            std::cerr << "\n/!\\ WARNING : --optimize-load-paths can't be used with --archive, ignoring it" << std::endl;
+            Settings::optimizeLoadPaths(false);
+        }
+        if(Archive::replacesFiles() and (Settings::analyzeLoadPaths() or Settings::verify() or Settings::checkSymbols() or not Settings::sizeReport().empty()))
+        {
+            // they look at the bundle on disk, and nothing is written there
+            std::cerr << "\n/!\\ WARNING : --analyze-load-paths, --verify, --check-symbols and --size-report need the external tools with --archive, ignoring them" << std::endl;
+            Settings::analyzeLoadPaths(false);
+            Settings::verify(false);
+            Settings::checkSymbols(false);
+            Settings::sizeReport("");
+        }
+        Archive::open();
+    }
     
-    const int amount = Settings::fileToFixAmount();
-    for(int n=0; n<amount; n++)
-        collectDependencies(Settings::fileToFix(n));
+    // before the files to fix are read, as it puts back those the interrupted run was fixing
+    if(Journal::enabled()) Journal::resume();
     
-    collectSubDependencies();
-    doneWithDeps_go();
+    if(Settings::pipeline())
+    {
+        collectAndBundle();
+        if(reportUnresolvedLibraries() > 0) exit(1);
+    }
+    else
+    {
+        const int amount = Settings::fileToFixAmount();
+        for(int n=0; n<amount; n++)
+            collectDependencies(Settings::fileToFix(n));
+        
+        collectSubDependencies();
+        Log::progressDone();
+        if(reportUnresolvedLibraries() > 0) exit(1);
+        if(Settings::reportUnused()) analyzeDependencyUsage();
+        doneWithDeps_go();
+    }
+    Store::finish();
+    if(Archive::enabled()) Archive::close();
+    Journal::finish();
+    if(not Settings::deltaFrom().empty()) Delta::write();
+    if(Settings::analyzeLoadPaths()) analyzeLoadPaths();
+    if(not Settings::sizeReport().empty()) reportBundleSizes();
+    // both run before failing, so that problems found by one don't hide those of the other
+    const bool unverified = Settings::verify() and verifyBundle() > 0;
+    const bool unresolved = Settings::checkSymbols() and checkBundleSymbols() > 0;
+    if(unverified) std::cerr << "\n\nError : The bundle failed verification" << std::endl;
+    if(unresolved) std::cerr << "\n\nError : The bundle has unresolved symbols" << std::endl;
+    if(unverified or unresolved) return 2;
+    Log::verbose() << "\n* " << tools().processLaunches() << " processes launched with the " << tools().name() << " tools";
+    Log::verbose() << "* " << Vfs::lookups() << " paths looked up, " << Vfs::hits() << " of them answered from memory";
+    if(not Settings::statsFile().empty()) writeStats(start);
+    if(Settings::watch())
+    {
+        // what is written again is what we wrote
+        Settings::canOverwriteFiles(true);
+        watchFiles(watchedFiles, rebundleChangedFiles);
+    }
     
     return 0;
 }
+
+int main (int argc, char * const argv[])
+{
+    if(argc > 2 and strcmp(argv[1],"--serve")==0)
+    {
+        // how many jobs run at once, by default as many as there are CPUs
+        const bool capped = argc > 4 and (strcmp(argv[3],"-j")==0 or strcmp(argv[3],"--jobs")==0);
+        const int max_jobs = capped ? atoi(argv[4]) : Settings::jobs();
+        runServer(argv[2], max_jobs > 0 ? max_jobs : 1, bundle);
+        return 1;
+    }
+    if(argc > 2 and strcmp(argv[1],"--connect")==0)
+    {
+        return runClient(argv[2], argc-3, argv+3);
+    }
+    return bundle(argc, argv);
+}
@@ -0,0 +1,258 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#include "Fixture.h"
+
+namespace Fixture
+{
+
+namespace
+{
+
+const uint32_t LINKEDIT_ALIGN = 16;
+
+void put32(std::string& out, uint32_t value)
+{
+    for (int n = 0; n < 4; n++) out += char((value >> (8 * n)) & 0xff);
+}
+
+void put64(std::string& out, uint64_t value)
+{
+    put32(out, uint32_t(value));
+    put32(out, uint32_t(value >> 32));
+}
+
+void putBig32(std::string& out, uint32_t value)
+{
+    for (int n = 3; n >= 0; n--) out += char((value >> (8 * n)) & 0xff);
+}
+
+void putName(std::string& out, const char* name)
+{
+    std::string padded(name);
+    padded.resize(16, '\0');
+    out += padded;
+}
+
+// the string, terminated and padded so that the command stays 8-byte aligned
+std::string commandString(const std::string& value, size_t fixed_size)
+{
+    std::string out = value;
+    do out += '\0'; while ((fixed_size + out.size()) % 8 != 0);
+    return out;
+}
+
+std::string dylibCommand(uint32_t cmd, const std::string& name)
+{
+    const std::string text = commandString(name, 24);
+    std::string out;
+    put32(out, cmd);
+    put32(out, uint32_t(24 + text.size()));
+    put32(out, 24);
+    put32(out, 2);
+    put32(out, 0x10000);
+    put32(out, 0x10000);
+    return out + text;
+}
+
+std::string rpathCommand(const std::string& path)
+{
+    const std::string text = commandString(path, 12);
+    std::string out;
+    put32(out, MachO::LC_RPATH);
+    put32(out, uint32_t(12 + text.size()));
+    put32(out, 12);
+    return out + text;
+}
+
+std::string segmentCommand(const char* name, uint64_t address, uint64_t size, uint64_t file_offset, uint64_t file_size,
+                           uint32_t protection, bool with_text)
+{
+    std::string out;
+    put32(out, MachO::LC_SEGMENT_64);
+    put32(out, with_text ? 72 + 80 : 72);
+    putName(out, name);
+    put64(out, address);
+    put64(out, size);
+    put64(out, file_offset);
+    put64(out, file_size);
+    put32(out, protection);
+    put32(out, protection);
+    put32(out, with_text ? 1 : 0);
+    put32(out, 0);
+    if (with_text)
+    {
+        putName(out, "__text");
+        putName(out, name);
+        put64(out, TEXT_OFFSET);
+        put64(out, file_size - TEXT_OFFSET);
+        put32(out, TEXT_OFFSET);
+        put32(out, 4);
+        for (int n = 0; n < 2; n++) put32(out, 0);
+        put32(out, 0x80000400);
+        for (int n = 0; n < 3; n++) put32(out, 0);
+    }
+    return out;
+}
+
+std::string pad(std::string data, size_t alignment)
+{
+    while (data.size() % alignment != 0) data += '\0';
+    return data;
+}
+
+}
+
+Symbol undefined(const std::string& name, int ordinal)
+{
+    return Symbol{ name, 0x01, 0, uint16_t(ordinal << 8) };  // N_UNDF | N_EXT
+}
+
+Symbol defined(const std::string& name)
+{
+    return Symbol{ name, 0x0f, 1, 0 };  // N_SECT | N_EXT
+}
+
+Symbol stab(const std::string& name)
+{
+    return Symbol{ name, 0x24, 1, 0 };  // N_FUN
+}
+
+std::string bind(const std::string& name, int ordinal)
+{
+    std::string out;
+    out += char(0x10 | ordinal);  // BIND_OPCODE_SET_DYLIB_ORDINAL_IMM
+    out += char(0x40);            // BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM
+    out += name;
+    out += '\0';
+    out += char(0x51);            // BIND_OPCODE_SET_TYPE_IMM, a pointer
+    out += char(0x71);            // BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB, in __LINKEDIT
+    out += char(0x00);
+    out += char(0x90);            // BIND_OPCODE_DO_BIND
+    out += char(0x00);            // BIND_OPCODE_DONE
+    return out;
+}
+
+std::string image(const Image& image)
+{
+    const uint32_t linkedit_offset = TEXT_OFFSET + image.code_pages * PAGE_SIZE;
+    const uint64_t text_size = (uint64_t(linkedit_offset) + 0x3fff) & ~uint64_t(0x3fff);
+
+    // __LINKEDIT: bind opcodes, symbols, then their names
+    const std::string binds = pad(image.binds, 8);
+    std::string symbols;
+    std::string strings(2, '\0');
+    for (const Symbol& symbol : image.symbols)
+    {
+        put32(symbols, uint32_t(strings.size()));
+        symbols += char(symbol.type);
+        symbols += char(symbol.sect);
+        symbols += char(symbol.desc & 0xff);
+        symbols += char(symbol.desc >> 8);
+        put64(symbols, symbol.sect != 0 ? TEXT_OFFSET : 0);
+        strings += symbol.name;
+        strings += '\0';
+    }
+    strings = pad(strings, LINKEDIT_ALIGN);
+    const uint32_t symoff = linkedit_offset + uint32_t(binds.size());
+    const uint32_t stroff = symoff + uint32_t(symbols.size());
+    const std::string linkedit = binds + symbols + strings;
+
+    std::vector<std::string> commands;
+    commands.push_back(segmentCommand("__TEXT", 0, text_size, 0, linkedit_offset, 5, true));
+    commands.push_back(segmentCommand("__LINKEDIT", text_size, 0x4000, linkedit_offset, linkedit.size(), 1, false));
+    if (!image.id.empty()) commands.push_back(dylibCommand(MachO::LC_ID_DYLIB, image.id));
+    for (const std::string& dependency : image.dependencies) commands.push_back(dylibCommand(MachO::LC_LOAD_DYLIB, dependency));
+    for (const std::string& rpath : image.rpaths) commands.push_back(rpathCommand(rpath));
+    if (!binds.empty())
+    {
+        std::string dyld_info;
+        put32(dyld_info, MachO::LC_DYLD_INFO_ONLY);
+        put32(dyld_info, 48);
+        for (int n = 0; n < 2; n++) put32(dyld_info, 0);
+        put32(dyld_info, linkedit_offset);
+        put32(dyld_info, uint32_t(image.binds.size()));
+        for (int n = 0; n < 6; n++) put32(dyld_info, 0);
+        commands.push_back(dyld_info);
+    }
+
+    std::string symtab;
+    put32(symtab, MachO::LC_SYMTAB);
+    put32(symtab, 24);
+    put32(symtab, symoff);
+    put32(symtab, uint32_t(image.symbols.size()));
+    put32(symtab, stroff);
+    put32(symtab, uint32_t(strings.size()));
+    commands.push_back(symtab);
+    std::string dysymtab;
+    put32(dysymtab, MachO::LC_DYSYMTAB);
+    put32(dysymtab, 80);
+    dysymtab.resize(80, '\0');
+    commands.push_back(dysymtab);
+
+    std::string command_bytes;
+    for (const std::string& command : commands) command_bytes += command;
+
+    std::string out;
+    put32(out, MachO::MH_MAGIC_64);
+    put32(out, image.cputype);
+    put32(out, image.cputype == MachO::CPU_TYPE_X86_64 ? 3 : 0);
+    put32(out, image.filetype);
+    put32(out, uint32_t(commands.size()));
+    put32(out, uint32_t(command_bytes.size()));
+    put32(out, MachO::MH_TWOLEVEL | 0x5);
+    put32(out, 0);
+    out += command_bytes;
+    if (out.size() > TEXT_OFFSET) return "";
+
+    out.resize(TEXT_OFFSET, '\0');
+    for (uint32_t seed = image.seed; out.size() < linkedit_offset; seed = seed * 1103515245 + 12345) put32(out, seed);
+    return out + linkedit;
+}
+
+std::string fat(const std::vector<std::string>& slices)
+{
+    const uint32_t ALIGN = 14;
+    std::string out;
+    putBig32(out, MachO::FAT_MAGIC);
+    putBig32(out, uint32_t(slices.size()));
+    uint32_t offset = 1 << ALIGN;
+    for (const std::string& slice : slices)
+    {
+        putBig32(out, MachO::read32(slice, 4));
+        putBig32(out, MachO::read32(slice, 8));
+        putBig32(out, offset);
+        putBig32(out, uint32_t(slice.size()));
+        putBig32(out, ALIGN);
+        offset = (offset + uint32_t(slice.size()) + (1 << ALIGN) - 1) & ~((1u << ALIGN) - 1);
+    }
+    for (const std::string& slice : slices)
+    {
+        out = pad(out, 1 << ALIGN);
+        out += slice;
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef _fixture_h_
+#define _fixture_h_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MachO.h"
+
+// Generated Mach-O files, shared by the tests and the benchmarks: laid out like the linker
+// does, with code after some room for the load commands and __LINKEDIT last, but with only
+// what dylibbundler reads in them.
+namespace Fixture
+{
+
+// where the load commands end at the latest, and the code starts
+const uint32_t TEXT_OFFSET = 0x3000;
+const uint32_t PAGE_SIZE = 0x1000;
+
+// an nlist entry of the symbol table
+struct Symbol
+{
+    std::string name;
+    uint8_t type;
+    uint8_t sect;
+    uint16_t desc;
+};
+
+// imported from the dependency 'ordinal' (1-based), through the symbol table
+Symbol undefined(const std::string& name, int ordinal);
+// defined in the code, and exported
+Symbol defined(const std::string& name);
+// a debugging symbol (STABS), only there for debuggers
+Symbol stab(const std::string& name);
+
+// bind opcodes binding 'name' to dependency 'ordinal' (1-based), for Image::binds
+std::string bind(const std::string& name, int ordinal);
+
+struct Image
+{
+    uint32_t filetype = MachO::MH_DYLIB;
+    uint32_t cputype = MachO::CPU_TYPE_ARM64;
+    std::string id;   // for a library
+    std::vector<std::string> dependencies;
+    std::vector<std::string> rpaths;
+    std::vector<Symbol> symbols;
+    std::string binds;  // bind opcodes, in LC_DYLD_INFO_ONLY if there are any
+    uint32_t code_pages = 1;
+    uint32_t seed = 0;  // code differs from seed to seed, so no two files are the same
+};
+
+// the file, or an empty string if the load commands don't fit before the code
+std::string image(const Image& image);
+
+// a universal file made of the given thin files
+std::string fat(const std::vector<std::string>& slices);
+
+}
+
+#endif
@@ -0,0 +1,904 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Marianne Gagnon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+// Regression tests: each one sets up files in a directory of its own, runs dylibbundler or a
+// part of it on them, and checks the outcome. Run as "dylibbundler-tests --dylibbundler <path>
+// <test>"; the exit status says whether the test passed.
+
+#include "Archive.h"
+#include "CodeSign.h"
+#include "Delta.h"
+#include "Fixture.h"
+#include "MachO.h"
+#include "PathRules.h"
+#include "Settings.h"
+#include "Sha256.h"
+#include "Symbols.h"
+#include "ToolBackend.h"
+#include "UnusedDependencies.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace
+{
+
+// ---- generated Mach-O files ----
+
+// a library with the given id, or an executable without one, depending on 'dependencies'
+std::string image(uint32_t filetype, const std::string& id, const std::vector<std::string>& dependencies, uint32_t code_pages)
+{
+    Fixture::Image image;
+    image.filetype = filetype;
+    image.id = id;
+    image.dependencies = dependencies;
+    image.code_pages = code_pages;
+    image.seed = uint32_t(id.size());
+    return Fixture::image(image);
+}
+
+// ---- files and processes ----
+
+struct Options
+{
+    std::string dylibbundler;
+    std::string root;
+};
+
+bool writeFile(const std::string& path, const std::string& contents)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file << contents;
+    return bool(file);
+}
+
+std::string readFile(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+bool makeDirectories(const std::string& path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+    {
+        const std::string part = path.substr(0, slash);
+        if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
+
+int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+bool isEmptyDirectory(const std::string& path)
+{
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return false;
+    bool empty = true;
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) empty = false;
+    }
+    closedir(dir);
+    return empty;
+}
+
+// runs dylibbundler in 'directory' with 'arguments', its output going to 'log'
+int runDylibbundler(const Options& options, const std::string& directory, const std::vector<std::string>& arguments)
+{
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        const int log = open((options.root + "/log").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (chdir(directory.c_str()) != 0 || log < 0) _exit(127);
+        dup2(log, 1);
+        dup2(log, 2);
+        std::vector<char*> args(1, const_cast<char*>(options.dylibbundler.c_str()));
+        for (const std::string& argument : arguments) args.push_back(const_cast<char*>(argument.c_str()));
+        args.push_back(nullptr);
+        execv(args[0], args.data());
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+bool fail(const Options& options, const std::string& message)
+{
+    std::ifstream log((options.root + "/log").c_str());
+    if (log) std::cerr << log.rdbuf();
+    std::cerr << "\n\nError : " << message << ", see " << options.root << std::endl;
+    return false;
+}
+
+// ---- the tests ----
+
+// A trace recorded anywhere replays in an empty directory, with the journal at its default,
+// as nothing is written to disk when replaying.
+bool replayWithJournal(const Options& options)
+{
+    const std::string lib = options.root + "/lib/";
+    if (!makeDirectories(options.root + "/lib") || !makeDirectories(options.root + "/app/Contents/MacOS") ||
+        !makeDirectories(options.root + "/elsewhere") ||
+        !writeFile(lib + "libA.dylib", image(MachO::MH_DYLIB, lib + "libA.dylib", std::vector<std::string>(), 1)) ||
+        !writeFile(options.root + "/app/Contents/MacOS/exe", image(MachO::MH_EXECUTE, "", std::vector<std::string>(1, lib + "libA.dylib"), 1)))
+    {
+        return fail(options, "Cannot generate the files");
+    }
+
+    const std::string trace = options.root + "/trace";
+    const std::vector<std::string> arguments = { "-b", "-cd", "-od", "--no-prompt", "-x", "app/Contents/MacOS/exe",
+                                                 "-d", "app/Contents/Frameworks", "--tool-backend", "native" };
+    std::vector<std::string> recording = arguments;
+    recording.push_back("--record-trace");
+    recording.push_back(trace);
+    if (runDylibbundler(options, options.root, recording) != 0) return fail(options, "Recording the trace failed");
+
+    std::vector<std::string> replaying = arguments;
+    replaying.push_back("--replay-trace");
+    replaying.push_back(trace);
+    if (runDylibbundler(options, options.root + "/elsewhere", replaying) != 0) return fail(options, "Replaying the trace failed");
+    if (!isEmptyDirectory(options.root + "/elsewhere")) return fail(options, "Replaying the trace wrote files");
+    return true;
+}
+
+uint32_t readBig32(const std::string& data, size_t offset)
+{
+    if (offset + 4 > data.size()) return 0;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data() + offset);
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// amount of pages whose hash in the code directory of 'slice' isn't theirs, -1 without one
+int badPageHashes(const MachO::Slice& slice)
+{
+    const int command = MachO::findCommand(slice, MachO::LC_CODE_SIGNATURE);
+    if (command < 0) return -1;
+    const uint32_t offset = MachO::read32(slice.data, slice.commands[command].offset + 8);
+    const std::string signature = slice.data.substr(offset);
+    const std::string cd = signature.substr(readBig32(signature, 16)); // the first blob
+    const uint32_t hash_offset = readBig32(cd, 16);
+    const uint32_t pages = readBig32(cd, 28);
+    const uint32_t code_limit = readBig32(cd, 32);
+    if (readBig32(cd, 0) != 0xfade0c02 || code_limit != offset) return -1;
+    int bad = 0;
+    for (uint32_t page = 0; page < pages; page++)
+    {
+        const uint32_t start = page * 0x1000;
+        const uint32_t size = code_limit - start < 0x1000 ? code_limit - start : 0x1000;
+        if (Sha256::digest(slice.data.data() + start, size) != cd.substr(hash_offset + page * 32, 32)) bad++;
+    }
+    return bad;
+}
+
+// A library changed after it was signed, in a page the edits leave alone, is hashed again in
+// full when signed again, rather than keeping the wrong hash of that page: in a small library,
+// and in one large enough that a check of only some of its pages could miss it.
+bool resignStaleSignature(const Options& options)
+{
+    for (uint32_t code_pages : { 8u, 200u })
+    {
+        const std::string size = std::to_string(code_pages) + " pages";
+        MachO::File file;
+        if (!file.parse(image(MachO::MH_DYLIB, "/usr/local/lib/libstale.dylib", std::vector<std::string>(), code_pages)) ||
+            !CodeSign::adhocSign(file, "libstale"))
+        {
+            return fail(options, "Cannot sign the generated library of " + size);
+        }
+        if (badPageHashes(file.slice(0)) != 0) return fail(options, "The first signature of " + size + " is wrong");
+
+        // changed after it was signed, in a page the edit below leaves alone
+        file.slice(0).data[Fixture::TEXT_OFFSET + 2 * Fixture::PAGE_SIZE + 7] ^= 0xff;
+        MachO::File stale;
+        if (!stale.parse(file.serialize())) return fail(options, "Cannot read the stale library of " + size);
+        if (badPageHashes(stale.slice(0)) != 1) return fail(options, "The library of " + size + " wasn't made stale");
+
+        const CodeSign::Snapshot before = CodeSign::snapshot(stale);
+        if (!MachO::replaceCommandString(stale.slice(0), MachO::findCommand(stale.slice(0), MachO::LC_ID_DYLIB), "@executable_path/../Frameworks/libstale.dylib") ||
+            !stale.reparse(0) || !CodeSign::adhocSign(stale, "libstale", before))
+        {
+            return fail(options, "Cannot edit and sign the stale library of " + size);
+        }
+        const int bad = badPageHashes(stale.slice(0));
+        if (bad != 0) return fail(options, "Signing the stale library of " + size + " again left " + std::to_string(bad) + " wrong page hashes");
+    }
+    return true;
+}
+
+// Flags come from a response file, quoted like in a shell, and files to fix from a list, where
+// a file also given through another path is only fixed once.
+bool responseFiles(const Options& options)
+{
+    const std::string lib = options.root + "/lib/";
+    const std::string macos = options.root + "/app/Contents/MacOS/";
+    const std::string dependencies = lib + "libA.dylib";
+    if (!makeDirectories(options.root + "/lib") || !makeDirectories(options.root + "/app/Contents/MacOS") ||
+        !writeFile(lib + "libA.dylib", image(MachO::MH_DYLIB, lib + "libA.dylib", std::vector<std::string>(), 1)) ||
+        !writeFile(macos + "one", image(MachO::MH_EXECUTE, "", std::vector<std::string>(1, dependencies), 1)) ||
+        !writeFile(macos + "two", image(MachO::MH_EXECUTE, "", std::vector<std::string>(1, dependencies), 2)) ||
+        !writeFile(options.root + "/arguments", "-b -cd -od --no-prompt --tool-backend native\n"
+                                                "-d 'app/Contents/Shared Libraries' -p \"@executable_path/../Shared Libraries/\"\n"
+                                                "-x app/Contents/MacOS/one --fix-files-from files\n") ||
+        !writeFile(options.root + "/files", std::string("app/Contents/MacOS/two\0app/Contents/MacOS/../MacOS/one\0", 56)))
+    {
+        return fail(options, "Cannot generate the files");
+    }
+
+    if (runDylibbundler(options, options.root, std::vector<std::string>(1, "@arguments")) != 0) return fail(options, "Bundling failed");
+    struct stat st;
+    if (stat((options.root + "/app/Contents/Shared Libraries/libA.dylib").c_str(), &st) != 0)
+    {
+        return fail(options, "The library wasn't bundled to the quoted directory");
+    }
+    for (const char* name : { "one", "two" })
+    {
+        MachO::File file;
+        if (!file.load(macos + name) || file.slice(0).dylibs.size() != 1 ||
+            file.slice(0).dylibs[0].name != "@executable_path/../Shared Libraries/libA.dylib")
+        {
+            return fail(options, std::string("The dependency of ") + name + " wasn't fixed");
+        }
+    }
+    const std::string log = readFile(options.root + "/log");
+    const std::string processing = "* Processing app/Contents/MacOS/";
+    size_t processed = 0;
+    for (size_t at = log.find(processing); at != std::string::npos; at = log.find(processing, at + 1)) processed++;
+    if (processed != 2) return fail(options, std::to_string(processed) + " files were fixed instead of 2");
+    return true;
+}
+
+// Dependencies nothing binds to are found and removed, and what was bound to the dependencies
+// after them is renumbered, in the symbol table as in the bind opcodes.
+bool dropUnused(const Options& options)
+{
+    Fixture::Image exe;
+    exe.filetype = MachO::MH_EXECUTE;
+    exe.dependencies = { "/opt/lib/libA.dylib", "/opt/lib/libB.dylib", "/opt/lib/libC.dylib" };
+    exe.symbols = { Fixture::undefined("_a", 1), Fixture::undefined("_c", 3) };
+    exe.binds = Fixture::bind("_bound_c", 3);
+    const std::string path = options.root + "/exe";
+    if (!writeFile(path, Fixture::image(exe))) return fail(options, "Cannot generate the files");
+
+    DependencyUsage usage;
+    if (!findDependencyUsage(path, [](const std::string& name) { return name; }, usage))
+    {
+        return fail(options, "Cannot read the executable");
+    }
+    if (usage.unused != std::set<std::string>{ "/opt/lib/libB.dylib" }) return fail(options, "libB wasn't the only one found unused");
+    removeDependencies(path, usage.unused);
+
+    MachO::File file;
+    if (!file.load(path)) return fail(options, "Cannot read the edited executable");
+    const MachO::Slice& slice = file.slice(0);
+    if (slice.dylibs.size() != 2 || slice.dylibs[0].name != "/opt/lib/libA.dylib" || slice.dylibs[1].name != "/opt/lib/libC.dylib")
+    {
+        return fail(options, "libB wasn't removed");
+    }
+    std::vector<Symbols::Import> imports;
+    Symbols::readImports(slice, imports);
+    std::map<std::string, int> ordinals;
+    for (const Symbols::Import& import : imports) ordinals[import.name] = import.ordinal;
+    const std::map<std::string, int> expected = { { "_a", 1 }, { "_c", 2 }, { "_bound_c", 2 } };
+    if (imports.size() != 3 || ordinals != expected) return fail(options, "The imports weren't renumbered");
+    return true;
+}
+
+// Universal libraries are copied as the one architecture asked for, without debugging symbols,
+// and still validly signed.
+bool thinAndStrip(const Options& options)
+{
+    const std::string lib = options.root + "/lib/";
+    Fixture::Image arm64;
+    arm64.id = lib + "libfat.dylib";
+    arm64.symbols = { Fixture::stab("/src/fat.c"), Fixture::defined("_fat"), Fixture::stab("_fat") };
+    arm64.code_pages = 2;
+    Fixture::Image x86_64 = arm64;
+    x86_64.cputype = MachO::CPU_TYPE_X86_64;
+    x86_64.seed = 1;
+    if (!makeDirectories(options.root + "/lib") || !makeDirectories(options.root + "/app/Contents/MacOS") ||
+        !writeFile(lib + "libfat.dylib", Fixture::fat({ Fixture::image(x86_64), Fixture::image(arm64) })) ||
+        !writeFile(options.root + "/app/Contents/MacOS/exe", image(MachO::MH_EXECUTE, "", std::vector<std::string>(1, lib + "libfat.dylib"), 1)))
+    {
+        return fail(options, "Cannot generate the files");
+    }
+
+    const std::vector<std::string> arguments = { "-b", "-cd", "-od", "--no-prompt", "-x", "app/Contents/MacOS/exe",
+                                                 "-d", "app/Contents/Frameworks", "--tool-backend", "native",
+                                                 "--thin", "arm64", "--strip-debug" };
+    if (runDylibbundler(options, options.root, arguments) != 0) return fail(options, "Bundling failed");
+
+    MachO::File file;
+    if (!file.load(options.root + "/app/Contents/Frameworks/libfat.dylib")) return fail(options, "Cannot read the bundled library");
+    if (file.isFat() || file.sliceAmount() != 1 || file.slice(0).cputype != MachO::CPU_TYPE_ARM64)
+    {
+        return fail(options, "The bundled library isn't thin arm64");
+    }
+    const MachO::Slice& slice = file.slice(0);
+    const int symtab = MachO::findCommand(slice, MachO::LC_SYMTAB);
+    std::vector<std::string> exports;
+    Symbols::readExports(slice, exports);
+    if (symtab < 0 || MachO::read32(slice.data, slice.commands[symtab].offset + 12) != 1 ||
+        exports != std::vector<std::string>(1, "_fat"))
+    {
+        return fail(options, "The debugging symbols weren't the only ones removed");
+    }
+    if (badPageHashes(slice) != 0) return fail(options, "The bundled library isn't validly signed");
+    return true;
+}
+
+// An rpath is changed in every slice of a universal file, and only its first occurrence in each.
+bool changeRpathInEverySlice(const Options& options)
+{
+    Fixture::Image arm64;
+    arm64.id = "@rpath/libfat.dylib";
+    arm64.rpaths = { "@loader_path/", "@loader_path/" };
+    Fixture::Image x86_64 = arm64;
+    x86_64.cputype = MachO::CPU_TYPE_X86_64;
+    const std::string path = options.root + "/libfat.dylib";
+    if (!writeFile(path, Fixture::fat({ Fixture::image(arm64), Fixture::image(x86_64) }))) return fail(options, "Cannot generate the files");
+
+    Settings::toolBackend("native");
+    selectTools();
+    if (!tools().changeRpath(path, "@loader_path/", "@executable_path/NEW")) return fail(options, "Cannot change the rpath");
+    MachO::File file;
+    if (!file.load(path) || file.sliceAmount() != 2) return fail(options, "Cannot read the edited library");
+    const std::vector<std::string> expected = { "@executable_path/NEW", "@loader_path/" };
+    for (size_t n = 0; n < file.sliceAmount(); n++)
+    {
+        if (file.slice(n).rpaths != expected) return fail(options, "The rpaths of slice " + std::to_string(n) + " are wrong");
+    }
+    return true;
+}
+
+// A universal library is bundled with its rpaths changed, and signed, in every slice.
+bool bundleUniversal(const Options& options)
+{
+    const std::string lib = options.root + "/lib/";
+    Fixture::Image arm64;
+    arm64.id = lib + "libfat.dylib";
+    arm64.rpaths = { "/opt/old/lib" };
+    arm64.code_pages = 3;
+    Fixture::Image x86_64 = arm64;
+    x86_64.cputype = MachO::CPU_TYPE_X86_64;
+    x86_64.seed = 1;
+    if (!makeDirectories(options.root + "/lib") || !makeDirectories(options.root + "/app/Contents/MacOS") ||
+        !writeFile(lib + "libfat.dylib", Fixture::fat({ Fixture::image(arm64), Fixture::image(x86_64) })) ||
+        !writeFile(options.root + "/app/Contents/MacOS/exe", image(MachO::MH_EXECUTE, "", std::vector<std::string>(1, lib + "libfat.dylib"), 1)))
+    {
+        return fail(options, "Cannot generate the files");
+    }
+
+    const std::vector<std::string> arguments = { "-b", "-cd", "-od", "--no-prompt", "-x", "app/Contents/MacOS/exe",
+                                                 "-d", "app/Contents/Frameworks", "-p", "@executable_path/../Frameworks/",
+                                                 "--tool-backend", "native" };
+    if (runDylibbundler(options, options.root, arguments) != 0) return fail(options, "Bundling failed");
+
+    MachO::File file;
+    if (!file.load(options.root + "/app/Contents/Frameworks/libfat.dylib") || file.sliceAmount() != 2)
+    {
+        return fail(options, "Cannot read the bundled library");
+    }
+    for (size_t n = 0; n < file.sliceAmount(); n++)
+    {
+        const MachO::Slice& slice = file.slice(n);
+        if (slice.rpaths != std::vector<std::string>(1, "@executable_path/../Frameworks/"))
+        {
+            return fail(options, "The rpath of slice " + std::to_string(n) + " wasn't changed");
+        }
+        if (slice.id.name != "@executable_path/../Frameworks/libfat.dylib") return fail(options, "The id of slice " + std::to_string(n) + " wasn't changed");
+        if (badPageHashes(slice) != 0) return fail(options, "Slice " + std::to_string(n) + " isn't validly signed");
+    }
+    return true;
+}
+
+struct Classification
+{
+    const char* path;
+    PathRules::Action action;
+};
+
+bool classifiesAs(const Options& options, const PathRules::RuleSet& rules, const std::vector<Classification>& expected,
+                  const std::string& what)
+{
+    for (const Classification& path : expected)
+    {
+        if (rules.classify(path.path) != path.action) return fail(options, std::string(path.path) + " is wrongly classified by " + what);
+    }
+    return true;
+}
+
+// How rules match paths: a directory alone only holds the libraries right in it, "/**" those at
+// any depth, the last matching rule wins wherever it is in the trie, globs backtrack, and -i
+// directories are taken literally.
+bool pathRules(const Options& options)
+{
+    PathRules::RuleSet exact;
+    exact.add(PathRules::IGNORE, "/opt/lib/");
+    exact.add(PathRules::IGNORE, "/opt/one/libone.dylib");
+    exact.add(PathRules::SYSTEM, "/opt/deep/**");
+    if (!classifiesAs(options, exact, {
+            { "/opt/lib/libA.dylib", PathRules::IGNORE },
+            { "/opt/lib/sub/libA.dylib", PathRules::BUNDLE },
+            { "/opt/libA.dylib", PathRules::BUNDLE },
+            { "/opt/one/libone.dylib", PathRules::IGNORE },
+            { "/opt/one/libone.dylib.1", PathRules::BUNDLE },
+            { "/opt/deep/a/b/libA.dylib", PathRules::SYSTEM },
+            { "/opt/deeper/libA.dylib", PathRules::BUNDLE },
+        }, "exact and recursive rules"))
+    {
+        return false;
+    }
+
+    PathRules::RuleSet last;
+    last.add(PathRules::IGNORE, "/opt/local/**");
+    last.add(PathRules::BUNDLE, "/opt/local/lib/libpng*");
+    last.add(PathRules::BUNDLE, "/a/b/c/**");
+    last.add(PathRules::IGNORE, "/a/**");
+    if (!classifiesAs(options, last, {
+            { "/opt/local/lib/libpng16.dylib", PathRules::BUNDLE },
+            { "/opt/local/lib/libz.dylib", PathRules::IGNORE },
+            { "/a/b/c/libA.dylib", PathRules::IGNORE },
+            { "/usr/lib/libSystem.B.dylib", PathRules::BUNDLE },
+        }, "the last matching rule"))
+    {
+        return false;
+    }
+
+    PathRules::RuleSet globs;
+    globs.add(PathRules::IGNORE, "/one/*/lib/*.dylib");
+    globs.add(PathRules::IGNORE, "/any/**/lib/*.dylib");
+    globs.add(PathRules::IGNORE, "/star/*ab*c");
+    globs.add(PathRules::IGNORE, "/class/lib[0-9][!a].dylib");
+    globs.add(PathRules::IGNORE, "/single/lib?.dylib");
+    if (!classifiesAs(options, globs, {
+            { "/one/x/lib/libA.dylib", PathRules::IGNORE },
+            { "/one/x/y/lib/libA.dylib", PathRules::BUNDLE },
+            { "/any/x/y/lib/libA.dylib", PathRules::IGNORE },
+            { "/any/lib/x/lib/libA.dylib", PathRules::IGNORE },
+            { "/any/lib/x/lib/sub/libA.dylib", PathRules::BUNDLE },
+            { "/star/aabxabyc", PathRules::IGNORE },
+            { "/star/aabxabyd", PathRules::BUNDLE },
+            { "/star/ab/c", PathRules::BUNDLE },
+            { "/class/lib1b.dylib", PathRules::IGNORE },
+            { "/class/lib1a.dylib", PathRules::BUNDLE },
+            { "/class/libxb.dylib", PathRules::BUNDLE },
+            { "/single/libA.dylib", PathRules::IGNORE },
+            { "/single/lib/.dylib", PathRules::BUNDLE },
+        }, "globs"))
+    {
+        return false;
+    }
+
+    Settings::ignore_prefix("/opt/weird[1]/");
+    Settings::ignore_prefix("/opt/star*");
+    if (!Settings::isPrefixIgnored("/opt/weird[1]/libA.dylib") || Settings::isPrefixIgnored("/opt/weird1/libA.dylib") ||
+        !Settings::isPrefixIgnored("/opt/star*/libA.dylib") || Settings::isPrefixIgnored("/opt/starry/libA.dylib"))
+    {
+        return fail(options, "Ignored directories are taken as patterns");
+    }
+    return true;
+}
+
+// ---- applying update packages ----
+
+uint64_t getNumber(const std::string& data, size_t at)
+{
+    uint64_t value = 0;
+    for (int n = 7; n >= 0; n--) value = (value << 8) | uint8_t(data[at + n]);
+    return value;
+}
+
+// 'old' patched by a .delta file
+bool applyDelta(const std::string& old, const std::string& delta, std::string& now)
+{
+    if (delta.size() < 24 || delta.compare(0, 8, "DBDELTA1") != 0) return false;
+    uLongf size = uLongf(getNumber(delta, 16));
+    std::string text(size, '\0');
+    if (uncompress(reinterpret_cast<Bytef*>(&text[0]), &size, reinterpret_cast<const Bytef*>(delta.data() + 24),
+                   uLong(delta.size() - 24)) != Z_OK || size != text.size())
+    {
+        return false;
+    }
+    now.clear();
+    for (size_t at = 0; at < text.size(); )
+    {
+        if (at + 9 > text.size()) return false;
+        const uint64_t first = getNumber(text, at + 1);
+        if (text[at] == 'C')
+        {
+            if (at + 17 > text.size()) return false;
+            const uint64_t length = getNumber(text, at + 9);
+            if (first > old.size() || length > old.size() - first) return false;
+            now.append(old, first, length);
+            at += 17;
+        }
+        else if (text[at] == 'L')
+        {
+            at += 9;
+            if (first > text.size() - at) return false;
+            now.append(text, at, first);
+            at += first;
+        }
+        else return false;
+    }
+    return now.size() == getNumber(delta, 8);
+}
+
+std::string hashOf(const std::string& contents)
+{
+    return Sha256::hex(Sha256::digest(contents));
+}
+
+bool exists(const std::string& path)
+{
+    struct stat st;
+    return lstat(path.c_str(), &st) == 0;
+}
+
+// the package in 'package' applied to 'dir' the way the README describes it, checking every
+// hash and that files are added and patched only where they are missing and present
+std::string applyPackage(const std::string& package, const std::string& dir)
+{
+    std::ifstream manifest((package + "/manifest").c_str());
+    std::string line;
+    if (!std::getline(manifest, line) || line != "dylibbundler delta 1") return "The manifest has no header";
+    while (std::getline(manifest, line))
+    {
+        std::vector<std::string> fields;
+        const size_t amount = line.compare(0, 6, "patch ") == 0 ? 3 : 2;
+        size_t at = 0;
+        for (size_t n = 0; n < amount && at != std::string::npos; n++)
+        {
+            const size_t space = line.find(' ', at);
+            fields.push_back(line.substr(at, space - at));
+            at = space == std::string::npos ? space : space + 1;
+        }
+        if (at == std::string::npos) return "Cannot read the manifest line " + line;
+        const std::string& kind = fields[0];
+        const std::string path = dir + "/" + line.substr(at);
+        const std::string given = package + "/" + line.substr(at);
+        const std::string& new_hash = fields.back();
+
+        if (kind == "same" || kind == "remove")
+        {
+            if (!exists(path) || hashOf(readFile(path)) != new_hash) return "The old version of " + path + " isn't the one listed";
+            if (kind == "remove" && unlink(path.c_str()) != 0) return "Cannot remove " + path;
+            continue;
+        }
+        std::string now;
+        if (kind == "add")
+        {
+            if (exists(path)) return path + " is added but was there";
+            now = readFile(given);
+        }
+        else if (kind == "patch")
+        {
+            if (!exists(path)) return path + " is patched but wasn't there";
+            const std::string old = readFile(path);
+            if (hashOf(old) != fields[1]) return "The old version of " + path + " isn't the one listed";
+            if (exists(given + ".delta") && !applyDelta(old, readFile(given + ".delta"), now)) return "Cannot apply " + given + ".delta";
+            if (!exists(given + ".delta")) now = readFile(given);
+        }
+        else return "Unknown manifest line " + line;
+        if (hashOf(now) != new_hash) return "The new version of " + path + " isn't the one listed";
+        if (!makeDirectories(path.substr(0, path.rfind('/'))) || !writeFile(path, now)) return "Cannot write " + path;
+    }
+    return "";
+}
+
+// regular files below 'dir', by path relative to it, with their contents
+void listFiles(const std::string& dir, const std::string& relative, std::map<std::string, std::string>& files)
+{
+    DIR* handle = opendir((dir + "/" + relative).c_str());
+    if (!handle) return;
+    while (struct dirent* entry = readdir(handle))
+    {
+        const std::string path = relative + entry->d_name;
+        struct stat st;
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || lstat((dir + "/" + path).c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) listFiles(dir, path + "/", files);
+        else files[path] = readFile(dir + "/" + path);
+    }
+    closedir(handle);
+}
+
+// bytes that don't compress, from 'seed'
+std::string noise(size_t size, uint32_t seed)
+{
+    std::string bytes;
+    for (; bytes.size() < size; seed = seed * 1103515245 + 12345) bytes += char(seed >> 16);
+    return bytes;
+}
+
+// An update package applied to the previous release gives the new one: unchanged, patched,
+// rewritten, added and removed files, checking the hashes of the manifest on the way.
+bool deltaRoundTrip(const Options& options)
+{
+    const std::string old_dir = options.root + "/old";
+    const std::string new_dir = options.root + "/new";
+    const std::string library = noise(256 << 10, 1);
+    std::string patched = library;
+    patched.replace(1000, 16, "a change in here");
+    patched.insert(100000, "some more code");
+    std::map<std::string, std::string> old_files;
+    std::map<std::string, std::string> new_files;
+    old_files["libSame.dylib"] = new_files["libSame.dylib"] = noise(4096, 2);
+    old_files["libPatched.dylib"] = library;
+    new_files["libPatched.dylib"] = patched;
+    old_files["Shared Libraries/lib Whole.dylib"] = noise(4096, 3);
+    new_files["Shared Libraries/lib Whole.dylib"] = noise(4096, 4);
+    new_files["sub/libNew.dylib"] = noise(1000, 5);
+    old_files["libGone.dylib"] = noise(1000, 6);
+    for (const auto& files : { std::make_pair(old_dir, &old_files), std::make_pair(new_dir, &new_files) })
+    {
+        for (const auto& file : *files.second)
+        {
+            const std::string path = files.first + "/" + file.first;
+            if (!makeDirectories(path.substr(0, path.rfind('/'))) || !writeFile(path, file.second))
+            {
+                return fail(options, "Cannot generate the files");
+            }
+        }
+    }
+
+    Settings::destFolder(new_dir);
+    Settings::deltaFrom(old_dir);
+    Settings::deltaOutput(options.root + "/delta");
+    Delta::write();
+    if (!exists(options.root + "/delta/libPatched.dylib.delta")) return fail(options, "The changed library isn't given as a diff");
+    const std::string error = applyPackage(options.root + "/delta", old_dir);
+    if (!error.empty()) return fail(options, error);
+
+    std::map<std::string, std::string> updated;
+    listFiles(old_dir, "", updated);
+    if (updated != new_files) return fail(options, "The package doesn't give the new files");
+    return true;
+}
+
+// ---- reading archives back ----
+
+struct Entry
+{
+    std::string contents;  // the target, for a symbolic link
+    mode_t mode;
+    bool symlink;
+};
+
+// 'data' inflated, as gzip members one after the other or as raw deflate
+bool inflateAll(const std::string& data, int window_bits, std::string& out)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, window_bits) != Z_OK) return false;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = uInt(data.size());
+    char buffer[1 << 16];
+    int status = Z_OK;
+    while (status == Z_OK || (status == Z_STREAM_END && stream.avail_in > 0 && inflateReset(&stream) == Z_OK))
+    {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return status == Z_STREAM_END && stream.avail_in == 0;
+}
+
+bool readTar(const std::string& data, std::map<std::string, Entry>& entries)
+{
+    const auto field = [&](size_t at, size_t width)
+    {
+        const std::string value = data.substr(at, width);
+        return value.substr(0, value.find('\0'));
+    };
+    std::string pax_path;
+    for (size_t at = 0; at + 512 <= data.size(); )
+    {
+        if (data.compare(at, 512, std::string(512, '\0')) == 0) return true;
+        const size_t size = strtoull(field(at + 124, 12).c_str(), NULL, 8);
+        const char type = data[at + 156];
+        const std::string contents = data.substr(at + 512, size);
+        const std::string prefix = field(at + 345, 155);
+        const std::string name = !pax_path.empty() ? pax_path : (prefix.empty() ? "" : prefix + "/") + field(at, 100);
+        if (type == 'x')
+        {
+            const size_t path = contents.find(" path=");
+            if (path != std::string::npos) pax_path = contents.substr(path + 6, contents.find('\n', path) - path - 6);
+        }
+        else
+        {
+            Entry& entry = entries[name];
+            entry.mode = strtoul(field(at + 100, 8).c_str(), NULL, 8);
+            entry.symlink = type == '2';
+            entry.contents = entry.symlink ? field(at + 157, 100) : contents;
+            pax_path.clear();
+        }
+        at += 512 + (size + 511) / 512 * 512;
+    }
+    return false;
+}
+
+bool readZip(const std::string& data, std::map<std::string, Entry>& entries)
+{
+    if (data.size() < 22 || MachO::read32(data, data.size() - 22) != 0x06054b50) return false;
+    const auto read16 = [&](size_t at) { return uint32_t(uint8_t(data[at])) | uint32_t(uint8_t(data[at + 1])) << 8; };
+    const uint32_t amount = read16(data.size() - 22 + 10);
+    size_t at = MachO::read32(data, data.size() - 22 + 16);
+    for (uint32_t n = 0; n < amount; n++)
+    {
+        if (MachO::read32(data, at) != 0x02014b50) return false;
+        const uint32_t method = read16(at + 10);
+        const uint32_t compressed_size = MachO::read32(data, at + 20);
+        const uint32_t name_size = read16(at + 28);
+        const uint32_t attributes = MachO::read32(data, at + 38) >> 16;
+        const uint32_t local = MachO::read32(data, at + 42);
+        const std::string name = data.substr(at + 46, name_size);
+        at += 46 + name_size + read16(at + 30) + read16(at + 32);
+
+        const std::string stored = data.substr(local + 30 + read16(local + 26) + read16(local + 28), compressed_size);
+        Entry& entry = entries[name];
+        entry.mode = attributes & 07777;
+        entry.symlink = S_ISLNK(attributes);
+        if (method == 0) entry.contents = stored;
+        else if (method != 8 || !inflateAll(stored, -15, entry.contents)) return false;
+    }
+    return true;
+}
+
+// What goes into an archive reads back the same in each format: contents, modes, symbolic links,
+// and names too long for a tar header.
+bool archives(const Options& options)
+{
+    const std::string dest = options.root + "/Test.app/Contents/Frameworks";
+    const std::string long_name = std::string(120, 'x') + ".dylib";
+    // large enough for several gzip members
+    std::string library;
+    for (uint32_t seed = 1; library.size() < (3 << 20); seed = seed * 1103515245 + 12345) library += char(seed >> 16);
+    if (!makeDirectories(dest) || symlink("libA.dylib", (dest + "/libA.1.dylib").c_str()) != 0)
+    {
+        return fail(options, "Cannot generate the files");
+    }
+    Settings::destFolder(dest);
+
+    std::map<std::string, Entry> expected;
+    expected["Test.app/Contents/Frameworks/libA.dylib"] = Entry{ library, 0755, false };
+    expected["Test.app/Contents/Frameworks/" + long_name] = Entry{ "small", 0644, false };
+    expected["Test.app/Contents/Frameworks/libA.1.dylib"] = Entry{ "libA.dylib", 0777, true };
+    for (const char* extension : { ".tar", ".tar.gz", ".zip" })
+    {
+        const std::string path = options.root + "/bundle" + extension;
+        Settings::archive(path);
+        Archive::open();
+        Archive::addFile(dest + "/libA.dylib", library, 0755);
+        Archive::addFile(dest + "/" + long_name, "small", 0644);
+        Archive::addFromDisk(dest + "/libA.1.dylib");
+        Archive::close();
+
+        const std::string data = readFile(path);
+        std::string tar;
+        std::map<std::string, Entry> entries;
+        const bool read = strcmp(extension, ".zip") == 0 ? readZip(data, entries) :
+                          strcmp(extension, ".tar") == 0 ? readTar(data, entries) :
+                          inflateAll(data, 15 + 16, tar) && readTar(tar, entries);
+        if (!read) return fail(options, std::string("Cannot read the ") + extension + " archive");
+        if (entries.size() != expected.size()) return fail(options, std::string("The ") + extension + " archive has other entries");
+        for (const auto& entry : expected)
+        {
+            const auto found = entries.find(entry.first);
+            // links have no mode of their own on some systems
+            if (found == entries.end() || found->second.contents != entry.second.contents ||
+                found->second.symlink != entry.second.symlink || (!entry.second.symlink && found->second.mode != entry.second.mode))
+            {
+                return fail(options, std::string("The ") + extension + " archive has the wrong " + entry.first);
+            }
+        }
+    }
+    return true;
+}
+
+struct Test
+{
+    const char* name;
+    bool (*run)(const Options&);
+};
+
+const Test tests[] =
+{
+    { "archives", archives },
+    { "bundle-universal", bundleUniversal },
+    { "change-rpath-in-every-slice", changeRpathInEverySlice },
+    { "delta-round-trip", deltaRoundTrip },
+    { "drop-unused", dropUnused },
+    { "path-rules", pathRules },
+    { "replay-with-journal", replayWithJournal },
+    { "resign-stale-signature", resignStaleSignature },
+    { "response-files", responseFiles },
+    { "thin-and-strip", thinAndStrip },
+};
+
+void showHelp()
+{
+    std::cout << "dylibbundler-tests --dylibbundler <path> <test>" << std::endl;
+    std::cout << "tests:";
+    for (const Test& test : tests) std::cout << " " << test.name;
+    std::cout << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::string name;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--dylibbundler" && i + 1 < argc) options.dylibbundler = argv[++i];
+        else if (name.empty() && arg[0] != '-') name = arg;
+        else
+        {
+            showHelp();
+            return 1;
+        }
+    }
+
+    for (const Test& test : tests)
+    {
+        if (name != test.name) continue;
+        const char* tmp = getenv("TMPDIR");
+        std::string root_template = std::string(tmp && *tmp ? tmp : "/tmp") + "/dylibbundler-test.XXXXXX";
+        if (options.dylibbundler.empty() || !mkdtemp(&root_template[0]))
+        {
+            showHelp();
+            return 1;
+        }
+        options.root = root_template;
+        if (!test.run(options)) return 1;
+        nftw(options.root.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+        std::cout << "* " << name << " passed" << std::endl;
+        return 0;
+    }
+    showHelp();
+    return 1;
+}